@@ -0,0 +1,633 @@
+/// End-to-end benchmark of site builds.
+///
+/// Generates a synthetic site from a seed, then times builds of it with mkweb:
+///
+/// - `full`: everything rendered, state and destination removed before.
+/// - `no-op`: nothing changed since the previous build.
+/// - `single-file`: one document changed and rendered by itself (`--file`).
+///
+/// Reported are the wall time and the durations of the phases of each build
+/// (see `mkweb --timings`), medians over all runs, in milliseconds.
+///
+/// By default pandoc is replaced by a deterministic stub, this very program
+/// invoked as `pandoc`, to measure the overhead of mkweb by itself. It writes
+/// a simplified JSON representation and HTML documents containing their input.
+///
+/// Usage: mkweb_bench [--pages N] [--tags N] [--years N] [--plugins PERCENT]
+///   [--links N] [--seed N] [--runs N] [--jobs N] [--builtin] [--pandoc FILE]
+///   [--mkweb FILE] [--shared DIR] [--dir DIR]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <experimental/filesystem>
+
+#ifndef MKWEB_BINARY
+	#define MKWEB_BINARY "mkweb"
+#endif
+
+#ifndef MKWEB_SHARED
+	#define MKWEB_SHARED "shared"
+#endif
+
+namespace
+{
+namespace fs = std::experimental::filesystem;
+
+using clock = std::chrono::steady_clock;
+
+const std::vector<std::string> phases
+	= {"collect", "overviews", "pages", "front", "sitemap", "redirect", "copy", "plugins"};
+
+std::string read_file(const std::string & filename)
+{
+	std::ifstream ifs{filename.c_str(), std::ios::binary};
+	return {std::istreambuf_iterator<char>{ifs}, std::istreambuf_iterator<char>{}};
+}
+
+void write_file(const std::string & filename, const std::string & contents)
+{
+	fs::create_directories(fs::path{filename}.parent_path());
+	std::ofstream ofs{filename.c_str(), std::ios::binary};
+	ofs << contents;
+}
+
+bool is_space(char c)
+{
+	return (c == ' ') || (c == '\t') || (c == '\n');
+}
+
+std::string json_string(const std::string & s)
+{
+	std::string result = "\"";
+	for (const auto c : s) {
+		switch (c) {
+			case '"':
+				result += "\\\"";
+				break;
+			case '\\':
+				result += "\\\\";
+				break;
+			case '\n':
+				result += "\\n";
+				break;
+			case '\t':
+				result += "\\t";
+				break;
+			default:
+				if (static_cast<unsigned char>(c) < 0x20)
+					continue;
+				result += c;
+				break;
+		}
+	}
+	return result + '"';
+}
+
+std::string escape_html(const std::string & s)
+{
+	std::string result;
+	for (const auto c : s) {
+		switch (c) {
+			case '&':
+				result += "&amp;";
+				break;
+			case '<':
+				result += "&lt;";
+				break;
+			case '>':
+				result += "&gt;";
+				break;
+			default:
+				result += c;
+				break;
+		}
+	}
+	return result;
+}
+
+/// The pandoc stub: inline elements of a paragraph as JSON, words, spaces,
+/// links and images.
+std::string stub_inlines(const std::string & text)
+{
+	std::vector<std::string> nodes;
+	std::size_t i = 0;
+	while (i < text.size()) {
+		if (is_space(text[i])) {
+			while ((i < text.size()) && is_space(text[i]))
+				++i;
+			nodes.push_back("{\"t\":\"Space\"}");
+			continue;
+		}
+
+		const auto image = (text[i] == '!') && (i + 1 < text.size()) && (text[i + 1] == '[');
+		if ((text[i] == '[') || image) {
+			const auto first = i + (image ? 2 : 1);
+			const auto middle = text.find("](", first);
+			const auto last = (middle == std::string::npos) ? middle : text.find(')', middle);
+			if (last != std::string::npos) {
+				nodes.push_back(std::string{"{\"t\":\""} + (image ? "Image" : "Link")
+					+ "\",\"c\":[[\"\",[],[]],[{\"t\":\"Str\",\"c\":"
+					+ json_string(text.substr(first, middle - first)) + "}],["
+					+ json_string(text.substr(middle + 2, last - middle - 2)) + ",\"\"]]}");
+				i = last + 1;
+				continue;
+			}
+		}
+
+		auto end = i;
+		while ((end < text.size()) && !is_space(text[end]))
+			++end;
+		nodes.push_back("{\"t\":\"Str\",\"c\":" + json_string(text.substr(i, end - i)) + "}");
+		i = end;
+	}
+
+	std::string result = "[";
+	for (std::size_t n = 0; n < nodes.size(); ++n)
+		result += ((n > 0) ? "," : "") + nodes[n];
+	return result + "]";
+}
+
+/// The pandoc stub: reads a markdown document into JSON blocks. The front
+/// matter is skipped, only keys of batched documents are kept as metadata.
+void stub_read(const std::string & text, std::vector<std::string> & blocks,
+	std::vector<std::string> & meta)
+{
+	std::istringstream is{text};
+	std::string line;
+	std::vector<std::string> lines;
+	while (std::getline(is, line))
+		lines.push_back(line);
+
+	std::size_t i = 0;
+	if (!lines.empty() && (lines[0] == "---")) {
+		for (i = 1; (i < lines.size()) && (lines[i] != "---") && (lines[i] != "..."); ++i) {
+			if (lines[i].compare(0, 12, "mkweb-batch-") == 0)
+				meta.push_back(json_string(lines[i].substr(0, lines[i].find(':')))
+					+ ":{\"t\":\"MetaMap\",\"c\":{}}");
+		}
+		++i;
+	}
+
+	std::string paragraph;
+	auto flush = [&] {
+		if (paragraph.empty())
+			return;
+		if (paragraph.compare(0, 4, "<!--") == 0) {
+			blocks.push_back("{\"t\":\"RawBlock\",\"c\":[\"html\"," + json_string(paragraph) + "]}");
+		} else if (paragraph[0] == '#') {
+			const auto level = paragraph.find_first_not_of('#');
+			blocks.push_back("{\"t\":\"Header\",\"c\":[" + std::to_string(level)
+				+ ",[\"\",[],[]]," + stub_inlines(paragraph.substr(level)) + "]}");
+		} else {
+			blocks.push_back("{\"t\":\"Para\",\"c\":" + stub_inlines(paragraph) + "}");
+		}
+		paragraph.clear();
+	};
+	for (; i < lines.size(); ++i) {
+		if (lines[i].find_first_not_of(" \t") == std::string::npos) {
+			flush();
+		} else {
+			paragraph += (paragraph.empty() ? "" : "\n") + lines[i];
+		}
+	}
+	flush();
+}
+
+/// A deterministic stand-in for pandoc, see above.
+int pandoc_stub(int argc, char ** argv)
+{
+	const std::vector<std::string> args(argv + 1, argv + argc);
+	if (std::find(begin(args), end(args), "--version") != end(args)) {
+		std::cout << "pandoc 2.19.2\n";
+		return 0;
+	}
+
+	std::string to;
+	std::string out;
+	std::vector<std::string> inputs;
+	std::vector<std::string> includes;
+	for (std::size_t i = 0; i < args.size(); ++i) {
+		const auto & a = args[i];
+		const auto has_arg = (i + 1) < args.size();
+		if ((a == "-t") && has_arg) {
+			to = args[++i];
+		} else if ((a == "-o") && has_arg) {
+			out = args[++i];
+		} else if (((a == "-H") || (a == "-A") || (a == "--template")) && has_arg) {
+			includes.push_back(args[++i]);
+		} else if (((a == "-f") || (a == "-V") || (a == "-M") || (a == "-d")
+					   || (a == "--defaults") || (a == "--lua-filter")
+					   || (a == "--metadata-file"))
+			&& has_arg) {
+			++i;
+		} else if (a.compare(0, 1, "-") != 0) {
+			inputs.push_back(a);
+		}
+	}
+
+	std::vector<std::string> texts;
+	for (const auto & input : inputs)
+		texts.push_back(read_file(input));
+	if (texts.empty())
+		texts.emplace_back(std::istreambuf_iterator<char>{std::cin}, std::istreambuf_iterator<char>{});
+
+	if (to == "json") {
+		std::vector<std::string> blocks;
+		std::vector<std::string> meta;
+		for (const auto & text : texts)
+			stub_read(text, blocks, meta);
+
+		std::string json = "{\"pandoc-api-version\":[1,22,2,1],\"meta\":{";
+		for (std::size_t i = 0; i < meta.size(); ++i)
+			json += ((i > 0) ? "," : "") + meta[i];
+		json += "},\"blocks\":[";
+		for (std::size_t i = 0; i < blocks.size(); ++i)
+			json += ((i > 0) ? "," : "") + blocks[i];
+		std::cout << json << "]}\n";
+		return 0;
+	}
+
+	std::string html = "<!DOCTYPE html>\n<html>\n<head>\n";
+	for (const auto & include : includes)
+		html += read_file(include);
+	html += "</head>\n<body>\n<pre>";
+	for (const auto & text : texts)
+		html += escape_html(text);
+	html += "</pre>\n</body>\n</html>\n";
+
+	if (out.empty()) {
+		std::cout << html;
+	} else {
+		std::ofstream ofs{out.c_str(), std::ios::binary};
+		ofs << html;
+		if (!ofs)
+			return 1;
+	}
+	return 0;
+}
+
+/// Pseudo random numbers, the same for a seed on every platform (unlike the
+/// distributions of the standard library).
+class random_numbers
+{
+public:
+	explicit random_numbers(std::uint64_t seed)
+		: state_(seed * 0x9e3779b97f4a7c15ull + 1)
+	{
+	}
+
+	/// Returns a number within `[0, n)`.
+	unsigned below(unsigned n)
+	{
+		state_ ^= state_ >> 12;
+		state_ ^= state_ << 25;
+		state_ ^= state_ >> 27;
+		return static_cast<unsigned>((state_ * 0x2545f4914f6cdd1dull) >> 33) % n;
+	}
+
+private:
+	std::uint64_t state_;
+};
+
+struct site_options {
+	unsigned pages = 200;
+	unsigned tags = 20;
+	unsigned years = 5;
+	unsigned plugins = 10; // percentage of pages using a plugin
+	unsigned links = 5; // per page
+	unsigned seed = 1;
+	bool builtin = false; // markdown rendered by mkweb itself
+};
+
+std::string page_path(unsigned index, unsigned year)
+{
+	return "pages/" + std::to_string(year) + "/page-" + std::to_string(index) + ".md";
+}
+
+/// Writes the configuration, documents and static files of a synthetic site.
+///
+/// \return Source filenames of all documents, relative to the site.
+std::vector<std::string> generate_site(const std::string & dir, const site_options & opt)
+{
+	static const std::vector<std::string> words = {"lorem", "ipsum", "dolor", "sit", "amet",
+		"consectetur", "adipiscing", "elit", "sed", "do", "eiusmod", "tempor", "incididunt",
+		"ut", "labore", "et", "dolore", "magna", "aliqua", "enim", "ad", "minim", "veniam",
+		"quis", "nostrud", "exercitation", "ullamco", "laboris", "nisi", "aliquip", "ex", "ea",
+		"commodo", "consequat"};
+
+	random_numbers rnd{opt.seed};
+
+	write_file(dir + "/config.yml",
+		"source: pages\n"
+		"destination: public\n"
+		"static: files\n"
+		"plugins: public/plugins\n"
+		"source-process-filetypes: [ '.md' ]\n"
+		"site_url: http://localhost/bench/\n"
+		"plugin_url: ${site_url}plugins/\n"
+		"site_title: mkweb Benchmark\n"
+		"site_subtitle: synthetic site\n"
+		"author: The Author\n"
+		"num_news: 8\n"
+		"theme: default\n"
+		"tags-enable: true\n"
+		"page-tags-enable: true\n"
+		"pagelist:\n"
+		"  enable: true\n"
+		"  sort: { direction: 'ascending', key: 'title' }\n"
+		"yearlist:\n"
+		"  enable: true\n"
+		"  sort: { direction: 'descending', key: 'date' }\n"
+		"sitemap:\n"
+		"  enable: true\n"
+		"  sort: { direction: 'ascending', key: 'title' }\n"
+		"menu-enable: true\n"
+		"menu: |\n"
+		"  <ul>\n"
+		"  <li><a href=\"${site_url}\">Home</a></li>\n"
+		"  </ul>\n"
+		"path_map: [\n"
+		"  { base: 'pages', url: '', absolute: false },\n"
+		"  { base: 'files', url: '', absolute: false }\n"
+		"  ]\n"
+		"renderer:\n"
+		"  engine: "
+			+ std::string{opt.builtin ? "builtin" : "pandoc"} + "\n");
+
+	const auto num_images = std::max(opt.pages / 20, 1u);
+	for (unsigned i = 0; i < num_images; ++i) {
+		std::string data(1024, '\0');
+		for (auto & c : data)
+			c = static_cast<char>(rnd.below(256));
+		write_file(dir + "/files/img-" + std::to_string(i) + ".png", data);
+	}
+
+	const auto first_year = 2020 - std::max(opt.years, 1u) + 1;
+	std::vector<unsigned> years;
+	for (unsigned i = 0; i < opt.pages; ++i)
+		years.push_back(first_year + rnd.below(std::max(opt.years, 1u)));
+
+	std::vector<std::string> documents;
+	for (unsigned i = 0; i < opt.pages; ++i) {
+		const auto author = rnd.below(3);
+		const auto month = 1 + rnd.below(12);
+		const auto day = 1 + rnd.below(28);
+
+		std::ostringstream os;
+		os << "---\n"
+		   << "title: Page " << i << '\n'
+		   << "author: Author " << author << '\n'
+		   << "date: " << years[i] << '-' << month / 10 << month % 10 << '-' << day / 10
+		   << day % 10 << '\n'
+		   << "summary: Summary of page " << i << '\n';
+		if (opt.tags > 0) {
+			os << "tags: [";
+			const auto num_tags = 1 + rnd.below(3);
+			for (unsigned t = 0; t < num_tags; ++t)
+				os << ((t > 0) ? ", " : "") << "tag-" << rnd.below(opt.tags);
+			os << "]\n";
+		}
+		if (rnd.below(100) < opt.plugins)
+			os << "plugins: [osm]\n";
+		os << "---\n\n";
+
+		const auto num_paragraphs = 3 + rnd.below(4);
+		std::vector<unsigned> links(num_paragraphs, 0);
+		for (unsigned l = 0; l < opt.links; ++l)
+			++links[rnd.below(num_paragraphs)];
+
+		for (unsigned p = 0; p < num_paragraphs; ++p) {
+			if (p % 2 == 0)
+				os << "# Section " << (p / 2 + 1) << "\n\n";
+			const auto num_words = 40 + rnd.below(40);
+			for (unsigned w = 0; w < num_words; ++w)
+				os << ((w > 0) ? " " : "") << words[rnd.below(words.size())];
+			for (unsigned l = 0; l < links[p]; ++l) {
+				if (rnd.below(5) == 0) {
+					os << " ![image](files/img-" << rnd.below(num_images) << ".png)";
+				} else {
+					const auto target = rnd.below(opt.pages);
+					auto link = page_path(target, years[target]);
+					link.replace(link.size() - 3, 3, ".html");
+					os << " [page " << target << "](" << link << ")";
+				}
+			}
+			os << ".\n\n";
+		}
+
+		documents.push_back(page_path(i, years[i]));
+		write_file(dir + '/' + documents.back(), os.str());
+	}
+	return documents;
+}
+
+struct build_result {
+	double total = 0.0; // milliseconds
+	std::map<std::string, double> phases;
+};
+
+std::string quote(const std::string & s)
+{
+	std::string result = "'";
+	for (const auto c : s)
+		result += (c == '\'') ? std::string{"'\\''"} : std::string(1, c);
+	return result + "'";
+}
+
+/// Runs mkweb within the site, the durations of the phases are taken from
+/// its output.
+build_result build(const std::string & site, const std::string & command)
+{
+	const auto t0 = clock::now();
+	const auto p = ::popen(("cd " + quote(site) + " && " + command + " 2>&1").c_str(), "r");
+	if (!p) {
+		std::cerr << "error: unable to execute: " << command << '\n';
+		std::exit(EXIT_FAILURE);
+	}
+	std::string output;
+	char buffer[4096];
+	for (std::size_t n; (n = std::fread(buffer, 1, sizeof(buffer), p)) > 0;)
+		output.append(buffer, n);
+	const auto rc = ::pclose(p);
+
+	build_result result;
+	result.total = std::chrono::duration<double, std::milli>(clock::now() - t0).count();
+
+	if (rc != 0) {
+		std::cerr << output << "error: build failed: " << command << '\n';
+		std::exit(EXIT_FAILURE);
+	}
+
+	std::istringstream is{output};
+	std::string line;
+	while (std::getline(is, line)) {
+		std::istringstream ls{line};
+		std::string tag;
+		std::string phase;
+		double ms = 0.0;
+		if ((ls >> tag >> phase >> ms) && (tag == "timing"))
+			result.phases[phase] = ms;
+	}
+	return result;
+}
+
+double median(std::vector<double> v)
+{
+	if (v.empty())
+		return 0.0;
+	std::sort(begin(v), end(v));
+	return (v.size() % 2) ? v[v.size() / 2] : (v[v.size() / 2 - 1] + v[v.size() / 2]) / 2.0;
+}
+
+void report(const std::string & scenario, const std::vector<build_result> & results)
+{
+	std::vector<double> totals;
+	for (const auto & r : results)
+		totals.push_back(r.total);
+	std::printf("%-12s %10.1f", scenario.c_str(), median(totals));
+
+	for (const auto & phase : phases) {
+		std::vector<double> values;
+		for (const auto & r : results) {
+			const auto i = r.phases.find(phase);
+			if (i != r.phases.end())
+				values.push_back(i->second);
+		}
+		if (values.empty()) {
+			std::printf(" %10s", "-");
+		} else {
+			std::printf(" %10.1f", median(values));
+		}
+	}
+	std::printf("\n");
+}
+
+/// Copies a file, keeping it executable.
+void copy_executable(const std::string & from, const std::string & to)
+{
+	fs::create_directories(fs::path{to}.parent_path());
+	fs::copy_file(from, to, fs::copy_options::overwrite_existing);
+	fs::permissions(to, fs::perms::add_perms | fs::perms::owner_exec);
+}
+}
+
+int main(int argc, char ** argv)
+{
+	if (fs::path{argv[0]}.filename() == "pandoc")
+		return pandoc_stub(argc, argv);
+
+	site_options opt;
+	unsigned runs = 3;
+	unsigned jobs = 0;
+	std::string mkweb = MKWEB_BINARY;
+	std::string shared = MKWEB_SHARED;
+	std::string pandoc;
+	std::string dir;
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string a = argv[i];
+		const auto has_arg = (i + 1) < argc;
+		auto number = [&] { return static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10)); };
+		if ((a == "--pages") && has_arg) {
+			opt.pages = std::max(number(), 1u);
+		} else if ((a == "--tags") && has_arg) {
+			opt.tags = number();
+		} else if ((a == "--years") && has_arg) {
+			opt.years = number();
+		} else if ((a == "--plugins") && has_arg) {
+			opt.plugins = number();
+		} else if ((a == "--links") && has_arg) {
+			opt.links = number();
+		} else if ((a == "--seed") && has_arg) {
+			opt.seed = number();
+		} else if ((a == "--runs") && has_arg) {
+			runs = std::max(number(), 1u);
+		} else if ((a == "--jobs") && has_arg) {
+			jobs = number();
+		} else if (a == "--builtin") {
+			opt.builtin = true;
+		} else if ((a == "--pandoc") && has_arg) {
+			pandoc = fs::canonical(argv[++i]).string();
+		} else if ((a == "--mkweb") && has_arg) {
+			mkweb = argv[++i];
+		} else if ((a == "--shared") && has_arg) {
+			shared = argv[++i];
+		} else if ((a == "--dir") && has_arg) {
+			dir = argv[++i];
+		} else {
+			std::cerr << "usage: " << argv[0]
+					  << " [--pages N] [--tags N] [--years N] [--plugins PERCENT] [--links N]"
+						 " [--seed N] [--runs N] [--jobs N] [--builtin] [--pandoc FILE]"
+						 " [--mkweb FILE] [--shared DIR] [--dir DIR]\n";
+			return EXIT_FAILURE;
+		}
+	}
+
+	// mkweb finds themes and plugins relative to its binary
+	const auto keep = !dir.empty();
+	if (dir.empty()) {
+		char tmpl[] = "/tmp/mkweb-bench-XXXXXX";
+		if (!::mkdtemp(tmpl)) {
+			std::cerr << "error: unable to create temporary directory\n";
+			return EXIT_FAILURE;
+		}
+		dir = tmpl;
+	}
+	dir = fs::absolute(dir).string();
+	const auto site = dir + "/site";
+	fs::remove_all(site);
+	fs::remove_all(dir + "/shared");
+	copy_executable(mkweb, dir + "/bin/mkweb");
+	fs::create_directories(dir + "/shared/mkweb");
+	fs::copy(fs::path{shared} / "mkweb", dir + "/shared/mkweb", fs::copy_options::recursive);
+	if (pandoc.empty()) {
+		pandoc = dir + "/stub/pandoc";
+		copy_executable(fs::read_symlink("/proc/self/exe").string(), pandoc);
+	}
+
+	const auto documents = generate_site(site, opt);
+
+	std::string command = quote(dir + "/bin/mkweb") + " --timings --pandoc " + quote(pandoc);
+	if (jobs > 0)
+		command += " -j " + std::to_string(jobs);
+
+	std::printf("%u pages, %u tags, %u years, %u%% plugins, %u links/page, seed %u, %u runs, %s\n",
+		opt.pages, opt.tags, opt.years, opt.plugins, opt.links, opt.seed, runs,
+		(pandoc == dir + "/stub/pandoc") ? "pandoc stub" : pandoc.c_str());
+	std::printf("%-12s %10s", "[ms]", "total");
+	for (const auto & phase : phases)
+		std::printf(" %10s", phase.c_str());
+	std::printf("\n");
+
+	std::vector<build_result> full;
+	std::vector<build_result> noop;
+	std::vector<build_result> single;
+	for (unsigned run = 0; run < runs; ++run) {
+		fs::remove_all(site + "/public");
+		fs::remove_all(site + "/.mkweb");
+		full.push_back(build(site, command));
+		noop.push_back(build(site, command));
+
+		const auto & document = documents[run % documents.size()];
+		std::ofstream{(site + '/' + document).c_str(), std::ios::app}
+			<< "\nChanged in run " << run << ".\n";
+		single.push_back(build(site, command + " --file " + quote(document)));
+	}
+	report("full", full);
+	report("no-op", noop);
+	report("single-file", single);
+
+	if (!keep)
+		fs::remove_all(dir);
+	return 0;
+}
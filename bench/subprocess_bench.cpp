@@ -0,0 +1,122 @@
+/// Micro-benchmark of the throughput of `utils::subprocess`.
+///
+/// Moves data through a pipe from and to a child process:
+///
+/// - `legacy`: the former setup, a `stdio_filebuf` with a buffer size of 1
+///   read by `std::istream_iterator`, one virtual call and one system call
+///   per byte.
+/// - `stream`: the output stream of the subprocess, read by
+///   `std::istreambuf_iterator`, byte by byte from a large buffer.
+/// - `bulk`: the output of the subprocess read in large blocks (`read_out`).
+/// - `communicate`: data written to `cat` and read back at the same time.
+///
+/// Usage: subprocess_bench [MiB]
+
+#include "subprocess.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <ext/stdio_filebuf.h>
+
+namespace
+{
+using clock = std::chrono::steady_clock;
+
+void report(const char * name, std::size_t size, clock::duration d, std::size_t result)
+{
+	const auto s = std::chrono::duration<double>(d).count();
+	std::printf("%-12s %8.1f MiB/s %8.2f ns/byte%s\n", name, size / s / (1024.0 * 1024.0),
+		s * 1e9 / size, (result == size) ? "" : "  (size mismatch)");
+}
+
+/// The former way: unbuffered stream on the pipe, copied per character.
+std::size_t legacy(const std::string & filename)
+{
+	int p[2];
+	if (::pipe(p) == -1)
+		std::abort();
+
+	const auto pid = ::fork();
+	if (pid == 0) {
+		::dup2(p[1], STDOUT_FILENO);
+		::close(p[0]);
+		::close(p[1]);
+		::execlp("cat", "cat", filename.c_str(), static_cast<char *>(nullptr));
+		::_exit(127);
+	}
+	::close(p[1]);
+
+	__gnu_cxx::stdio_filebuf<char> buf{p[0], std::ios_base::in, 1};
+	std::istream is{&buf};
+	std::ostringstream os;
+	is >> std::noskipws;
+	std::copy(std::istream_iterator<char>{is}, std::istream_iterator<char>{},
+		std::ostream_iterator<char>{os});
+	::waitpid(pid, nullptr, 0);
+	return os.str().size();
+}
+
+std::size_t stream(const std::string & filename)
+{
+	utils::subprocess p{{"cat", filename}};
+	p.exec();
+	p.close_in();
+	const std::string s{std::istreambuf_iterator<char>{p.out()}, std::istreambuf_iterator<char>{}};
+	p.wait();
+	return s.size();
+}
+
+std::size_t bulk(const std::string & filename)
+{
+	utils::subprocess p{{"cat", filename}};
+	p.exec();
+	p.close_in();
+	const auto s = p.read_out();
+	p.wait();
+	return s.size();
+}
+
+std::size_t communicate(const std::string & data)
+{
+	utils::subprocess p{{"cat"}};
+	std::string out;
+	std::string err;
+	p.exec();
+	p.communicate(data, out, err);
+	return out.size();
+}
+}
+
+int main(int argc, char ** argv)
+{
+	const std::size_t mib = (argc > 1) ? std::strtoul(argv[1], nullptr, 10) : 16;
+	const std::size_t size = mib * 1024 * 1024;
+
+	std::string data(size, '\0');
+	for (std::size_t i = 0; i < size; ++i)
+		data[i] = static_cast<char>('a' + (i % 26));
+
+	const std::string filename = "/tmp/subprocess_bench.dat";
+	{
+		std::ofstream ofs{filename.c_str(), std::ios::binary};
+		ofs.write(data.data(), static_cast<std::streamsize>(data.size()));
+	}
+
+	auto run = [&](const char * name, auto func) {
+		const auto t0 = clock::now();
+		const auto result = func();
+		report(name, size, clock::now() - t0, result);
+	};
+
+	run("legacy", [&] { return legacy(filename); });
+	run("stream", [&] { return stream(filename); });
+	run("bulk", [&] { return bulk(filename); });
+	run("communicate", [&] { return communicate(data); });
+
+	std::remove(filename.c_str());
+	return 0;
+}
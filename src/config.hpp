@@ -1,15 +1,9 @@
 #ifndef MKWEB__CONFIG_HPP
 #define MKWEB__CONFIG_HPP
 
-#include <memory>
 #include <string>
 #include <vector>
 
-namespace YAML
-{
-class Node; // forward declaration
-}
-
 namespace mkweb
 {
 class config
@@ -50,8 +44,20 @@ public:
 		sort_description sorting;
 	};
 
-	~config();
+	struct cache {
+		bool enable = false;
+		std::string directory;
+		int max_size = 0; // MiB, 0: unlimited
+	};
+
+	struct renderer {
+		bool builtin = false; // markdown rendered in-process, pandoc as fallback
+		std::vector<std::string> filetypes; // of sources rendered in-process
+	};
 
+	/// Reads the configuration file and resolves all values, including the
+	/// substitution of variables (`${name}`). The file is not needed anymore
+	/// afterwards, the configuration is immutable and may be shared by threads.
 	config(const std::string & filename);
 
 	config(const config &) = delete;
@@ -60,60 +66,70 @@ public:
 	config(config &&) = default;
 	config & operator=(config &&) = default;
 
-	std::string get_source() const;
-	std::string get_destination() const;
-	std::string get_static() const;
+	const std::string & get_source() const { return source_; }
+	const std::string & get_destination() const { return destination_; }
+	const std::string & get_static() const { return static_; }
 
 	std::string get_plugin_path(const std::string & plugin = "") const;
 
-	std::string get_site_url() const;
+	const std::string & get_site_url() const { return site_url_; }
 	std::string get_plugin_url(const std::string & plugin = "") const;
-	std::string get_site_title() const;
-	std::string get_site_subtitle() const;
-	std::string get_language() const;
-	std::string get_author() const;
-	int get_num_news() const;
+	const std::string & get_site_title() const { return site_title_; }
+	const std::string & get_site_subtitle() const { return site_subtitle_; }
+	const std::string & get_language() const { return language_; }
+	const std::string & get_author() const { return author_; }
+	int get_num_news() const { return num_news_; }
 
-	std::vector<std::string> get_source_process_filetypes() const;
+	const std::vector<std::string> & get_source_process_filetypes() const
+	{
+		return source_process_filetypes_;
+	}
 
-	std::vector<path_map_entry> get_path_map() const;
+	const std::vector<path_map_entry> & get_path_map() const { return path_map_; }
 
-	bool get_social_enable() const;
-	std::string get_social() const;
+	bool get_social_enable() const { return social_enable_; }
+	const std::string & get_social() const { return social_; }
 
-	bool get_menu_enable() const;
-	std::string get_menu() const;
+	bool get_menu_enable() const { return menu_enable_; }
+	const std::string & get_menu() const { return menu_; }
 
-	bool get_tags_enable() const;
+	bool get_tags_enable() const { return tags_enable_; }
 
-	bool get_page_tags_enable() const;
+	bool get_page_tags_enable() const { return page_tags_enable_; }
 
-	theme get_theme() const;
-	pagelist get_pagelist() const;
-	yearlist get_yearlist() const;
-	sitemap get_sitemap() const;
+	const theme & get_theme() const { return theme_; }
+	const pagelist & get_pagelist() const { return pagelist_; }
+	const yearlist & get_yearlist() const { return yearlist_; }
+	const sitemap & get_sitemap() const { return sitemap_; }
+	const cache & get_cache() const { return cache_; }
+	const renderer & get_renderer() const { return renderer_; }
 
 private:
-	std::unique_ptr<YAML::Node> node_;
-
-	const YAML::Node & node() const;
-
-	std::string get_node_str(const std::string & tag, const std::string & default_value) const;
-	std::string substitute_vars(const std::string & s) const;
-
-	std::string get_str(const std::string & tag, const std::string & default_value) const;
-
-	int get_int(const std::string & tag, int default_value) const;
-	int get_int(const std::string & group, const std::string & tag, int default_value) const;
-
-	bool get_bool(const std::string & tag, bool default_value) const;
-	bool get_bool(const std::string & group, const std::string & tag, bool default_value) const;
-
-	sort_description get_sort_description(
-		const std::string & group, const std::string & name) const;
-
-	std::string get_grouped(const std::string & group, const std::string & field,
-		const std::string & default_value = "") const;
+	std::string source_;
+	std::string destination_;
+	std::string static_;
+	std::string plugins_;
+	std::string site_url_;
+	std::string plugin_url_;
+	std::string site_title_;
+	std::string site_subtitle_;
+	std::string language_;
+	std::string author_;
+	int num_news_ = 0;
+	std::vector<std::string> source_process_filetypes_;
+	std::vector<path_map_entry> path_map_;
+	bool social_enable_ = false;
+	std::string social_;
+	bool menu_enable_ = false;
+	std::string menu_;
+	bool tags_enable_ = false;
+	bool page_tags_enable_ = false;
+	theme theme_;
+	pagelist pagelist_;
+	yearlist yearlist_;
+	sitemap sitemap_;
+	cache cache_;
+	renderer renderer_;
 };
 
 bool operator<(const config::sort_description &, const config::sort_description &);
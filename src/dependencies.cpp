@@ -0,0 +1,216 @@
+#include "dependencies.hpp"
+#include "hash.hpp"
+#include <fstream>
+#include <vector>
+#include <experimental/filesystem>
+#include <nlohmann/json.hpp>
+
+namespace mkweb
+{
+namespace fs
+{
+using path = std::experimental::filesystem::path;
+using std::experimental::filesystem::create_directories;
+using std::experimental::filesystem::exists;
+using std::experimental::filesystem::file_size;
+using std::experimental::filesystem::is_regular_file;
+using std::experimental::filesystem::last_write_time;
+using std::experimental::filesystem::rename;
+}
+
+namespace
+{
+constexpr int format_version = 1;
+
+/// Returns the hash of the contents of the specified file, an empty string
+/// if the file is not readable.
+std::string hash_file(const std::string & path)
+{
+	std::ifstream ifs{path.c_str(), std::ios::binary};
+	if (!ifs)
+		return {};
+
+	fnv1a h;
+	std::vector<char> buf(64 * 1024);
+	while (ifs) {
+		ifs.read(buf.data(), buf.size());
+		h.update(buf.data(), static_cast<std::size_t>(ifs.gcount()));
+	}
+	return h.str();
+}
+}
+
+void dependencies::record::add_file(const std::string & path, const std::string & key)
+{
+	add_file(status_of(path), key);
+}
+
+void dependencies::record::add_file(const file_entry & entry, const std::string & key)
+{
+	files[key.empty() ? entry.path : key] = entry;
+}
+
+void dependencies::record::add_value(const std::string & name, const std::string & value)
+{
+	// values are kept as hashes only, sidebar fragments may be large
+	auto & v = values[name];
+	v = fnv1a::str(v + value);
+}
+
+dependencies::file_entry dependencies::status_of(const std::string & path)
+{
+	file_entry entry;
+	entry.path = path;
+	if (fs::is_regular_file(path)) {
+		entry.mtime = fs::last_write_time(path).time_since_epoch().count();
+		entry.size = fs::file_size(path);
+	}
+	return entry;
+}
+
+dependencies::dependencies(const std::string & filename)
+	: filename_(filename)
+{
+	load();
+}
+
+void dependencies::load()
+{
+	std::ifstream ifs{filename_.c_str()};
+	if (!ifs)
+		return;
+
+	// an unreadable record only means everything is rendered again
+	const auto data = nlohmann::json::parse(ifs, nullptr, false);
+	if (!data.is_object() || (data.value("version", 0) != format_version))
+		return;
+	if (!data.contains("outputs") || !data["outputs"].is_object())
+		return;
+
+	for (const auto & output : data["outputs"].items()) {
+		record r;
+		const auto files = output.value().value("files", nlohmann::json::object());
+		const auto values = output.value().value("values", nlohmann::json::object());
+		for (const auto & file : files.items()) {
+			file_entry entry;
+			entry.path = file.value().value("path", "");
+			entry.mtime = file.value().value("mtime", std::int64_t{0});
+			entry.size = file.value().value("size", std::uintmax_t{0});
+			entry.hash = file.value().value("hash", "");
+			r.files[file.key()] = entry;
+		}
+		for (const auto & value : values.items())
+			r.values[value.key()] = value.value().get<std::string>();
+		records_[output.key()] = std::move(r);
+	}
+}
+
+void dependencies::save()
+{
+	std::lock_guard<std::mutex> lock{mtx_};
+	if (!modified_)
+		return;
+
+	nlohmann::json outputs = nlohmann::json::object();
+	for (const auto & output : records_) {
+		nlohmann::json files = nlohmann::json::object();
+		for (const auto & file : output.second.files) {
+			files[file.first] = {{"path", file.second.path}, {"mtime", file.second.mtime},
+				{"size", file.second.size}, {"hash", file.second.hash}};
+		}
+		outputs[output.first] = {{"files", files}, {"values", output.second.values}};
+	}
+	const nlohmann::json data = {{"version", format_version}, {"outputs", outputs}};
+
+	// write and rename, a reader never sees a partially written file
+	const auto path = fs::path{filename_};
+	if (path.has_parent_path())
+		fs::create_directories(path.parent_path());
+	const auto tmp = filename_ + ".tmp";
+	{
+		std::ofstream ofs{tmp.c_str()};
+		ofs << data.dump() << '\n';
+		if (!ofs)
+			throw std::runtime_error{"unable to write dependencies: " + tmp};
+	}
+	fs::rename(tmp, filename_);
+	modified_ = false;
+}
+
+std::string dependencies::hash_of(const file_entry & entry)
+{
+	// files may change while running (watching, serving), hashes are valid for a status only
+	auto & cached = hashes_[entry.path];
+	if (cached.path.empty() || (cached.mtime != entry.mtime) || (cached.size != entry.size)) {
+		cached = entry;
+		cached.hash = hash_file(entry.path);
+	}
+	return cached.hash;
+}
+
+std::string dependencies::check(const std::string & filename_out, record & r)
+{
+	std::lock_guard<std::mutex> lock{mtx_};
+
+	const auto old = records_.find(filename_out);
+
+	// complete the record, files unchanged in size and time keep their hash
+	for (auto & file : r.files) {
+		auto & entry = file.second;
+		if (old != records_.end()) {
+			const auto i = old->second.files.find(file.first);
+			if ((i != old->second.files.end()) && (i->second.path == entry.path)
+				&& (i->second.mtime == entry.mtime) && (i->second.size == entry.size)) {
+				entry.hash = i->second.hash;
+				continue;
+			}
+		}
+		entry.hash = hash_of(entry);
+	}
+
+	if (!fs::exists(filename_out))
+		return "output missing";
+	if (old == records_.end())
+		return "no dependency record";
+
+	for (const auto & file : r.files) {
+		const auto i = old->second.files.find(file.first);
+		if (i == old->second.files.end())
+			return "new dependency: " + file.first;
+		if (i->second.hash != file.second.hash)
+			return "changed: " + file.first;
+	}
+	for (const auto & file : old->second.files) {
+		if (r.files.find(file.first) == r.files.end())
+			return "dependency removed: " + file.first;
+	}
+
+	for (const auto & value : r.values) {
+		const auto i = old->second.values.find(value.first);
+		if (i == old->second.values.end())
+			return "new value: " + value.first;
+		if (i->second != value.second)
+			return "value changed: " + value.first;
+	}
+	for (const auto & value : old->second.values) {
+		if (r.values.find(value.first) == r.values.end())
+			return "value removed: " + value.first;
+	}
+
+	return {};
+}
+
+void dependencies::update(const std::string & filename_out, const record & r)
+{
+	std::lock_guard<std::mutex> lock{mtx_};
+	records_[filename_out] = r;
+	modified_ = true;
+}
+
+void dependencies::remove(const std::string & filename_out)
+{
+	std::lock_guard<std::mutex> lock{mtx_};
+	if (records_.erase(filename_out))
+		modified_ = true;
+}
+}
@@ -0,0 +1,84 @@
+#ifndef MKWEB__DEPENDENCIES__HPP
+#define MKWEB__DEPENDENCIES__HPP
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace mkweb
+{
+/// Records the inputs each destination document was rendered from, in order
+/// to render only documents whose inputs have changed.
+///
+/// Inputs are files (source, theme and plugin files), identified by the hash
+/// of their contents, and named values (configuration, sidebar fragments),
+/// identified by the hash of the value. Files are only hashed if their size
+/// or modification time differs from the record.
+///
+/// Records are read from and written to a JSON file. Recording is thread safe,
+/// the checks are not meant to run concurrently to recording.
+class dependencies
+{
+public:
+	struct file_entry {
+		std::string path;
+		std::int64_t mtime = 0;
+		std::uintmax_t size = 0;
+		std::string hash;
+	};
+
+	/// Inputs of a destination document.
+	struct record {
+		std::map<std::string, file_entry> files;
+		std::map<std::string, std::string> values;
+
+		/// Adds a file. The key identifies the file within the record, it
+		/// defaults to the path.
+		void add_file(const std::string & path, const std::string & key = "");
+
+		/// Adds a file of which the status is known already, see `status_of`.
+		void add_file(const file_entry & entry, const std::string & key = "");
+
+		/// Adds a named value, a value of the same name is extended.
+		/// Only the hash of the value is kept.
+		void add_value(const std::string & name, const std::string & value);
+	};
+
+	/// Returns size and modification time of a file, without its hash.
+	static file_entry status_of(const std::string & path);
+
+	dependencies(const std::string & filename);
+
+	dependencies(const dependencies &) = delete;
+	dependencies & operator=(const dependencies &) = delete;
+
+	/// Checks the inputs of the destination document against the record.
+	/// Files of the specified record are completed (hashes).
+	///
+	/// \return The reason why the document has to be rendered, an empty
+	///   string if it is up to date.
+	std::string check(const std::string & filename_out, record & r);
+
+	/// Records the inputs of a successfully rendered document.
+	void update(const std::string & filename_out, const record & r);
+
+	/// Removes the record of a document, it will be rendered next time.
+	void remove(const std::string & filename_out);
+
+	/// Writes all records to the file, if there were any changes.
+	void save();
+
+private:
+	const std::string filename_;
+	std::map<std::string, record> records_;
+	std::map<std::string, file_entry> hashes_; // contents hashes by path, cache
+	bool modified_ = false;
+	mutable std::mutex mtx_;
+
+	void load();
+	std::string hash_of(const file_entry & entry);
+};
+}
+
+#endif
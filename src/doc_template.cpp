@@ -0,0 +1,291 @@
+#include "doc_template.hpp"
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+
+namespace mkweb
+{
+namespace
+{
+/// Returns `true` if the directive is a call of the function, e.g. `if(name)`.
+bool is_call(const std::string & directive, const std::string & function, std::string & arg)
+{
+	const auto n = function.size();
+	if ((directive.size() < n + 2) || (directive.compare(0, n, function) != 0)
+		|| (directive[n] != '(') || (directive.back() != ')'))
+		return false;
+	arg = directive.substr(n + 1, directive.size() - n - 2);
+	return true;
+}
+
+bool is_blank(char c)
+{
+	return (c == ' ') || (c == '\t');
+}
+
+bool is_variable_name(const std::string & name)
+{
+	return !name.empty() && std::all_of(begin(name), end(name), [](unsigned char c) {
+		return std::isalnum(c) || (c == '-') || (c == '_') || (c == '.');
+	});
+}
+
+/// Appends the value, all lines but the first are indented.
+void append_indented(std::string & out, const std::string & value, const std::string & indent)
+{
+	if (indent.empty()) {
+		out += value;
+		return;
+	}
+	for (std::size_t i = 0; i < value.size(); ++i) {
+		out += value[i];
+		if ((value[i] == '\n') && (i + 1 < value.size()) && (value[i + 1] != '\n'))
+			out += indent;
+	}
+}
+}
+
+class doc_template::parser
+{
+public:
+	parser(const std::string & text)
+		: s_(text)
+	{
+	}
+
+	std::vector<node> parse()
+	{
+		std::string terminator;
+		return parse_block({}, terminator);
+	}
+
+private:
+	const std::string & s_;
+	std::size_t pos_ = 0;
+
+	[[noreturn]] void fail(const std::string & what, std::size_t offset) const
+	{
+		const auto line = 1 + std::count(s_.begin(), s_.begin() + offset, '\n');
+		throw std::runtime_error{"template, line " + std::to_string(line) + ": " + what};
+	}
+
+	/// Returns `true` if the directive within `[first, last)` is alone on its line,
+	/// only surrounded by blanks.
+	///
+	/// \param[out] line_start Offset of the beginning of the line.
+	/// \param[out] next_line Offset of the next line.
+	bool alone_on_line(std::size_t first, std::size_t last, std::size_t & line_start,
+		std::size_t & next_line) const
+	{
+		line_start = first;
+		while ((line_start > 0) && is_blank(s_[line_start - 1]))
+			--line_start;
+		if ((line_start > 0) && (s_[line_start - 1] != '\n'))
+			return false;
+
+		next_line = last;
+		while ((next_line < s_.size()) && is_blank(s_[next_line]))
+			++next_line;
+		if (next_line == s_.size())
+			return true;
+		if (s_[next_line] != '\n')
+			return false;
+		++next_line;
+		return true;
+	}
+
+	/// Parses until one of the terminating directives (e.g. `endif`), which is
+	/// consumed and returned.
+	std::vector<node> parse_block(
+		const std::vector<std::string> & terminators, std::string & terminator)
+	{
+		std::vector<node> nodes;
+		std::string text;
+
+		auto flush = [&] {
+			if (text.empty())
+				return;
+			node n;
+			n.value = std::move(text);
+			nodes.push_back(std::move(n));
+			text.clear();
+		};
+
+		for (;;) {
+			const auto first = s_.find('$', pos_);
+			text.append(s_, pos_, ((first == std::string::npos) ? s_.size() : first) - pos_);
+			if (first == std::string::npos) {
+				pos_ = s_.size();
+				if (!terminators.empty())
+					fail("missing $" + terminators.back() + "$", s_.size());
+				flush();
+				return nodes;
+			}
+
+			if (s_.compare(first, 2, "$$") == 0) {
+				text += '$';
+				pos_ = first + 2;
+				continue;
+			}
+
+			// comments end with their line
+			if (s_.compare(first, 3, "$--") == 0) {
+				const auto eol = s_.find('\n', first);
+				pos_ = (eol == std::string::npos) ? s_.size() : eol + 1;
+				continue;
+			}
+
+			const auto last = s_.find('$', first + 1);
+			if (last == std::string::npos)
+				fail("unterminated '$'", first);
+			auto directive = s_.substr(first + 1, last - first - 1);
+			if ((directive.size() >= 2) && (directive.front() == '{')
+				&& (directive.back() == '}'))
+				directive = directive.substr(1, directive.size() - 2);
+			pos_ = last + 1;
+
+			std::string name;
+			const auto is_if = is_call(directive, "if", name);
+			const auto is_for = !is_if && is_call(directive, "for", name);
+			const auto is_end = (directive == "else") || (directive == "endif")
+				|| (directive == "sep") || (directive == "endfor");
+
+			if (!is_if && !is_for && !is_end) {
+				if (!is_variable_name(directive))
+					fail("unsupported: $" + directive + "$", first);
+
+				// values of several lines keep the indentation of the variable
+				node n;
+				n.kind = node::type::variable;
+				n.value = directive;
+				auto line_start = first;
+				while ((line_start > 0) && is_blank(s_[line_start - 1]))
+					--line_start;
+				if ((line_start == 0) || (s_[line_start - 1] == '\n'))
+					n.indent = s_.substr(line_start, first - line_start);
+				flush();
+				nodes.push_back(std::move(n));
+				continue;
+			}
+
+			// directives alone on a line remove the line entirely
+			std::size_t line_start = 0;
+			std::size_t next_line = 0;
+			if (alone_on_line(first, last + 1, line_start, next_line)) {
+				text.erase(text.size() - (first - line_start));
+				pos_ = next_line;
+			}
+
+			if (is_end) {
+				if (std::find(begin(terminators), end(terminators), directive)
+					== end(terminators))
+					fail("unexpected $" + directive + "$", first);
+				flush();
+				terminator = directive;
+				return nodes;
+			}
+
+			if (!is_variable_name(name))
+				fail("unsupported: $" + directive + "$", first);
+
+			node n;
+			n.value = name;
+			std::string end;
+			if (is_if) {
+				n.kind = node::type::conditional;
+				n.body = parse_block({"else", "endif"}, end);
+				if (end == "else")
+					n.alternative = parse_block({"endif"}, end);
+			} else {
+				n.kind = node::type::loop;
+				n.body = parse_block({"sep", "endfor"}, end);
+				if (end == "sep")
+					n.alternative = parse_block({"endfor"}, end);
+			}
+			flush();
+			nodes.push_back(std::move(n));
+		}
+	}
+};
+
+/// Variables and the values of the loops currently rendered.
+struct doc_template::context {
+	const variables & vars;
+	std::vector<std::pair<std::string, const std::string *>> bound; // innermost last
+
+	const std::string * find_bound(const std::string & name) const
+	{
+		for (auto i = bound.rbegin(); i != bound.rend(); ++i) {
+			if ((i->first == name) || (name == "it"))
+				return i->second;
+		}
+		return nullptr;
+	}
+
+	std::vector<const std::string *> values(const std::string & name) const
+	{
+		if (const auto b = find_bound(name))
+			return {b};
+
+		std::vector<const std::string *> result;
+		const auto i = vars.find(name);
+		if (i != vars.end()) {
+			for (const auto & value : i->second)
+				result.push_back(&value);
+		}
+		return result;
+	}
+
+	bool is_set(const std::string & name) const
+	{
+		const auto v = values(name);
+		return std::any_of(
+			begin(v), end(v), [](const std::string * value) { return !value->empty(); });
+	}
+};
+
+doc_template::doc_template(const std::string & text)
+	: nodes_(parser{text}.parse())
+{
+}
+
+std::string doc_template::render(const variables & vars) const
+{
+	context ctx{vars, {}};
+	std::string out;
+	render(nodes_, ctx, out);
+	return out;
+}
+
+void doc_template::render(const std::vector<node> & nodes, context & ctx, std::string & out)
+{
+	for (const auto & n : nodes) {
+		switch (n.kind) {
+			case node::type::text:
+				out += n.value;
+				break;
+
+			case node::type::variable:
+				for (const auto value : ctx.values(n.value))
+					append_indented(out, *value, n.indent);
+				break;
+
+			case node::type::conditional:
+				render(ctx.is_set(n.value) ? n.body : n.alternative, ctx, out);
+				break;
+
+			case node::type::loop: {
+				const auto values = ctx.values(n.value);
+				for (std::size_t i = 0; i < values.size(); ++i) {
+					if (i > 0)
+						render(n.alternative, ctx, out);
+					ctx.bound.emplace_back(n.value, values[i]);
+					render(n.body, ctx, out);
+					ctx.bound.pop_back();
+				}
+				break;
+			}
+		}
+	}
+}
+}
@@ -0,0 +1,53 @@
+#ifndef MKWEB__DOC_TEMPLATE__HPP
+#define MKWEB__DOC_TEMPLATE__HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace mkweb
+{
+/// A template in the format of pandoc, restricted to the subset used by themes:
+/// variables `$name$`, conditionals `$if(name)$ ... $else$ ... $endif$`, loops
+/// `$for(name)$ ... $sep$ ... $endfor$`, comments `$-- ...` and `$$`.
+///
+/// Like pandoc, conditionals and loops alone on a line do not leave an empty
+/// line behind, and values of several lines interpolated after indentation
+/// are indented the same way.
+///
+/// Within a loop, the variable iterated over (or `it`) denotes the current value.
+class doc_template
+{
+public:
+	/// Values of variables, each variable may have several values.
+	using variables = std::map<std::string, std::vector<std::string>>;
+
+	/// \exception std::runtime_error The template is malformed or uses
+	///   unsupported features.
+	explicit doc_template(const std::string & text);
+
+	/// Returns the template with all variables substituted. Values are inserted
+	/// as they are, they have to be escaped already.
+	std::string render(const variables & vars) const;
+
+private:
+	struct node {
+		enum class type { text, variable, conditional, loop };
+
+		type kind = type::text;
+		std::string value; ///< the text, or the name of the variable
+		std::string indent; ///< variables: indentation of continuation lines
+		std::vector<node> body; ///< conditional: if set, loop: for each value
+		std::vector<node> alternative; ///< conditional: otherwise, loop: separator
+	};
+
+	class parser;
+	struct context;
+
+	std::vector<node> nodes_;
+
+	static void render(const std::vector<node> & nodes, context & ctx, std::string & out);
+};
+}
+
+#endif
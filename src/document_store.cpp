@@ -0,0 +1,173 @@
+#include "document_store.hpp"
+#include <algorithm>
+#include <numeric>
+
+namespace mkweb
+{
+document_store::id document_store::string_pool::intern(const std::string & s)
+{
+	const auto i = index_.find(s);
+	if (i != index_.end())
+		return i->second;
+
+	const auto n = static_cast<id>(names_.size());
+	names_.push_back(s);
+	index_.emplace(names_.back(), n);
+	return n;
+}
+
+std::experimental::optional<document_store::id> document_store::string_pool::find(
+	const std::string & s) const
+{
+	const auto i = index_.find(s);
+	if (i == index_.end())
+		return {};
+	return i->second;
+}
+
+void document_store::string_pool::clear()
+{
+	index_.clear();
+	names_.clear();
+}
+
+void document_store::clear()
+{
+	paths_.clear();
+	tags_.clear();
+	authors_.clear();
+	plugins_.clear();
+	documents_.clear();
+	by_date_.clear();
+	by_title_.clear();
+	date_rank_.clear();
+	title_rank_.clear();
+	tagged_.clear();
+	years_.clear();
+}
+
+document_store::id document_store::add(const std::string & path, const meta_info & info)
+{
+	document d;
+	d.date = info.date;
+	d.date_key = info.date.key();
+	d.title = info.title;
+	for (const auto & author : info.authors)
+		d.authors.push_back(authors_.intern(author));
+	for (const auto & tag : info.tags)
+		d.tags.push_back(tags_.intern(tag));
+	d.language = info.language;
+	d.summary = info.summary;
+	for (const auto & plugin : info.plugins)
+		d.plugins.push_back(plugins_.intern(plugin));
+
+	const auto doc = paths_.intern(path);
+	if (doc < documents_.size()) {
+		documents_[doc] = std::move(d);
+	} else {
+		documents_.push_back(std::move(d));
+	}
+	return doc;
+}
+
+void document_store::finish()
+{
+	// sorted once, with ranks for sorting subsets, equal keys have equal ranks
+	auto build = [this](std::vector<id> & view, std::vector<std::uint32_t> & rank, auto less) {
+		view.resize(documents_.size());
+		std::iota(begin(view), end(view), 0);
+		std::stable_sort(begin(view), end(view),
+			[&](id a, id b) { return less(documents_[a], documents_[b]); });
+
+		rank.assign(documents_.size(), 0);
+		std::uint32_t r = 0;
+		for (std::size_t i = 0; i < view.size(); ++i) {
+			if ((i > 0) && less(documents_[view[i - 1]], documents_[view[i]]))
+				++r;
+			rank[view[i]] = r;
+		}
+	};
+	build(by_date_, date_rank_,
+		[](const document & a, const document & b) { return a.date_key < b.date_key; });
+	build(by_title_, title_rank_,
+		[](const document & a, const document & b) { return a.title < b.title; });
+
+	tagged_.assign(tags_.size(), {});
+	std::unordered_map<std::uint32_t, std::vector<id>> years;
+	for (id doc = 0; doc < documents_.size(); ++doc) {
+		for (const auto tag : documents_[doc].tags)
+			tagged_[tag].push_back(doc);
+		years[documents_[doc].date.year()].push_back(doc);
+	}
+	years_.assign(years.begin(), years.end());
+	std::sort(begin(years_), end(years_),
+		[](const auto & a, const auto & b) { return a.first < b.first; });
+}
+
+std::experimental::optional<document_store::id> document_store::find(
+	const std::string & path) const
+{
+	const auto doc = paths_.find(path);
+	if (!doc || (*doc >= documents_.size()))
+		return {};
+	return doc;
+}
+
+meta_info document_store::meta(id doc) const
+{
+	const auto & d = documents_[doc];
+
+	meta_info info;
+	info.date = d.date;
+	info.title = d.title;
+	for (const auto author : d.authors)
+		info.authors.push_back(authors_.name(author));
+	for (const auto tag : d.tags)
+		info.tags.push_back(tags_.name(tag));
+	info.language = d.language;
+	info.summary = d.summary;
+	for (const auto plugin : d.plugins)
+		info.plugins.push_back(plugins_.name(plugin));
+	return info;
+}
+
+const std::vector<std::uint32_t> & document_store::ranks(sort_key key) const
+{
+	return (key == sort_key::date) ? date_rank_ : title_rank_;
+}
+
+std::vector<document_store::id> document_store::sorted(sort_key key, bool descending) const
+{
+	const auto & view = (key == sort_key::date) ? by_date_ : by_title_;
+	if (!descending)
+		return view;
+
+	// reversed, runs of equal keys kept in their order
+	const auto & rank = ranks(key);
+	std::vector<id> result;
+	result.reserve(view.size());
+	auto last = view.size();
+	while (last > 0) {
+		auto first = last - 1;
+		while ((first > 0) && (rank[view[first - 1]] == rank[view[last - 1]]))
+			--first;
+		result.insert(end(result), begin(view) + first, begin(view) + last);
+		last = first;
+	}
+	return result;
+}
+
+std::vector<document_store::id> document_store::sorted(
+	std::vector<id> docs, sort_key key, bool descending) const
+{
+	const auto & rank = ranks(key);
+	if (descending) {
+		std::stable_sort(
+			begin(docs), end(docs), [&rank](id a, id b) { return rank[a] > rank[b]; });
+	} else {
+		std::stable_sort(
+			begin(docs), end(docs), [&rank](id a, id b) { return rank[a] < rank[b]; });
+	}
+	return docs;
+}
+}
@@ -0,0 +1,126 @@
+#ifndef MKWEB__DOCUMENT_STORE__HPP
+#define MKWEB__DOCUMENT_STORE__HPP
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <experimental/optional>
+#include "meta_info.hpp"
+
+namespace mkweb
+{
+/// Meta information of all documents of the site, in a dense table.
+///
+/// Paths, tags, authors and plugins are interned, documents refer to them by
+/// integer identifiers, dates are kept as written along with an integer key
+/// ordering them. Views of the documents sorted by date and title, and the
+/// documents of every tag and year, are built once by `finish`, sorting any
+/// subset of documents compares integers only.
+///
+/// Documents are identified by the order they are added in, which is expected
+/// to be deterministic (e.g. the order of the directory traversal). Ties of
+/// sorted views are kept in this order.
+///
+/// \note This class is not thread safe, concurrent reading is fine though.
+class document_store
+{
+public:
+	using id = std::uint32_t;
+
+	enum class sort_key { date, title };
+
+	/// A document, identified by the same integer as its path.
+	struct document {
+		posix_time date; ///< as written, shown
+		std::int64_t date_key; ///< orders like `date`, see `posix_time::key`
+		std::string title;
+		std::vector<id> authors;
+		std::vector<id> tags;
+		std::string language;
+		std::string summary;
+		std::vector<id> plugins;
+	};
+
+	/// Removes all documents.
+	void clear();
+
+	/// Adds a document, one of the same path is replaced.
+	id add(const std::string & path, const meta_info & info);
+
+	/// Builds the sorted views, to be called after all documents have been added.
+	void finish();
+
+	std::size_t size() const { return documents_.size(); }
+
+	const document & operator[](id doc) const { return documents_[doc]; }
+
+	/// Returns the document of the specified path, if there is one.
+	std::experimental::optional<id> find(const std::string & path) const;
+
+	/// Returns the meta information of a document, as it has been added.
+	meta_info meta(id doc) const;
+
+	const std::string & path(id doc) const { return paths_.name(doc); }
+	const std::string & tag(id t) const { return tags_.name(t); }
+	const std::string & author(id a) const { return authors_.name(a); }
+	const std::string & plugin(id p) const { return plugins_.name(p); }
+
+	std::size_t num_tags() const { return tags_.size(); }
+
+	/// Returns the documents of the tag, in the order they were added.
+	const std::vector<id> & tagged(id t) const { return tagged_[t]; }
+
+	/// Returns years and their documents, in the order they were added. Years
+	/// are in ascending order.
+	const std::vector<std::pair<std::uint32_t, std::vector<id>>> & years() const
+	{
+		return years_;
+	}
+
+	/// Returns all documents, sorted.
+	std::vector<id> sorted(sort_key key, bool descending) const;
+
+	/// Returns the specified documents, sorted. The order of documents with
+	/// equal keys is kept.
+	std::vector<id> sorted(std::vector<id> docs, sort_key key, bool descending) const;
+
+private:
+	/// Strings identified by dense integers, in the order of their first use.
+	class string_pool
+	{
+	public:
+		id intern(const std::string & s);
+		std::experimental::optional<id> find(const std::string & s) const;
+		const std::string & name(id i) const { return names_[i]; }
+		std::size_t size() const { return names_.size(); }
+		void clear();
+
+	private:
+		std::deque<std::string> names_; // stable, referred to by the index
+		std::unordered_map<std::string_view, id> index_;
+	};
+
+	string_pool paths_;
+	string_pool tags_;
+	string_pool authors_;
+	string_pool plugins_;
+
+	std::vector<document> documents_;
+
+	// built by `finish`
+	std::vector<id> by_date_;
+	std::vector<id> by_title_;
+	std::vector<std::uint32_t> date_rank_; // equal dates have equal ranks
+	std::vector<std::uint32_t> title_rank_;
+	std::vector<std::vector<id>> tagged_;
+	std::vector<std::pair<std::uint32_t, std::vector<id>>> years_;
+
+	const std::vector<std::uint32_t> & ranks(sort_key key) const;
+};
+}
+
+#endif
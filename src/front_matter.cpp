@@ -0,0 +1,377 @@
+#include "front_matter.hpp"
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace mkweb
+{
+namespace
+{
+constexpr std::size_t read_size = 64 * 1024;
+
+/// A value of the front matter, either a scalar or a sequence of scalars.
+struct value {
+	bool sequence = false;
+	std::vector<std::string> items;
+};
+
+bool is_space(char c)
+{
+	return c == ' ';
+}
+
+std::string trim(const std::string & s)
+{
+	std::string::size_type first = 0;
+	auto last = s.size();
+	while ((first < last) && is_space(s[first]))
+		++first;
+	while ((last > first) && is_space(s[last - 1]))
+		--last;
+	return s.substr(first, last - first);
+}
+
+/// Returns `true` if the rest is empty or a comment.
+bool is_rest_empty(const std::string & s, std::string::size_type pos)
+{
+	while ((pos < s.size()) && is_space(s[pos]))
+		++pos;
+	return (pos == s.size()) || (s[pos] == '#');
+}
+
+/// Parses a quoted scalar starting at `pos`, which is advanced behind the
+/// closing quote. Only escape sequences which are unambiguous are supported.
+bool parse_quoted(const std::string & s, std::string::size_type & pos, std::string & result)
+{
+	const auto quote = s[pos++];
+	result.clear();
+	while (pos < s.size()) {
+		const auto c = s[pos++];
+		if (c == quote) {
+			if ((quote == '\'') && (pos < s.size()) && (s[pos] == '\'')) {
+				result += '\'';
+				++pos;
+				continue;
+			}
+			return true;
+		}
+		if ((quote == '"') && (c == '\\')) {
+			if (pos >= s.size())
+				return false;
+			switch (s[pos++]) {
+				case '\\':
+					result += '\\';
+					break;
+				case '"':
+					result += '"';
+					break;
+				case '/':
+					result += '/';
+					break;
+				case 'n':
+					result += '\n';
+					break;
+				case 't':
+					result += '\t';
+					break;
+				default:
+					return false;
+			}
+			continue;
+		}
+		result += c;
+	}
+	return false; // not closed on this line
+}
+
+/// Returns `true` if the plain scalar is a valid string, which is not
+/// interpreted otherwise (null) and does not start with an indicator.
+bool is_plain(const std::string & s, bool flow)
+{
+	if (s.empty())
+		return false;
+	if (std::strchr("[]{}#&*!|>'\"%@`,", s[0]))
+		return false;
+	if (std::strchr("-?:", s[0]) && ((s.size() == 1) || is_space(s[1])))
+		return false;
+	if ((s == "~") || (s == "null") || (s == "Null") || (s == "NULL"))
+		return false;
+	if ((s.find(": ") != std::string::npos) || (s.back() == ':'))
+		return false;
+	if (s.find(" #") != std::string::npos)
+		return false;
+	if (flow && (s.find_first_of("[]{},#") != std::string::npos))
+		return false;
+	return true;
+}
+
+/// Parses a scalar, the remainder of a line.
+bool parse_scalar(const std::string & s, std::string & result)
+{
+	const auto t = trim(s);
+	if (t.empty())
+		return false;
+
+	if ((t[0] == '\'') || (t[0] == '"')) {
+		std::string::size_type pos = 0;
+		return parse_quoted(t, pos, result) && is_rest_empty(t, pos);
+	}
+
+	// comments are only recognized after a space
+	auto plain = t;
+	const auto comment = plain.find(" #");
+	if (comment != std::string::npos)
+		plain = trim(plain.substr(0, comment));
+	if (!is_plain(plain, false))
+		return false;
+	result = plain;
+	return true;
+}
+
+/// Parses a flow sequence of scalars, on a single line.
+bool parse_flow_sequence(const std::string & s, std::vector<std::string> & items)
+{
+	std::string::size_type pos = s.find('[') + 1;
+	items.clear();
+
+	for (;;) {
+		while ((pos < s.size()) && is_space(s[pos]))
+			++pos;
+		if (pos >= s.size())
+			return false;
+		if ((s[pos] == ']') && items.empty())
+			return is_rest_empty(s, pos + 1);
+
+		std::string item;
+		if ((s[pos] == '\'') || (s[pos] == '"')) {
+			if (!parse_quoted(s, pos, item))
+				return false;
+			while ((pos < s.size()) && is_space(s[pos]))
+				++pos;
+		} else {
+			const auto end = s.find_first_of(",]", pos);
+			if (end == std::string::npos)
+				return false;
+			item = trim(s.substr(pos, end - pos));
+			if (!is_plain(item, true))
+				return false;
+			pos = end;
+		}
+		items.push_back(item);
+
+		if (pos >= s.size())
+			return false;
+		if (s[pos] == ']')
+			return is_rest_empty(s, pos + 1);
+		if (s[pos] != ',')
+			return false;
+		++pos;
+	}
+}
+
+bool is_blank_or_comment(const std::string & line)
+{
+	const auto pos = line.find_first_not_of(' ');
+	return (pos == std::string::npos) || (line[pos] == '#');
+}
+
+std::vector<std::string> split_lines(const std::string & text)
+{
+	std::vector<std::string> lines;
+	std::string::size_type pos = 0;
+	while (pos < text.size()) {
+		auto end = text.find('\n', pos);
+		if (end == std::string::npos)
+			end = text.size();
+		lines.push_back(text.substr(pos, end - pos));
+		pos = end + 1;
+	}
+	return lines;
+}
+
+/// Parses the front matter into a map of values.
+bool parse_values(const std::string & text, std::map<std::string, value> & values)
+{
+	if (text.find_first_of("\t\r") != std::string::npos)
+		return false;
+
+	const auto lines = split_lines(text);
+	for (std::size_t i = 0; i < lines.size(); ++i) {
+		const auto & line = lines[i];
+		if (is_blank_or_comment(line))
+			continue;
+		if (is_space(line[0]) || (line.compare(0, 3, "---") == 0) || (line.compare(0, 3, "...") == 0))
+			return false;
+
+		// key
+		std::string::size_type pos = 0;
+		while ((pos < line.size())
+			&& (std::isalnum(static_cast<unsigned char>(line[pos])) || (line[pos] == '_')
+				|| (line[pos] == '-')))
+			++pos;
+		if ((pos == 0) || (pos >= line.size()) || (line[pos] != ':'))
+			return false;
+		if (((pos + 1) < line.size()) && !is_space(line[pos + 1]))
+			return false;
+		const auto key = line.substr(0, pos);
+		if (values.count(key))
+			return false;
+
+		const auto rest = line.substr(pos + 1);
+		const auto t = trim(rest);
+		value v;
+
+		if (t.empty() || (t[0] == '#')) {
+			// block sequence, anything else would be null or a mapping
+			std::string::size_type indent = std::string::npos;
+			for (; (i + 1) < lines.size(); ++i) {
+				const auto & item_line = lines[i + 1];
+				if (is_blank_or_comment(item_line))
+					continue;
+				const auto item_indent = item_line.find_first_not_of(' ');
+				if (item_line.compare(item_indent, 2, "- ") != 0)
+					break;
+				if (indent == std::string::npos)
+					indent = item_indent;
+				if (item_indent != indent)
+					return false;
+
+				std::string item;
+				if (!parse_scalar(item_line.substr(item_indent + 2), item))
+					return false;
+				v.items.push_back(item);
+			}
+			if (v.items.empty())
+				return false;
+			v.sequence = true;
+
+			// more indented lines would be continuations
+			if (((i + 1) < lines.size()) && is_space(lines[i + 1][0])
+				&& !is_blank_or_comment(lines[i + 1]))
+				return false;
+		} else if (t[0] == '[') {
+			if (!parse_flow_sequence(t, v.items))
+				return false;
+			v.sequence = true;
+		} else {
+			std::string item;
+			if (!parse_scalar(t, item))
+				return false;
+			v.items.push_back(item);
+		}
+
+		// scalars continued on the next line are not supported
+		if (!v.sequence && ((i + 1) < lines.size()) && is_space(lines[i + 1][0])
+			&& !is_blank_or_comment(lines[i + 1]))
+			return false;
+
+		values.emplace(key, std::move(v));
+	}
+	return true;
+}
+}
+
+std::string read_front_matter(const std::string & path)
+{
+	const auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return {};
+
+	std::string data;
+	std::string::size_type pos = 0; // beginning of the current line
+	std::string::size_type start = std::string::npos; // beginning of the front matter
+	bool eof = false;
+
+	while (!eof) {
+		const auto size = data.size();
+		data.resize(size + read_size);
+		const auto n = ::read(fd, &data[size], read_size);
+		if (n < 0) {
+			if (errno == EINTR) {
+				data.resize(size);
+				continue;
+			}
+			::close(fd);
+			return {};
+		}
+		data.resize(size + static_cast<std::size_t>(n));
+		eof = (n == 0);
+
+		for (;;) {
+			auto end = data.find('\n', pos);
+			if (end == std::string::npos) {
+				if (!eof || (pos >= data.size()))
+					break;
+				end = data.size(); // last line without line break
+			}
+
+			const auto is_delimiter = ((end - pos) == 3) && (data.compare(pos, 3, "---") == 0);
+			if (is_delimiter) {
+				if (start != std::string::npos) {
+					::close(fd);
+					return data.substr(start, pos - start);
+				}
+				start = end + 1;
+			}
+			pos = end + 1;
+		}
+	}
+	::close(fd);
+
+	if ((start == std::string::npos) || (start >= data.size()))
+		return {};
+
+	// not closed, everything after the opening delimiter
+	auto result = data.substr(start);
+	if (result.back() != '\n')
+		result += '\n';
+	return result;
+}
+
+bool parse_front_matter(const std::string & text, meta_info & info)
+{
+	std::map<std::string, value> values;
+	if (!parse_values(text, values))
+		return false;
+
+	const auto title = values.find("title");
+	if (title == values.end())
+		throw std::runtime_error{"essential information missing: 'title'"};
+
+	info = meta_info{};
+
+	auto get_str = [&](const char * key, std::string & s) {
+		const auto i = values.find(key);
+		if ((i != values.end()) && !i->second.sequence)
+			s = i->second.items.front();
+	};
+	auto get_list = [&](const char * key, std::vector<std::string> & v) {
+		const auto i = values.find(key);
+		if (i != values.end())
+			v = i->second.items;
+	};
+
+	get_str("title", info.title);
+	get_list("author", info.authors);
+	get_list("tags", info.tags);
+	get_list("plugins", info.plugins);
+	get_str("language", info.language);
+	get_str("summary", info.summary);
+
+	const auto date = values.find("date");
+	if (date != values.end()) {
+		if (date->second.sequence)
+			throw std::runtime_error{"invalid date"};
+		info.date = posix_time::from_string(date->second.items.front());
+	} else {
+		info.date = posix_time::from_string("2000-01-01 00:00");
+	}
+
+	return true;
+}
+}
@@ -0,0 +1,30 @@
+#ifndef MKWEB__FRONT_MATTER__HPP
+#define MKWEB__FRONT_MATTER__HPP
+
+#include <string>
+#include "meta_info.hpp"
+
+namespace mkweb
+{
+/// Reads the front matter of a document: the lines between the first line
+/// `---` and the next line `---`. Reading stops at the closing delimiter.
+///
+/// \return The front matter, an empty string if there is none.
+std::string read_front_matter(const std::string & path);
+
+/// Parses the front matter without a generic YAML parser, supporting the
+/// fields of `meta_info` with plain or quoted scalars, as well as flow and
+/// block sequences of them. Other fields are allowed with the same values.
+///
+/// Anything unusual (multi line scalars, mappings, anchors, null values,
+/// escape sequences, duplicate keys, etc.) is left to a YAML parser.
+///
+/// \param[in] text The front matter.
+/// \param[out] info The meta information.
+/// \return `true` if the front matter was parsed, `false` if the front matter
+///   is not supported.
+/// \exception std::runtime_error The title is missing.
+bool parse_front_matter(const std::string & text, meta_info & info);
+}
+
+#endif
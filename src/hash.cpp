@@ -0,0 +1,125 @@
+#include "hash.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace mkweb
+{
+namespace
+{
+constexpr std::uint32_t k[64] = {0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b,
+	0x59f111f1, 0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6,
+	0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152, 0xa831c66d,
+	0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967, 0x27b70a85,
+	0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585,
+	0x106aa070, 0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+	0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa,
+	0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+inline std::uint32_t rotr(std::uint32_t x, int n)
+{
+	return (x >> n) | (x << (32 - n));
+}
+}
+
+void sha256::update(const void * data, std::size_t size)
+{
+	const auto * p = static_cast<const unsigned char *>(data);
+	length += size;
+	while (size > 0) {
+		const auto n = std::min(size, block.size() - used);
+		std::memcpy(block.data() + used, p, n);
+		used += n;
+		p += n;
+		size -= n;
+		if (used == block.size()) {
+			transform();
+			used = 0;
+		}
+	}
+}
+
+std::string sha256::str()
+{
+	if (!finished) {
+		const std::uint64_t bits = length * 8;
+		block[used++] = 0x80;
+		if (used > 56) {
+			std::fill(block.begin() + used, block.end(), 0);
+			transform();
+			used = 0;
+		}
+		std::fill(block.begin() + used, block.begin() + 56, 0);
+		for (int i = 0; i < 8; ++i)
+			block[56 + i] = static_cast<unsigned char>(bits >> (56 - 8 * i));
+		transform();
+		finished = true;
+	}
+
+	static const char digits[] = "0123456789abcdef";
+	std::string s;
+	s.reserve(64);
+	for (const auto v : h) {
+		for (int i = 28; i >= 0; i -= 4)
+			s += digits[(v >> i) & 0xf];
+	}
+	return s;
+}
+
+std::string sha256::str(const std::string & s)
+{
+	sha256 h;
+	h.update(s);
+	return h.str();
+}
+
+void sha256::transform()
+{
+	std::uint32_t w[64];
+	for (int i = 0; i < 16; ++i) {
+		w[i] = (std::uint32_t{block[4 * i]} << 24) | (std::uint32_t{block[4 * i + 1]} << 16)
+			| (std::uint32_t{block[4 * i + 2]} << 8) | std::uint32_t{block[4 * i + 3]};
+	}
+	for (int i = 16; i < 64; ++i) {
+		const auto s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		const auto s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+
+	auto a = h[0];
+	auto b = h[1];
+	auto c = h[2];
+	auto d = h[3];
+	auto e = h[4];
+	auto f = h[5];
+	auto g = h[6];
+	auto hh = h[7];
+
+	for (int i = 0; i < 64; ++i) {
+		const auto s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+		const auto ch = (e & f) ^ (~e & g);
+		const auto t1 = hh + s1 + ch + k[i] + w[i];
+		const auto s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+		const auto maj = (a & b) ^ (a & c) ^ (b & c);
+		const auto t2 = s0 + maj;
+		hh = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	}
+
+	h[0] += a;
+	h[1] += b;
+	h[2] += c;
+	h[3] += d;
+	h[4] += e;
+	h[5] += f;
+	h[6] += g;
+	h[7] += hh;
+}
+}
@@ -0,0 +1,74 @@
+#ifndef MKWEB__HASH__HPP
+#define MKWEB__HASH__HPP
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+namespace mkweb
+{
+/// 64 bit FNV-1a hash, fast but not suitable for cryptographic purposes.
+class fnv1a
+{
+public:
+	void update(const void * data, std::size_t size)
+	{
+		const auto * p = static_cast<const unsigned char *>(data);
+		for (std::size_t i = 0; i < size; ++i) {
+			h ^= p[i];
+			h *= 0x100000001b3ull;
+		}
+	}
+
+	void update(const std::string & s) { update(s.data(), s.size()); }
+
+	std::uint64_t value() const { return h; }
+
+	/// Returns the hash as hexadecimal string.
+	std::string str() const
+	{
+		static const char digits[] = "0123456789abcdef";
+		std::string s(16, '0');
+		auto v = h;
+		for (auto i = s.size(); i > 0; --i, v >>= 4)
+			s[i - 1] = digits[v & 0xf];
+		return s;
+	}
+
+	static std::string str(const std::string & s)
+	{
+		fnv1a h;
+		h.update(s);
+		return h.str();
+	}
+
+private:
+	std::uint64_t h = 0xcbf29ce484222325ull;
+};
+
+/// SHA-256, for content addressing of data shared between runs and machines.
+class sha256
+{
+public:
+	void update(const void * data, std::size_t size);
+	void update(const std::string & s) { update(s.data(), s.size()); }
+
+	/// Finishes the hash and returns it as hexadecimal string. No more data
+	/// may be added afterwards.
+	std::string str();
+
+	static std::string str(const std::string & s);
+
+private:
+	std::array<std::uint32_t, 8> h = {{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+		0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19}};
+	std::array<unsigned char, 64> block;
+	std::size_t used = 0;
+	std::uint64_t length = 0;
+	bool finished = false;
+
+	void transform();
+};
+}
+
+#endif
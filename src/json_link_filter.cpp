@@ -0,0 +1,561 @@
+#include "json_link_filter.hpp"
+#include <cctype>
+#include <stdexcept>
+#include <fmt/format.h>
+
+namespace mkweb
+{
+namespace
+{
+/// Appends the code point as UTF-8 to the string.
+void append_utf8(std::string & s, unsigned long cp)
+{
+	if (cp < 0x80) {
+		s += static_cast<char>(cp);
+	} else if (cp < 0x800) {
+		s += static_cast<char>(0xc0 | (cp >> 6));
+		s += static_cast<char>(0x80 | (cp & 0x3f));
+	} else if (cp < 0x10000) {
+		s += static_cast<char>(0xe0 | (cp >> 12));
+		s += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+		s += static_cast<char>(0x80 | (cp & 0x3f));
+	} else {
+		s += static_cast<char>(0xf0 | (cp >> 18));
+		s += static_cast<char>(0x80 | ((cp >> 12) & 0x3f));
+		s += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+		s += static_cast<char>(0x80 | (cp & 0x3f));
+	}
+}
+}
+
+json_link_filter::json_link_filter(rewrite_function rewrite)
+	: json_link_filter(std::move(rewrite), value_mode::process)
+{
+}
+
+/// A filter of a value of the specified kind, see `process_captured`.
+json_link_filter::json_link_filter(rewrite_function rewrite, value_mode mode)
+	: rewrite_(std::move(rewrite))
+	, mode_(mode)
+{
+}
+
+void json_link_filter::feed(const char * data, std::size_t size, std::string & out)
+{
+	out_ = &out;
+	const auto * end = data + size;
+	for (const auto * p = data; p < end;)
+		p = step(p, end);
+	out_ = nullptr;
+}
+
+void json_link_filter::finish(std::string & out)
+{
+	out_ = &out;
+	if (state_ == state::scalar)
+		end_value();
+	if (state_ != state::done)
+		fail();
+	out_ = nullptr;
+}
+
+void json_link_filter::fail() const
+{
+	throw std::runtime_error{"invalid JSON representation of document"};
+}
+
+void json_link_filter::put(char c)
+{
+	if (capture_) {
+		captured_ += c;
+	} else {
+		*out_ += c;
+	}
+}
+
+void json_link_filter::put(const char * data, std::size_t size)
+{
+	if (capture_) {
+		captured_.append(data, size);
+	} else {
+		out_->append(data, size);
+	}
+}
+
+void json_link_filter::put(const std::string & s)
+{
+	put(s.data(), s.size());
+}
+
+/// Passes on a part of the string being read, or holds it.
+void json_link_filter::put_string(const char * data, std::size_t size)
+{
+	if ((role_ == string_role::key) || (role_ == string_role::type)) {
+		token_.append(data, size);
+	} else {
+		put(data, size);
+	}
+}
+
+/// Processes input, at least one character unless the state changes.
+///
+/// \return The first character not processed.
+const char * json_link_filter::step(const char * p, const char * end)
+{
+	switch (state_) {
+		case state::string: {
+			// strings are passed on in runs, not one character at a time
+			auto q = p;
+			while ((q < end) && (*q != '"') && (*q != '\\'))
+				++q;
+			if (q < end)
+				++q; // the quote or backslash ends the run
+			put_string(p, static_cast<std::size_t>(q - p));
+			if (*(q - 1) == '\\') {
+				state_ = state::string_escape;
+			} else if (*(q - 1) == '"') {
+				end_string();
+			}
+			return q;
+		}
+
+		case state::string_escape:
+			put_string(p, 1);
+			state_ = state::string;
+			return p + 1;
+
+		case state::scalar:
+			if (std::isalnum(static_cast<unsigned char>(*p)) || (*p == '-') || (*p == '+')
+				|| (*p == '.')) {
+				put(*p);
+				return p + 1;
+			}
+			end_value();
+			return p; // processed again in the state of the parent
+
+		default:
+			break;
+	}
+
+	const auto c = *p;
+	if ((c == ' ') || (c == '\t') || (c == '\n') || (c == '\r'))
+		return p + 1;
+
+	switch (state_) {
+		case state::value:
+			begin_value(c);
+			break;
+		case state::after_value:
+			next_entry(c);
+			break;
+		case state::key:
+			begin_key(c);
+			break;
+		case state::colon:
+			if (c != ':')
+				fail();
+			end_key();
+			break;
+		default:
+			fail();
+	}
+	return p + 1;
+}
+
+/// Begins the next value, in the mode determined by its parent.
+void json_link_filter::begin_value(char c)
+{
+	if (!stack_.empty() && (stack_.back().kind != frame::kind_type::object)) {
+		if ((c == ']') && stack_.back().empty) {
+			close();
+			return;
+		}
+		stack_.back().empty = false;
+	}
+
+	auto mode = mode_;
+	if (mode == value_mode::capture) {
+		capture_ = true;
+		capture_depth_ = stack_.size();
+		captured_.clear();
+		mode = value_mode::copy;
+	}
+
+	// the type of an element is a string, anything else makes it an untyped one
+	if ((mode == value_mode::type) && (c != '"')) {
+		stack_.back().type = element_type::other;
+		mode = value_mode::process;
+	}
+
+	switch (c) {
+		case '[':
+			put('[');
+			if (mode == value_mode::link_contents) {
+				stack_.emplace_back(frame::kind_type::link_array, true);
+				mode_ = value_mode::capture;
+			} else {
+				stack_.emplace_back(frame::kind_type::array, mode == value_mode::process);
+				mode_ = (mode == value_mode::process) ? value_mode::process : value_mode::copy;
+			}
+			state_ = state::value;
+			return;
+
+		case '{':
+			put('{');
+			stack_.emplace_back(frame::kind_type::object, mode == value_mode::process);
+			state_ = state::key;
+			return;
+
+		case '"':
+			if (mode == value_mode::type) {
+				role_ = string_role::type;
+				token_ = '"';
+			} else {
+				role_ = string_role::value;
+				put('"');
+			}
+			state_ = state::string;
+			return;
+
+		default:
+			// numbers, `true`, `false` and `null`
+			if (!std::isalnum(static_cast<unsigned char>(c)) && (c != '-') && (c != '+')
+				&& (c != '.'))
+				fail();
+			put(c);
+			state_ = state::scalar;
+			return;
+	}
+}
+
+/// Begins the key of the next entry of an object.
+void json_link_filter::begin_key(char c)
+{
+	auto & f = stack_.back();
+	if ((c == '}') && f.empty) {
+		close();
+		return;
+	}
+	if (c != '"')
+		fail();
+	f.empty = false;
+
+	// keys of processed objects are held, their entries are written once their kind is known
+	if (f.process) {
+		role_ = string_role::key;
+		token_ = '"';
+	} else {
+		role_ = string_role::copied_key;
+		put('"');
+	}
+	state_ = state::string;
+}
+
+/// Determines what to do with the value of the entry, after its key.
+void json_link_filter::end_key()
+{
+	auto & f = stack_.back();
+	state_ = state::value;
+	if (!f.process) {
+		put(':');
+		mode_ = value_mode::copy;
+		return;
+	}
+
+	const auto key = decode(token_);
+	if (!f.type_known && (key == "t")) {
+		begin_entry(f, token_);
+		f.entry = frame::entry_type::type;
+		mode_ = value_mode::type;
+	} else if (f.first && (key == "c")) {
+		f.pending_key = token_;
+		f.entry = frame::entry_type::pending;
+		mode_ = value_mode::capture;
+	} else {
+		if (f.first)
+			f.type_known = true; // no type at the beginning: an untyped object
+		begin_entry(f, token_);
+		f.entry = frame::entry_type::normal;
+		switch (f.type) {
+			case element_type::untyped:
+			case element_type::other:
+				mode_ = value_mode::process;
+				break;
+			case element_type::link:
+				mode_ = (key == "c") ? value_mode::link_contents : value_mode::copy;
+				break;
+			case element_type::para:
+				mode_ = (key == "c") ? value_mode::process : value_mode::copy;
+				break;
+		}
+	}
+}
+
+void json_link_filter::end_string()
+{
+	switch (role_) {
+		case string_role::value:
+			end_value();
+			return;
+
+		case string_role::key:
+		case string_role::copied_key:
+			state_ = state::colon;
+			return;
+
+		case string_role::type: {
+			put(token_);
+			const auto value = decode(token_);
+			auto & f = stack_.back();
+			if ((value == "Link") || (value == "Image")) {
+				f.type = element_type::link;
+			} else if (value == "Para") {
+				f.type = element_type::para;
+			} else {
+				f.type = element_type::other;
+			}
+			end_value();
+			return;
+		}
+	}
+}
+
+/// Completes a value, continues with its parent.
+void json_link_filter::end_value()
+{
+	if (stack_.empty()) {
+		state_ = state::done;
+		return;
+	}
+
+	if (capture_ && (stack_.size() == capture_depth_))
+		capture_ = false;
+
+	state_ = state::after_value;
+	auto & f = stack_.back();
+	switch (f.kind) {
+		case frame::kind_type::array:
+			return;
+
+		case frame::kind_type::link_array:
+			if (f.has_previous) {
+				put(f.previous);
+				put(',');
+			}
+			f.previous.swap(captured_);
+			f.has_previous = true;
+			return;
+
+		case frame::kind_type::object:
+			if (!f.process)
+				return;
+			if (f.entry == frame::entry_type::type) {
+				f.type_known = true;
+				flush_pending(f);
+			} else if (f.entry == frame::entry_type::pending) {
+				f.pending_contents.swap(captured_);
+				f.pending = true;
+			}
+			f.first = false;
+			return;
+	}
+}
+
+/// Continues after a value, with the next one or the end of the parent.
+void json_link_filter::next_entry(char c)
+{
+	auto & f = stack_.back();
+	if (c == ',') {
+		switch (f.kind) {
+			case frame::kind_type::array:
+				put(',');
+				mode_ = f.process ? value_mode::process : value_mode::copy;
+				state_ = state::value;
+				return;
+			case frame::kind_type::link_array:
+				mode_ = value_mode::capture; // separated as elements are released
+				state_ = state::value;
+				return;
+			case frame::kind_type::object:
+				if (!f.process)
+					put(','); // entries of processed objects are separated by `begin_entry`
+				state_ = state::key;
+				return;
+		}
+	}
+
+	if (c != ((f.kind == frame::kind_type::object) ? '}' : ']'))
+		fail();
+	close();
+}
+
+/// Ends the innermost array or object.
+void json_link_filter::close()
+{
+	auto f = std::move(stack_.back());
+	stack_.pop_back();
+
+	switch (f.kind) {
+		case frame::kind_type::array:
+			put(']');
+			break;
+		case frame::kind_type::link_array:
+			// the target is the first entry of the last element
+			if (f.has_previous)
+				put(rewrite_target(f.previous));
+			put(']');
+			break;
+		case frame::kind_type::object:
+			if (f.process)
+				flush_pending(f);
+			put('}');
+			break;
+	}
+	end_value();
+}
+
+void json_link_filter::begin_entry(frame & f, const std::string & key_raw)
+{
+	if (f.need_comma)
+		put(',');
+	put(key_raw);
+	put(':');
+	f.need_comma = true;
+}
+
+/// Writes the contents read before the type, now that the type is known.
+void json_link_filter::flush_pending(frame & f)
+{
+	if (!f.pending)
+		return;
+	begin_entry(f, f.pending_key);
+	process_captured(f.pending_contents, f.type);
+	f.pending = false;
+}
+
+void json_link_filter::process_captured(const std::string & raw, element_type type)
+{
+	json_link_filter nested{rewrite_,
+		(type == element_type::link) ? value_mode::link_contents : value_mode::process};
+	std::string s;
+	nested.feed(raw.data(), raw.size(), s);
+	nested.finish(s);
+	put(s);
+}
+
+/// Rewrites the target, if the element is an array with a string as first entry.
+std::string json_link_filter::rewrite_target(const std::string & raw) const
+{
+	if ((raw.size() < 2) || (raw[0] != '[') || (raw[1] != '"'))
+		return raw;
+
+	// find the end of the string token
+	std::string::size_type end = 2;
+	while ((end < raw.size()) && (raw[end] != '"')) {
+		if (raw[end] == '\\')
+			++end;
+		++end;
+	}
+	if (end >= raw.size())
+		return raw;
+
+	const auto target_raw = raw.substr(1, end);
+	const auto target = decode(target_raw);
+	const auto rewritten = rewrite_(target);
+	if (rewritten == target)
+		return raw;
+	return '[' + encode(rewritten) + raw.substr(end + 1);
+}
+
+/// Decodes a string token (including quotes) into UTF-8.
+std::string json_link_filter::decode(const std::string & raw)
+{
+	std::string s;
+	s.reserve(raw.size());
+
+	auto hex4 = [&](std::string::size_type pos) -> unsigned long {
+		if (pos + 4 > raw.size())
+			throw std::runtime_error{"invalid escape sequence in JSON string"};
+		return std::stoul(raw.substr(pos, 4), nullptr, 16);
+	};
+
+	for (std::string::size_type i = 1; i + 1 < raw.size(); ++i) {
+		if (raw[i] != '\\') {
+			s += raw[i];
+			continue;
+		}
+		++i;
+		switch (raw[i]) {
+			case 'b':
+				s += '\b';
+				break;
+			case 'f':
+				s += '\f';
+				break;
+			case 'n':
+				s += '\n';
+				break;
+			case 'r':
+				s += '\r';
+				break;
+			case 't':
+				s += '\t';
+				break;
+			case 'u': {
+				auto cp = hex4(i + 1);
+				i += 4;
+				if ((cp >= 0xd800) && (cp < 0xdc00) && (i + 6 < raw.size()) && (raw[i + 1] == '\\')
+					&& (raw[i + 2] == 'u')) {
+					const auto low = hex4(i + 3);
+					if ((low >= 0xdc00) && (low < 0xe000)) {
+						cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+						i += 6;
+					}
+				}
+				append_utf8(s, cp);
+				break;
+			}
+			default: // '"', '\\', '/'
+				s += raw[i];
+				break;
+		}
+	}
+	return s;
+}
+
+/// Encodes a UTF-8 string as string token.
+std::string json_link_filter::encode(const std::string & s)
+{
+	std::string raw;
+	raw.reserve(s.size() + 2);
+	raw += '"';
+	for (const unsigned char c : s) {
+		switch (c) {
+			case '"':
+				raw += "\\\"";
+				break;
+			case '\\':
+				raw += "\\\\";
+				break;
+			case '\n':
+				raw += "\\n";
+				break;
+			case '\r':
+				raw += "\\r";
+				break;
+			case '\t':
+				raw += "\\t";
+				break;
+			default:
+				if (c < 0x20) {
+					raw += fmt::sprintf("\\u%04x", static_cast<unsigned int>(c));
+				} else {
+					raw += static_cast<char>(c);
+				}
+				break;
+		}
+	}
+	raw += '"';
+	return raw;
+}
+}
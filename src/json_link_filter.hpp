@@ -0,0 +1,132 @@
+#ifndef MKWEB__JSON_LINK_FILTER__HPP
+#define MKWEB__JSON_LINK_FILTER__HPP
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace mkweb
+{
+/// Filters a pandoc AST in JSON representation, rewriting the targets of
+/// `Link` and `Image` elements as they pass.
+///
+/// This is the streaming equivalent of traversing the JSON DOM: the contents of
+/// links and images are not traversed, everything else is. The input is pushed
+/// in parts of any size, e.g. as read from a pipe, each part is processed as far
+/// as possible. Only a small window of the document is held in memory: a key or
+/// the type of an element or, within a link or image, one element of its contents.
+///
+/// Pandoc writes the type (`t`) of an element before its contents (`c`). Should the
+/// contents come first, they are held back until the type is known.
+///
+/// The output is compact JSON, whitespace between tokens is not preserved.
+class json_link_filter
+{
+public:
+	using rewrite_function = std::function<std::string(const std::string &)>;
+
+	explicit json_link_filter(rewrite_function rewrite);
+
+	json_link_filter(const json_link_filter &) = delete;
+	json_link_filter & operator=(const json_link_filter &) = delete;
+
+	/// Processes the next part of the input, which may end anywhere, also within
+	/// a token. The output is appended to `out`. Throws if the input is not valid JSON.
+	void feed(const char * data, std::size_t size, std::string & out);
+
+	/// Ends the input, the remaining output is appended to `out`. Throws if the
+	/// input was not exactly one JSON value.
+	void finish(std::string & out);
+
+private:
+	enum class element_type { untyped, link, para, other };
+
+	/// What is done with a value, determined by its parent.
+	enum class value_mode {
+		process, ///< links within are rewritten
+		copy, ///< copied as it is
+		capture, ///< copied into `captured_`, handed to the parent at its end
+		link_contents, ///< contents of a link or image
+		type, ///< type of an element, held until the end of the string
+	};
+
+	enum class state { value, after_value, key, colon, string, string_escape, scalar, done };
+
+	/// What a string being read is, keys and types are held until their end.
+	enum class string_role { value, key, copied_key, type };
+
+	/// An array or object being read.
+	struct frame {
+		enum class kind_type { array, object, link_array };
+		enum class entry_type { normal, type, pending };
+
+		frame(kind_type k, bool p)
+			: kind(k)
+			, process(p)
+		{
+		}
+
+		kind_type kind;
+		bool process; ///< contents processed, otherwise copied
+		bool empty = true; ///< nothing read yet, the closing bracket may follow
+
+		// object being processed, entries written as their keys are known
+		bool first = true;
+		bool need_comma = false;
+		bool type_known = false;
+		element_type type = element_type::untyped;
+		entry_type entry = entry_type::normal; ///< of the value being read
+		std::string pending_key; ///< contents read before the type
+		std::string pending_contents;
+		bool pending = false;
+
+		// contents of a link or image, each element held back until the next one
+		std::string previous;
+		bool has_previous = false;
+	};
+
+	rewrite_function rewrite_;
+
+	std::vector<frame> stack_; // innermost last
+	state state_ = state::value;
+	value_mode mode_; // of the next value, if a value is expected
+
+	string_role role_ = string_role::value;
+	std::string token_; // key or type being read
+
+	bool capture_ = false;
+	std::size_t capture_depth_ = 0; // the value captured ends at this depth
+	std::string captured_;
+
+	std::string * out_ = nullptr; // valid while processing input
+
+	json_link_filter(rewrite_function rewrite, value_mode mode);
+
+	[[noreturn]] void fail() const;
+
+	void put(char c);
+	void put(const char * data, std::size_t size);
+	void put(const std::string & s);
+	void put_string(const char * data, std::size_t size);
+
+	const char * step(const char * p, const char * end);
+	void begin_value(char c);
+	void begin_key(char c);
+	void end_key();
+	void end_string();
+	void end_value();
+	void next_entry(char c);
+	void close();
+
+	void begin_entry(frame & f, const std::string & key_raw);
+	void flush_pending(frame & f);
+	void process_captured(const std::string & raw, element_type type);
+
+	std::string rewrite_target(const std::string & raw) const;
+
+	static std::string decode(const std::string & raw);
+	static std::string encode(const std::string & s);
+};
+}
+
+#endif
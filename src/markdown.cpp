@@ -0,0 +1,1223 @@
+#include "markdown.hpp"
+#include <algorithm>
+#include <cctype>
+#include <set>
+#include <vector>
+
+namespace mkweb
+{
+namespace
+{
+/// Thrown for syntax left to pandoc, never leaves this file.
+struct unsupported {
+};
+
+bool is_space(char c)
+{
+	return (c == ' ') || (c == '\t') || (c == '\n');
+}
+
+/// ASCII punctuation, everything beyond ASCII is taken as part of words.
+bool is_punct(char c)
+{
+	const auto u = static_cast<unsigned char>(c);
+	return (u < 0x80) && std::ispunct(u);
+}
+
+bool is_word(char c)
+{
+	const auto u = static_cast<unsigned char>(c);
+	return (u >= 0x80) || std::isalnum(u);
+}
+
+bool starts_with(const std::string & s, const std::string & prefix)
+{
+	return s.compare(0, prefix.size(), prefix) == 0;
+}
+
+void append_escaped(std::string & out, char c)
+{
+	switch (c) {
+		case '&':
+			out += "&amp;";
+			break;
+		case '<':
+			out += "&lt;";
+			break;
+		case '>':
+			out += "&gt;";
+			break;
+		case '"':
+			out += "&quot;";
+			break;
+		default:
+			out += c;
+			break;
+	}
+}
+
+std::string escape(const std::string & s)
+{
+	std::string result;
+	result.reserve(s.size());
+	for (const auto c : s)
+		append_escaped(result, c);
+	return result;
+}
+
+/// Reverts `escape`.
+std::string unescape(const std::string & s)
+{
+	static const std::pair<std::string, char> entities[]
+		= {{"&amp;", '&'}, {"&lt;", '<'}, {"&gt;", '>'}, {"&quot;", '"'}};
+
+	std::string result;
+	for (std::size_t i = 0; i < s.size(); ++i) {
+		const auto e = std::find_if(std::begin(entities), std::end(entities),
+			[&](const std::pair<std::string, char> & entity) {
+				return s.compare(i, entity.first.size(), entity.first) == 0;
+			});
+		if (e == std::end(entities)) {
+			result += s[i];
+		} else {
+			result += e->second;
+			i += e->first.size() - 1;
+		}
+	}
+	return result;
+}
+
+std::string trim(const std::string & s)
+{
+	const auto first = s.find_first_not_of(" \n");
+	if (first == std::string::npos)
+		return {};
+	return s.substr(first, s.find_last_not_of(" \n") - first + 1);
+}
+
+/// Splits the text into lines, tabs are expanded to the next multiple of
+/// four columns, like pandoc does.
+std::vector<std::string> split_lines(const std::string & text)
+{
+	std::vector<std::string> lines;
+	std::string line;
+	for (const auto c : text) {
+		if (c == '\n') {
+			lines.push_back(std::move(line));
+			line.clear();
+		} else if (c == '\t') {
+			line.append(4 - line.size() % 4, ' ');
+		} else if (c != '\r') {
+			line += c;
+		}
+	}
+	if (!line.empty())
+		lines.push_back(std::move(line));
+	return lines;
+}
+
+bool is_blank(const std::string & line)
+{
+	return line.find_first_not_of(' ') == std::string::npos;
+}
+
+std::size_t indentation(const std::string & line)
+{
+	const auto pos = line.find_first_not_of(' ');
+	return (pos == std::string::npos) ? line.size() : pos;
+}
+
+/// Renders the contents of a paragraph.
+///
+/// Text is collected, emphasis and quotes are collected as delimiters first,
+/// matched after the whole text is read.
+class inline_renderer
+{
+public:
+	inline_renderer(const std::string & s, const link_rewriter & rewrite, bool in_link)
+		: s_(s)
+		, rewrite_(rewrite)
+		, in_link_(in_link)
+	{
+	}
+
+	/// \exception unsupported
+	std::string render()
+	{
+		while (pos_ < s_.size()) {
+			const auto c = s_[pos_];
+			switch (c) {
+				case '\\':
+					backslash();
+					break;
+				case '`':
+					code_span();
+					break;
+				case '*':
+				case '_':
+					emphasis(c);
+					break;
+				case '!':
+					if (at(pos_ + 1) == '[') {
+						link(true);
+					} else {
+						append_escaped(text_, c);
+						++pos_;
+					}
+					break;
+				case '[':
+					link(false);
+					break;
+				case '<':
+					angle_bracket();
+					break;
+				case '&':
+					ampersand();
+					break;
+				case '"':
+				case '\'':
+					quote(c);
+					break;
+				case '.':
+					ellipsis();
+					break;
+				case '-':
+					dash();
+					break;
+				case '\n':
+					line_break();
+					break;
+				case ' ':
+					// like pandoc, spaces are collapsed
+					if ((pos_ == 0) || (s_[pos_ - 1] != ' '))
+						text_ += c;
+					++pos_;
+					break;
+				case '$': // math
+				case '^': // superscript, inline notes
+				case '~': // subscript, strikeout
+				case '@': // citations
+				case '|': // tables, line blocks
+				case '{': // attributes
+				case '}':
+				case ']':
+					throw unsupported{};
+				default:
+					append_escaped(text_, c);
+					++pos_;
+					break;
+			}
+		}
+		flush();
+
+		match_emphasis();
+		match_quotes();
+
+		std::string html;
+		for (const auto & n : nodes_)
+			html += n.close + n.html + n.open;
+		return html;
+	}
+
+	/// Returns `true` if the text is nothing but an image, rendered by `render`.
+	bool is_image() const
+	{
+		return (nodes_.size() == 1) && (num_images_ == 1) && (nodes_.front().html == image_);
+	}
+
+	/// The rendered description of the last image.
+	const std::string & caption() const { return caption_; }
+
+private:
+	struct node {
+		enum class type { html, emphasis, quote };
+
+		type kind = type::html;
+		std::string html;
+		char c = 0; ///< delimiter
+		int count = 0; ///< number of delimiters, zero once matched
+		bool can_open = false;
+		bool can_close = false;
+		bool apostrophe = false; ///< quote: may be an apostrophe
+		std::string open; ///< tags opened after the delimiter
+		std::string close; ///< tags closed in front of the delimiter
+	};
+
+	const std::string & s_;
+	const link_rewriter & rewrite_;
+	const bool in_link_;
+	std::size_t pos_ = 0;
+	std::string text_;
+	std::vector<node> nodes_;
+	int num_images_ = 0;
+	std::string image_;
+	std::string caption_;
+
+	/// Returns the character at the position, a space beyond the text.
+	char at(std::size_t i) const { return (i < s_.size()) ? s_[i] : ' '; }
+
+	/// Returns the character in front of the position, a space at the start.
+	char before(std::size_t i) const { return (i > 0) ? s_[i - 1] : ' '; }
+
+	void flush()
+	{
+		if (text_.empty())
+			return;
+		node n;
+		n.html = std::move(text_);
+		nodes_.push_back(std::move(n));
+		text_.clear();
+	}
+
+	void push(node && n)
+	{
+		flush();
+		nodes_.push_back(std::move(n));
+	}
+
+	std::size_t run_length(std::size_t i) const
+	{
+		const auto c = s_[i];
+		auto end = i;
+		while ((end < s_.size()) && (s_[end] == c))
+			++end;
+		return end - i;
+	}
+
+	/// Returns the end of the code span starting at the position.
+	std::size_t code_span_end(std::size_t i) const
+	{
+		const auto n = run_length(i);
+		for (auto first = s_.find('`', i + n); first != std::string::npos;
+			 first = s_.find('`', first)) {
+			const auto m = run_length(first);
+			if (m == n)
+				return first + m;
+			first += m;
+		}
+		throw unsupported{};
+	}
+
+	void backslash()
+	{
+		const auto c = at(pos_ + 1);
+		if ((pos_ + 1 < s_.size()) && (c == '\n')) {
+			text_ += "<br />\n";
+			pos_ += 2;
+			return;
+		}
+		// a space would be non-breaking, letters are TeX
+		if ((pos_ + 1 >= s_.size()) || !is_punct(c))
+			throw unsupported{};
+		append_escaped(text_, c);
+		pos_ += 2;
+	}
+
+	void code_span()
+	{
+		const auto n = run_length(pos_);
+		const auto end = code_span_end(pos_);
+		auto code = s_.substr(pos_ + n, end - pos_ - 2 * n);
+		std::replace(code.begin(), code.end(), '\n', ' ');
+		code = trim(code);
+		if (code.empty())
+			throw unsupported{};
+		text_ += "<code>" + escape(code) + "</code>";
+		pos_ = end;
+	}
+
+	void emphasis(char c)
+	{
+		const auto n = run_length(pos_);
+		const auto prev = before(pos_);
+		const auto next = at(pos_ + n);
+		const auto prev_space = is_space(prev);
+		const auto next_space = is_space(next);
+		const auto prev_punct = is_punct(prev);
+		const auto next_punct = is_punct(next);
+		const auto left = !next_space && (!next_punct || prev_space || prev_punct);
+		const auto right = !prev_space && (!prev_punct || next_space || next_punct);
+
+		node d;
+		d.kind = node::type::emphasis;
+		d.c = c;
+		d.count = static_cast<int>(n);
+		if (c == '*') {
+			d.can_open = left;
+			d.can_close = right;
+		} else if (!(is_word(prev) && is_word(next))) {
+			// underscores within words are not emphasis
+			d.can_open = left && (!right || prev_punct);
+			d.can_close = right && (!left || next_punct);
+		}
+
+		if (!d.can_open && !d.can_close) {
+			text_.append(n, c);
+		} else {
+			// pandoc nests runs of three the other way round
+			if (n > 2)
+				throw unsupported{};
+			push(std::move(d));
+		}
+		pos_ += n;
+	}
+
+	void link(bool image)
+	{
+		if (in_link_ && !image)
+			throw unsupported{};
+
+		// text, up to the matching bracket
+		const auto first = pos_ + (image ? 2 : 1);
+		auto i = first;
+		for (int depth = 1; i < s_.size(); ++i) {
+			const auto c = s_[i];
+			if (c == '\\') {
+				++i;
+			} else if (c == '`') {
+				i = code_span_end(i) - 1;
+			} else if (c == '[') {
+				++depth;
+			} else if ((c == ']') && (--depth == 0)) {
+				break;
+			}
+		}
+		// anything but inline links: references, spans, notes, etc.
+		if ((i >= s_.size()) || (at(i + 1) != '('))
+			throw unsupported{};
+		const auto label = s_.substr(first, i - first);
+		pos_ = i + 2;
+
+		auto skip_spaces = [this] {
+			while ((pos_ < s_.size()) && is_space(s_[pos_]))
+				++pos_;
+		};
+
+		skip_spaces();
+		std::string target;
+		if (at(pos_) == '<') {
+			const auto end = s_.find('>', pos_);
+			if (end == std::string::npos)
+				throw unsupported{};
+			target = s_.substr(pos_ + 1, end - pos_ - 1);
+			pos_ = end + 1;
+		} else {
+			for (int depth = 0; (pos_ < s_.size()) && !is_space(s_[pos_]); ++pos_) {
+				const auto c = s_[pos_];
+				if ((c == '\\') && is_punct(at(pos_ + 1))) {
+					target += s_[++pos_];
+					continue;
+				}
+				if (c == '(') {
+					++depth;
+				} else if (c == ')') {
+					if (depth == 0)
+						break;
+					--depth;
+				}
+				target += c;
+			}
+		}
+		skip_spaces();
+
+		std::string title;
+		const auto q = at(pos_);
+		if ((q == '"') || (q == '\'')) {
+			for (++pos_; (pos_ < s_.size()) && (s_[pos_] != q); ++pos_) {
+				if ((s_[pos_] == '\\') && is_punct(at(pos_ + 1)))
+					++pos_;
+				title += s_[pos_];
+			}
+			++pos_;
+			skip_spaces();
+		}
+		if ((pos_ >= s_.size()) || (s_[pos_] != ')'))
+			throw unsupported{};
+		++pos_;
+
+		// pandoc escapes URIs in its own way
+		if (target.empty() || std::any_of(begin(target), end(target), [](char c) {
+				const auto u = static_cast<unsigned char>(c);
+				return (u <= 0x20) || (u >= 0x7f);
+			}))
+			throw unsupported{};
+
+		inline_renderer inner{label, rewrite_, !image || in_link_};
+		const auto contents = inner.render();
+		const auto attributes = "=\"" + escape(rewrite_(target)) + "\""
+			+ (title.empty() ? std::string{} : " title=\"" + escape(title) + "\"");
+
+		if (!image) {
+			text_ += "<a href" + attributes + ">" + contents + "</a>";
+			return;
+		}
+
+		const auto alt = strip_tags(contents);
+		if (alt.empty())
+			throw unsupported{};
+		image_ = "<img src" + attributes + " alt=\"" + alt + "\" />";
+		caption_ = contents;
+		++num_images_;
+		text_ += image_;
+	}
+
+	void angle_bracket()
+	{
+		static const std::string schemes[] = {"http://", "https://", "ftp://"};
+
+		const auto end = s_.find('>', pos_);
+		if (end == std::string::npos) {
+			text_ += "&lt;";
+			++pos_;
+			return;
+		}
+		const auto contents = s_.substr(pos_ + 1, end - pos_ - 1);
+
+		if (std::any_of(std::begin(schemes), std::end(schemes),
+				[&](const std::string & scheme) { return starts_with(contents, scheme); })) {
+			if (std::any_of(contents.begin(), contents.end(),
+					[](char c) { return is_space(c) || (c == '<'); }))
+				throw unsupported{};
+			text_ += "<a href=\"" + escape(rewrite_(contents)) + "\" class=\"uri\">"
+				+ escape(contents) + "</a>";
+			pos_ = end + 1;
+			return;
+		}
+
+		if (starts_with(contents, "!--")) {
+			const auto comment_end = s_.find("-->", pos_ + 4);
+			if (comment_end == std::string::npos)
+				throw unsupported{};
+			text_ += s_.substr(pos_, comment_end + 3 - pos_);
+			pos_ = comment_end + 3;
+			return;
+		}
+
+		// raw HTML tag, e-mail addresses are not
+		auto i = pos_ + 1;
+		if (at(i) == '/')
+			++i;
+		if (!std::isalpha(static_cast<unsigned char>(at(i)))) {
+			text_ += "&lt;";
+			++pos_;
+			return;
+		}
+		while (std::isalnum(static_cast<unsigned char>(at(i))))
+			++i;
+		if (!is_space(at(i)) && (at(i) != '/') && (at(i) != '>'))
+			throw unsupported{};
+		for (char q = 0; i < s_.size(); ++i) {
+			const auto c = s_[i];
+			if (q) {
+				if (c == q)
+					q = 0;
+			} else if ((c == '"') || (c == '\'')) {
+				q = c;
+			} else if (c == '<') {
+				throw unsupported{};
+			} else if (c == '>') {
+				break;
+			}
+		}
+		if (i >= s_.size())
+			throw unsupported{};
+		text_ += s_.substr(pos_, i + 1 - pos_);
+		pos_ = i + 1;
+	}
+
+	void ampersand()
+	{
+		auto i = pos_ + 1;
+		while ((i < s_.size()) && (std::isalnum(static_cast<unsigned char>(s_[i])) || s_[i] == '#'))
+			++i;
+		// entities are decoded by pandoc
+		if ((i > pos_ + 1) && (at(i) == ';'))
+			throw unsupported{};
+		text_ += "&amp;";
+		++pos_;
+	}
+
+	void quote(char c)
+	{
+		const auto prev = before(pos_);
+		const auto next = at(pos_ + 1);
+		const auto opening_context = is_space(prev) || (prev == '(') || (prev == '[')
+			|| (prev == '"') || (prev == '\'') || (prev == '-');
+
+		node q;
+		q.kind = node::type::quote;
+		q.c = c;
+		if ((c == '\'') && is_word(prev)) {
+			q.apostrophe = true;
+			q.can_close = !is_word(next);
+		} else if (opening_context && !is_space(next)) {
+			// a year, like '70s, is not quoted
+			if ((c == '\'') && std::isdigit(static_cast<unsigned char>(next)))
+				throw unsupported{};
+			q.can_open = true;
+		} else if (!is_space(prev)) {
+			q.can_close = true;
+		} else {
+			throw unsupported{};
+		}
+		push(std::move(q));
+		++pos_;
+	}
+
+	void ellipsis()
+	{
+		if (s_.compare(pos_, 3, "...") == 0) {
+			text_ += "…";
+			pos_ += 3;
+			return;
+		}
+		text_ += '.';
+		++pos_;
+	}
+
+	void dash()
+	{
+		const auto n = run_length(pos_);
+		if (n > 3)
+			throw unsupported{};
+		static const char * const dashes[] = {"-", "–", "—"};
+		text_ += dashes[n - 1];
+		pos_ += n;
+	}
+
+	void line_break()
+	{
+		std::size_t spaces = 0;
+		while ((spaces < pos_) && (s_[pos_ - spaces - 1] == ' '))
+			++spaces;
+		while (!text_.empty() && (text_.back() == ' '))
+			text_.pop_back();
+		text_ += (spaces >= 2) ? "<br />\n" : "\n";
+		++pos_;
+	}
+
+	/// Matches delimiters of emphasis, the way CommonMark does. Runs of
+	/// delimiters are matched as a whole.
+	void match_emphasis()
+	{
+		for (std::size_t c = 0; c < nodes_.size(); ++c) {
+			auto & closer = nodes_[c];
+			if ((closer.kind != node::type::emphasis) || !closer.can_close)
+				continue;
+
+			auto o = c;
+			bool found = false;
+			while (!found && (o-- > 0)) {
+				const auto & opener = nodes_[o];
+				found = (opener.kind == node::type::emphasis) && (opener.c == closer.c)
+					&& opener.can_open && (opener.count > 0);
+			}
+			if (!found)
+				continue;
+
+			// pandoc might match runs of different lengths differently
+			auto & opener = nodes_[o];
+			if (opener.count != closer.count)
+				throw unsupported{};
+			const std::string tag = (opener.count == 2) ? "strong" : "em";
+			opener.count = 0;
+			closer.count = 0;
+			opener.open = "<" + tag + ">";
+			closer.close = "</" + tag + ">";
+
+			for (auto i = o + 1; i < c; ++i) {
+				nodes_[i].can_open = false;
+				nodes_[i].can_close = false;
+			}
+		}
+
+		// pandoc might read unmatched delimiters differently
+		for (const auto & n : nodes_) {
+			if ((n.kind == node::type::emphasis) && (n.count > 0))
+				throw unsupported{};
+		}
+	}
+
+	/// Matches quotes, turns them into typographic ones.
+	void match_quotes()
+	{
+		std::vector<node *> open;
+		for (auto & n : nodes_) {
+			if (n.kind != node::type::quote)
+				continue;
+
+			const auto single = (n.c == '\'');
+			if (n.can_close && !open.empty() && (open.back()->c == n.c)) {
+				open.back()->html = single ? "‘" : "“";
+				n.html = single ? "’" : "”";
+				open.pop_back();
+			} else if (n.apostrophe) {
+				n.html = "’";
+			} else if (n.can_open) {
+				open.push_back(&n);
+			} else {
+				throw unsupported{};
+			}
+		}
+		if (!open.empty())
+			throw unsupported{};
+	}
+};
+
+struct list_marker {
+	bool ordered = false;
+	char c = 0; ///< bullet, or delimiter of the number
+	int start = 1;
+	std::size_t indent = 0; ///< of the marker
+	std::size_t offset = 0; ///< of the contents
+};
+
+/// Recognizes list items, empty items are not supported.
+bool parse_list_marker(const std::string & line, list_marker & m)
+{
+	m = list_marker{};
+	m.indent = indentation(line);
+	if ((m.indent > 3) || (m.indent >= line.size()))
+		return false;
+
+	auto i = m.indent;
+	const auto c = line[i];
+	if ((c == '-') || (c == '*') || (c == '+')) {
+		m.c = c;
+		++i;
+	} else {
+		while ((i < line.size()) && std::isdigit(static_cast<unsigned char>(line[i])))
+			++i;
+		if ((i == m.indent) || (i - m.indent > 9) || (i >= line.size())
+			|| ((line[i] != '.') && (line[i] != ')')))
+			return false;
+		m.ordered = true;
+		m.c = line[i];
+		m.start = std::stoi(line.substr(m.indent, i - m.indent));
+		++i;
+	}
+
+	if ((i < line.size()) && (line[i] != ' '))
+		return false;
+	const auto spaces = indentation(line.substr(i));
+	if ((i + spaces >= line.size()) || (spaces > 4))
+		throw unsupported{};
+	m.offset = i + spaces;
+	return true;
+}
+
+bool same_list(const list_marker & a, const list_marker & b)
+{
+	return (a.ordered == b.ordered) && (a.c == b.c);
+}
+
+int atx_level(const std::string & s)
+{
+	std::size_t n = 0;
+	while ((n < s.size()) && (s[n] == '#'))
+		++n;
+	if ((n == 0) || (n > 6) || ((n < s.size()) && (s[n] != ' ')))
+		return 0;
+	return static_cast<int>(n);
+}
+
+bool is_rule(const std::string & s)
+{
+	char c = 0;
+	int n = 0;
+	for (const auto ch : s) {
+		if (ch == ' ')
+			continue;
+		if ((c == 0) && ((ch == '*') || (ch == '-') || (ch == '_')))
+			c = ch;
+		if (ch != c)
+			return false;
+		++n;
+	}
+	return n >= 3;
+}
+
+bool is_fence(const std::string & s)
+{
+	return starts_with(s, "```") || starts_with(s, "~~~");
+}
+
+/// Lines of `=`, `-`, `+` and `:` underline headings or belong to tables.
+bool is_underline(const std::string & s)
+{
+	return !s.empty() && (s.find_first_not_of("=-+: ") == std::string::npos)
+		&& (s.find_first_of("=-") != std::string::npos);
+}
+
+/// List markers of pandoc beyond CommonMark: letters, roman numerals, `#`,
+/// numbers in parentheses.
+bool is_fancy_list_marker(const std::string & s)
+{
+	const std::size_t first = (!s.empty() && (s[0] == '(')) ? 1 : 0;
+	auto i = first;
+	while ((i < s.size()) && std::isalnum(static_cast<unsigned char>(s[i])))
+		++i;
+	if ((i == first) && (i < s.size()) && (s[i] == '#'))
+		++i;
+	if ((i == first) || (i >= s.size()) || ((s[i] != '.') && (s[i] != ')'))
+		|| ((i + 1 < s.size()) && (s[i + 1] != ' ')))
+		return false;
+
+	const auto token = s.substr(first, i - first);
+	const auto digits = std::all_of(
+		begin(token), end(token), [](unsigned char c) { return std::isdigit(c); });
+	const auto roman = std::all_of(begin(token), end(token),
+		[](char c) { return std::string{"ivxlcdmIVXLCDM"}.find(c) != std::string::npos; });
+	return digits ? (first == 1) : (roman || (token.size() == 1));
+}
+
+/// Returns `true` if the line starts something else than a paragraph, for
+/// pandoc or CommonMark.
+bool starts_block(const std::string & line)
+{
+	const auto indent = indentation(line);
+	if (indent > 3)
+		return false;
+	const auto s = line.substr(indent);
+	list_marker m;
+	return is_fence(s) || atx_level(s) || is_rule(s) || is_underline(s) || (s[0] == '>')
+		|| (s[0] == '<') || (s[0] == ':') || (s[0] == '|') || (s[0] == '%')
+		|| is_fancy_list_marker(s) || parse_list_marker(line, m);
+}
+
+struct block {
+	enum class type { paragraph, heading, code, quote, list, rule };
+
+	type kind = type::paragraph;
+	int level = 0; ///< heading
+	std::string text; ///< paragraph and heading: markdown, code: contents
+	std::vector<block> children; ///< quote
+	std::vector<std::vector<block>> items; ///< list
+	bool ordered = false;
+	bool tight = true;
+	int start = 1;
+};
+
+std::vector<block> parse_blocks(const std::vector<std::string> & lines, bool in_item);
+
+/// Parses the list starting at the line.
+///
+/// \return The line after the list.
+std::size_t parse_list(const std::vector<std::string> & lines, std::size_t i, list_marker m,
+	std::vector<block> & blocks)
+{
+	block list;
+	list.kind = block::type::list;
+	list.ordered = m.ordered;
+	list.start = m.start;
+
+	const auto n = lines.size();
+	bool blank_between = false;
+	bool adjacent = false;
+	bool blank_within = false;
+
+	for (;;) {
+		std::vector<std::string> item{lines[i].substr(m.offset)};
+		std::size_t blanks = 0;
+		auto k = i + 1;
+		for (; k < n; ++k) {
+			const auto & line = lines[k];
+			if (is_blank(line)) {
+				++blanks;
+				continue;
+			}
+			const auto indent = indentation(line);
+			if (indent >= m.offset) {
+				if (blanks > 0)
+					blank_within = true;
+				item.insert(item.end(), blanks, std::string{});
+				item.push_back(line.substr(m.offset));
+				blanks = 0;
+				continue;
+			}
+			list_marker next;
+			if (parse_list_marker(line, next) || (blanks > 0)) {
+				// indented less than the contents, more than the marker
+				if ((indent > m.indent) && ((blanks > 0) || !same_list(next, m)))
+					throw unsupported{};
+				break;
+			}
+			// lazy continuation of a paragraph
+			if (starts_block(line))
+				throw unsupported{};
+			item.push_back(line.substr(indent));
+		}
+		list.items.push_back(parse_blocks(item, true));
+
+		list_marker next;
+		if ((k >= n) || !parse_list_marker(lines[k], next)
+			|| ((blanks > 0) && !same_list(next, m))) {
+			i = k;
+			break;
+		}
+		if (!same_list(next, m))
+			throw unsupported{};
+		((blanks > 0) ? blank_between : adjacent) = true;
+		m = next;
+		i = k;
+	}
+
+	// pandoc decides for each item
+	if (blank_between && adjacent)
+		throw unsupported{};
+	if (blank_within && !blank_between && (list.items.size() > 1))
+		throw unsupported{};
+	list.tight = !blank_between && !blank_within;
+
+	blocks.push_back(std::move(list));
+	return i;
+}
+
+/// Parses lines into blocks. Within list items, lists may follow paragraphs
+/// directly.
+std::vector<block> parse_blocks(const std::vector<std::string> & lines, bool in_item)
+{
+	std::vector<block> blocks;
+	const auto n = lines.size();
+	std::size_t i = 0;
+	while (i < n) {
+		const auto & line = lines[i];
+		if (is_blank(line)) {
+			++i;
+			continue;
+		}
+
+		const auto indent = indentation(line);
+		if (indent >= 4) {
+			block b;
+			b.kind = block::type::code;
+			auto last = i;
+			for (auto k = i; (k < n) && (is_blank(lines[k]) || (indentation(lines[k]) >= 4));
+				 ++k) {
+				if (!is_blank(lines[k]))
+					last = k;
+			}
+			for (; i <= last; ++i)
+				b.text += ((lines[i].size() > 4) ? lines[i].substr(4) : std::string{}) + '\n';
+			blocks.push_back(std::move(b));
+			continue;
+		}
+
+		const auto s = line.substr(indent);
+		if (is_fence(s)) {
+			const auto fence = s.substr(0, s.find_first_not_of(s[0]));
+			// info strings lead to highlighting
+			if (!is_blank(s.substr(fence.size())))
+				throw unsupported{};
+
+			block b;
+			b.kind = block::type::code;
+			for (++i;; ++i) {
+				if (i >= n)
+					throw unsupported{};
+				const auto & l = lines[i];
+				const auto rest = l.substr(std::min(indentation(l), std::size_t{3}));
+				const auto end = std::min(rest.find_first_not_of(fence[0]), rest.size());
+				if ((end >= fence.size()) && is_blank(rest.substr(end)))
+					break;
+				b.text += l.substr(std::min(indentation(l), indent)) + '\n';
+			}
+			++i;
+			blocks.push_back(std::move(b));
+			continue;
+		}
+
+		if (const auto level = atx_level(s)) {
+			block b;
+			b.kind = block::type::heading;
+			b.level = level;
+			auto text = trim(s.substr(level));
+			const auto closing = text.find_last_not_of('#');
+			if ((closing == std::string::npos) || (text[closing] == ' '))
+				text = trim(text.substr(0, (closing == std::string::npos) ? 0 : closing));
+			b.text = text;
+			blocks.push_back(std::move(b));
+			++i;
+			continue;
+		}
+
+		if (is_rule(s)) {
+			// may be a YAML metadata block or a table for pandoc
+			if ((i + 1 < n) && !is_blank(lines[i + 1]))
+				throw unsupported{};
+			block b;
+			b.kind = block::type::rule;
+			blocks.push_back(std::move(b));
+			++i;
+			continue;
+		}
+
+		if (s[0] == '>') {
+			block b;
+			b.kind = block::type::quote;
+			std::vector<std::string> inner;
+			for (; (i < n) && !is_blank(lines[i]); ++i) {
+				const auto & l = lines[i];
+				const auto ind = indentation(l);
+				if ((ind > 3) || (l[ind] != '>'))
+					throw unsupported{};
+				auto rest = l.substr(ind + 1);
+				if (!rest.empty() && (rest[0] == ' '))
+					rest.erase(0, 1);
+				inner.push_back(rest);
+			}
+			// pandoc may join quotes separated by empty lines
+			auto k = i;
+			while ((k < n) && is_blank(lines[k]))
+				++k;
+			if ((k < n) && (indentation(lines[k]) <= 3)
+				&& (lines[k][indentation(lines[k])] == '>'))
+				throw unsupported{};
+			b.children = parse_blocks(inner, false);
+			blocks.push_back(std::move(b));
+			continue;
+		}
+
+		list_marker m;
+		if (parse_list_marker(line, m)) {
+			i = parse_list(lines, i, m, blocks);
+			continue;
+		}
+
+		if (starts_block(line))
+			throw unsupported{};
+
+		block b;
+		b.text = s;
+		for (++i; (i < n) && !is_blank(lines[i]); ++i) {
+			const auto & l = lines[i];
+			if (in_item && parse_list_marker(l, m))
+				break;
+			if (starts_block(l))
+				throw unsupported{};
+			b.text += '\n' + l.substr(indentation(l));
+		}
+		b.text = trim(b.text);
+		blocks.push_back(std::move(b));
+	}
+	return blocks;
+}
+
+struct heading {
+	int level = 0;
+	std::string id;
+	std::string html;
+};
+
+/// Renders blocks into HTML, collects the headings.
+class block_renderer
+{
+public:
+	block_renderer(const link_rewriter & rewrite)
+		: rewrite_(rewrite)
+	{
+	}
+
+	std::string render(const std::vector<block> & blocks, bool tight = false)
+	{
+		std::string html;
+		for (const auto & b : blocks) {
+			if (!html.empty())
+				html += '\n';
+			html += render(b, tight);
+		}
+		return html;
+	}
+
+	const std::vector<heading> & headings() const { return headings_; }
+
+private:
+	const link_rewriter & rewrite_;
+	std::vector<heading> headings_;
+	std::set<std::string> ids_;
+
+	std::string render(const block & b, bool tight)
+	{
+		switch (b.kind) {
+			case block::type::paragraph: {
+				inline_renderer r{b.text, rewrite_, false};
+				const auto html = r.render();
+				if (tight)
+					return html;
+				if (r.is_image()) {
+					return "<figure>\n" + html + "\n<figcaption aria-hidden=\"true\">"
+						+ r.caption() + "</figcaption>\n</figure>";
+				}
+				return "<p>" + html + "</p>";
+			}
+
+			case block::type::heading: {
+				heading h;
+				h.level = b.level;
+				h.html = inline_renderer{b.text, rewrite_, false}.render();
+				h.id = identifier(h.html);
+				headings_.push_back(h);
+				const auto tag = "h" + std::to_string(h.level);
+				return "<" + tag + " id=\"" + h.id + "\">" + h.html + "</" + tag + ">";
+			}
+
+			case block::type::code: {
+				auto text = b.text;
+				while (!text.empty() && (text.back() == '\n'))
+					text.pop_back();
+				return "<pre><code>" + escape(text) + "</code></pre>";
+			}
+
+			case block::type::quote:
+				return "<blockquote>\n" + render(b.children) + "\n</blockquote>";
+
+			case block::type::list: {
+				std::string html;
+				if (!b.ordered) {
+					html = "<ul>\n";
+				} else if (b.start == 1) {
+					html = "<ol type=\"1\">\n";
+				} else {
+					html = "<ol start=\"" + std::to_string(b.start) + "\" type=\"1\">\n";
+				}
+				for (const auto & item : b.items)
+					html += "<li>" + render(item, b.tight) + "</li>\n";
+				return html + (b.ordered ? "</ol>" : "</ul>");
+			}
+
+			case block::type::rule:
+				return "<hr />";
+		}
+		return {};
+	}
+
+	/// Returns a unique identifier for the heading, the way pandoc derives it.
+	std::string identifier(const std::string & html)
+	{
+		const auto text = unescape(strip_tags(html));
+
+		std::string id;
+		bool separate = false;
+		for (std::size_t i = 0; i < text.size(); ++i) {
+			const auto c = static_cast<unsigned char>(text[i]);
+			std::string ch;
+			if (c >= 0x80) {
+				const std::size_t len = (c >= 0xf0) ? 4 : (c >= 0xe0) ? 3 : 2;
+				ch = text.substr(i, len);
+				i += len - 1;
+				const auto c1 = static_cast<unsigned char>(ch.size() > 1 ? ch[1] : 0);
+				if ((c == 0xe2) && (c1 == 0x80)) // general punctuation
+					continue;
+				if ((c == 0xc2) && (c1 == 0xa0)) { // non-breaking space
+					separate = !id.empty();
+					continue;
+				}
+				if ((c == 0xc3) && (c1 >= 0x80) && (c1 <= 0x9e) && (c1 != 0x97))
+					ch[1] = static_cast<char>(c1 + 0x20); // Latin-1 letters, lower case
+			} else if (std::isalpha(c)) {
+				ch = static_cast<char>(std::tolower(c));
+			} else if (std::isdigit(c) || (c == '_') || (c == '-') || (c == '.')) {
+				// identifiers start with a letter
+				if (id.empty())
+					continue;
+				ch = static_cast<char>(c);
+			} else {
+				if (std::isspace(c))
+					separate = !id.empty();
+				continue;
+			}
+			if (separate)
+				id += '-';
+			separate = false;
+			id += ch;
+		}
+		if (id.empty())
+			id = "section";
+
+		auto unique = id;
+		for (int n = 1; ids_.count(unique); ++n)
+			unique = id + '-' + std::to_string(n);
+		ids_.insert(unique);
+		return unique;
+	}
+};
+
+/// Returns the TOC as nested lists, see `render_markdown`.
+std::string toc_list(const std::vector<heading> & headings, std::size_t & i, int parent_level)
+{
+	std::string html = "<ul>\n";
+	while ((i < headings.size()) && (headings[i].level > parent_level)) {
+		const auto & h = headings[i++];
+		html += "<li><a href=\"#" + h.id + "\" id=\"toc-" + h.id + "\">" + h.html + "</a>";
+		if ((i < headings.size()) && (headings[i].level > h.level))
+			html += '\n' + toc_list(headings, i, h.level);
+		html += "</li>\n";
+	}
+	return html + "</ul>";
+}
+}
+
+std::experimental::optional<markdown_document> render_markdown(
+	const std::string & text, const link_rewriter & rewrite, int toc_depth)
+{
+	try {
+		const auto lines = split_lines(text);
+
+		// title blocks of pandoc
+		if (!lines.empty() && starts_with(lines.front(), "%"))
+			return {};
+
+		block_renderer renderer{rewrite};
+		markdown_document doc;
+		doc.body = renderer.render(parse_blocks(lines, false));
+
+		std::vector<heading> toc;
+		for (const auto & h : renderer.headings()) {
+			if (h.level > toc_depth)
+				continue;
+			// links within the TOC are removed by pandoc
+			if (h.html.find("<a ") != std::string::npos)
+				return {};
+			toc.push_back(h);
+		}
+		if (!toc.empty()) {
+			std::size_t i = 0;
+			doc.toc = toc_list(toc, i, 0);
+		}
+		return doc;
+	} catch (const unsupported &) {
+		return {};
+	}
+}
+
+std::experimental::optional<std::string> render_markdown_inline(
+	const std::string & text, const link_rewriter & rewrite)
+{
+	try {
+		const auto blocks = parse_blocks(split_lines(text), false);
+		if (blocks.empty())
+			return std::string{};
+		if ((blocks.size() > 1) || (blocks.front().kind != block::type::paragraph))
+			return {};
+		return inline_renderer{blocks.front().text, rewrite, false}.render();
+	} catch (const unsupported &) {
+		return {};
+	}
+}
+
+std::string strip_tags(const std::string & html)
+{
+	std::string result;
+	bool in_tag = false;
+	for (const auto c : html) {
+		if (c == '<') {
+			in_tag = true;
+		} else if ((c == '>') && in_tag) {
+			in_tag = false;
+		} else if (!in_tag) {
+			result += c;
+		}
+	}
+	return result;
+}
+}
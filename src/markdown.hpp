@@ -0,0 +1,50 @@
+#ifndef MKWEB__MARKDOWN__HPP
+#define MKWEB__MARKDOWN__HPP
+
+#include <functional>
+#include <string>
+#include <experimental/optional>
+
+namespace mkweb
+{
+/// A document rendered by `render_markdown`.
+struct markdown_document {
+	std::string body; ///< HTML
+	std::string toc; ///< HTML list of links to the headings, empty if there are none
+};
+
+/// Rewrites the target of a link or image.
+using link_rewriter = std::function<std::string(const std::string &)>;
+
+/// Renders markdown into HTML5 in-process, the way pandoc renders its markdown
+/// (smart punctuation, identifiers of headings, implicit figures).
+///
+/// Supported are paragraphs, ATX headings, block quotes, bullet and ordered
+/// lists, fenced and indented code blocks without highlighting, horizontal
+/// rules, emphasis, code spans, inline links and images, autolinks, inline
+/// HTML and hard line breaks.
+///
+/// Everything else pandoc knows about (tables, footnotes, math, reference
+/// links, definition lists, fenced divs, attributes, HTML blocks, citations,
+/// etc.) and constructs pandoc reads differently from CommonMark are not
+/// rendered, those documents are left to pandoc.
+///
+/// \param[in] text The document, without front matter.
+/// \param[in] rewrite Rewrites targets of links and images.
+/// \param[in] toc_depth Headings up to this level are listed in the TOC.
+/// \return The document, nothing if it uses unsupported syntax.
+std::experimental::optional<markdown_document> render_markdown(
+	const std::string & text, const link_rewriter & rewrite, int toc_depth);
+
+/// Renders the text as the contents of a paragraph, e.g. meta data.
+///
+/// \return The HTML, nothing if the text uses unsupported syntax.
+std::experimental::optional<std::string> render_markdown_inline(
+	const std::string & text, const link_rewriter & rewrite);
+
+/// Returns the text of HTML without any tags, entities are kept. Plain text
+/// the way pandoc uses it for some variables, e.g. `pagetitle`.
+std::string strip_tags(const std::string & html);
+}
+
+#endif
@@ -0,0 +1,327 @@
+#include "meta_index.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+#include <unordered_map>
+#include <experimental/filesystem>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mkweb
+{
+namespace fs
+{
+using path = std::experimental::filesystem::path;
+using std::experimental::filesystem::create_directories;
+using std::experimental::filesystem::rename;
+}
+
+namespace
+{
+constexpr char magic[8] = {'M', 'K', 'W', 'E', 'B', 'I', 'D', 'X'};
+constexpr std::uint32_t format_version = 1;
+constexpr std::uint32_t byte_order_mark = 0x01020304;
+
+// layout of the file: header, records (sorted by path), list items, strings
+
+struct header {
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t byte_order;
+	std::uint64_t num_records;
+	std::uint64_t records_offset;
+	std::uint64_t num_items;
+	std::uint64_t items_offset;
+	std::uint64_t strings_size;
+	std::uint64_t strings_offset;
+};
+
+struct str_ref {
+	std::uint32_t offset;
+	std::uint32_t size;
+};
+
+struct list_ref {
+	std::uint32_t first;
+	std::uint32_t count;
+};
+
+struct record {
+	str_ref path;
+	std::uint64_t size;
+	std::int64_t mtime;
+	std::uint64_t inode;
+	std::uint32_t has_meta;
+	std::uint32_t date[6]; // year, month, day, hour, minute, second
+	str_ref title;
+	str_ref language;
+	str_ref summary;
+	list_ref authors;
+	list_ref tags;
+	list_ref plugins;
+};
+
+static_assert(std::is_standard_layout<header>::value, "header must be plain data");
+static_assert(std::is_standard_layout<record>::value, "record must be plain data");
+
+constexpr std::uint64_t align(std::uint64_t n)
+{
+	return (n + 7u) & ~std::uint64_t{7u};
+}
+
+/// Collects the data of the file to write.
+class writer
+{
+public:
+	std::vector<record> records;
+	std::vector<str_ref> items;
+	std::string strings;
+
+	str_ref add(const std::string & s)
+	{
+		const auto i = known.find(s);
+		if (i != known.end())
+			return i->second;
+		if (strings.size() + s.size() > UINT32_MAX)
+			throw std::runtime_error{"meta index too large"};
+		const str_ref ref{static_cast<std::uint32_t>(strings.size()),
+			static_cast<std::uint32_t>(s.size())};
+		strings += s;
+		known.emplace(s, ref);
+		return ref;
+	}
+
+	list_ref add(const std::vector<std::string> & list)
+	{
+		const list_ref ref{static_cast<std::uint32_t>(items.size()),
+			static_cast<std::uint32_t>(list.size())};
+		for (const auto & s : list)
+			items.push_back(add(s));
+		return ref;
+	}
+
+private:
+	std::unordered_map<std::string, str_ref> known;
+};
+}
+
+bool meta_index::status(const std::string & path, file_status & st)
+{
+	struct stat s;
+	if ((::stat(path.c_str(), &s) == -1) || !S_ISREG(s.st_mode))
+		return false;
+	st.size = static_cast<std::uint64_t>(s.st_size);
+	st.mtime = static_cast<std::int64_t>(s.st_mtim.tv_sec) * 1000000000 + s.st_mtim.tv_nsec;
+	st.inode = static_cast<std::uint64_t>(s.st_ino);
+	return true;
+}
+
+meta_index::meta_index(const std::string & filename)
+{
+	const auto fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return;
+
+	struct stat s;
+	if ((::fstat(fd, &s) == -1) || (static_cast<std::size_t>(s.st_size) < sizeof(header))) {
+		::close(fd);
+		return;
+	}
+
+	auto * p = ::mmap(nullptr, static_cast<std::size_t>(s.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (p == MAP_FAILED)
+		return;
+
+	data_ = p;
+	length_ = static_cast<std::size_t>(s.st_size);
+
+	// everything found by `find` is checked, only the structure is checked here
+	const auto & h = *static_cast<const header *>(data_);
+	const auto valid = (std::memcmp(h.magic, magic, sizeof(magic)) == 0)
+		&& (h.version == format_version) && (h.byte_order == byte_order_mark)
+		&& ((h.records_offset % alignof(record)) == 0)
+		&& ((h.items_offset % alignof(str_ref)) == 0)
+		&& (h.num_records <= length_ / sizeof(record))
+		&& (h.num_items <= length_ / sizeof(str_ref))
+		&& valid_range(h.records_offset, h.num_records * sizeof(record))
+		&& valid_range(h.items_offset, h.num_items * sizeof(str_ref))
+		&& valid_range(h.strings_offset, h.strings_size);
+	if (!valid) {
+		::munmap(const_cast<void *>(data_), length_);
+		data_ = nullptr;
+		length_ = 0;
+	}
+}
+
+meta_index::~meta_index()
+{
+	if (data_)
+		::munmap(const_cast<void *>(data_), length_);
+}
+
+bool meta_index::valid_range(std::uint64_t offset, std::uint64_t size) const
+{
+	return (offset <= length_) && (size <= length_ - offset);
+}
+
+std::size_t meta_index::size() const
+{
+	return data_ ? static_cast<std::size_t>(static_cast<const header *>(data_)->num_records) : 0u;
+}
+
+bool meta_index::find(const std::string & path, const file_status & st,
+	std::experimental::optional<meta_info> & meta) const
+{
+	if (!data_)
+		return false;
+
+	const auto * base = static_cast<const char *>(data_);
+	const auto & h = *static_cast<const header *>(data_);
+	const auto * records = reinterpret_cast<const record *>(base + h.records_offset);
+	const auto * items = reinterpret_cast<const str_ref *>(base + h.items_offset);
+	const auto * strings = base + h.strings_offset;
+
+	bool valid = true;
+	auto str = [&](const str_ref & ref) {
+		if ((std::uint64_t{ref.offset} + ref.size) > h.strings_size) {
+			valid = false;
+			return std::string{};
+		}
+		return std::string{strings + ref.offset, ref.size};
+	};
+	auto list = [&](const list_ref & ref) {
+		std::vector<std::string> result;
+		if ((std::uint64_t{ref.first} + ref.count) > h.num_items) {
+			valid = false;
+			return result;
+		}
+		result.reserve(ref.count);
+		for (std::uint32_t i = 0; i < ref.count; ++i)
+			result.push_back(str(items[ref.first + i]));
+		return result;
+	};
+
+	// compares the path of a record with the searched one
+	auto compare = [&](const record & r) {
+		if ((std::uint64_t{r.path.offset} + r.path.size) > h.strings_size) {
+			valid = false;
+			return 0;
+		}
+		const auto n = std::min<std::size_t>(r.path.size, path.size());
+		const auto c = std::memcmp(strings + r.path.offset, path.data(), n);
+		if (c != 0)
+			return c;
+		return (r.path.size < path.size()) ? -1 : (r.path.size > path.size()) ? 1 : 0;
+	};
+
+	std::size_t lo = 0;
+	std::size_t hi = static_cast<std::size_t>(h.num_records);
+	while (lo < hi) {
+		const auto mid = lo + (hi - lo) / 2;
+		const auto c = compare(records[mid]);
+		if (!valid)
+			return false;
+		if (c == 0) {
+			const auto & r = records[mid];
+			if ((r.size != st.size) || (r.mtime != st.mtime) || (r.inode != st.inode))
+				return false;
+
+			if (!r.has_meta) {
+				meta = {};
+				return true;
+			}
+
+			meta_info info;
+			info.date = posix_time::from_fields(
+				r.date[0], r.date[1], r.date[2], r.date[3], r.date[4], r.date[5]);
+			info.title = str(r.title);
+			info.language = str(r.language);
+			info.summary = str(r.summary);
+			info.authors = list(r.authors);
+			info.tags = list(r.tags);
+			info.plugins = list(r.plugins);
+			if (!valid)
+				return false;
+			meta = std::move(info);
+			return true;
+		}
+		if (c < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return false;
+}
+
+void meta_index::write(const std::string & filename, std::vector<entry> entries)
+{
+	std::sort(begin(entries), end(entries),
+		[](const entry & a, const entry & b) { return a.path < b.path; });
+
+	writer w;
+	w.records.reserve(entries.size());
+	for (const auto & e : entries) {
+		record r;
+		std::memset(&r, 0, sizeof(r));
+		r.path = w.add(e.path);
+		r.size = e.status.size;
+		r.mtime = e.status.mtime;
+		r.inode = e.status.inode;
+		if (e.meta) {
+			const auto & info = *e.meta;
+			r.has_meta = 1;
+			r.date[0] = info.date.year();
+			r.date[1] = info.date.month();
+			r.date[2] = info.date.day();
+			r.date[3] = info.date.hour();
+			r.date[4] = info.date.minute();
+			r.date[5] = info.date.second();
+			r.title = w.add(info.title);
+			r.language = w.add(info.language);
+			r.summary = w.add(info.summary);
+			r.authors = w.add(info.authors);
+			r.tags = w.add(info.tags);
+			r.plugins = w.add(info.plugins);
+		}
+		w.records.push_back(r);
+	}
+
+	header h;
+	std::memset(&h, 0, sizeof(h));
+	std::memcpy(h.magic, magic, sizeof(magic));
+	h.version = format_version;
+	h.byte_order = byte_order_mark;
+	h.num_records = w.records.size();
+	h.records_offset = align(sizeof(header));
+	h.num_items = w.items.size();
+	h.items_offset = align(h.records_offset + h.num_records * sizeof(record));
+	h.strings_size = w.strings.size();
+	h.strings_offset = align(h.items_offset + h.num_items * sizeof(str_ref));
+
+	std::string data(h.strings_offset + h.strings_size, '\0');
+	std::memcpy(&data[0], &h, sizeof(h));
+	if (!w.records.empty())
+		std::memcpy(&data[h.records_offset], w.records.data(), w.records.size() * sizeof(record));
+	if (!w.items.empty())
+		std::memcpy(&data[h.items_offset], w.items.data(), w.items.size() * sizeof(str_ref));
+	std::memcpy(&data[h.strings_offset], w.strings.data(), w.strings.size());
+
+	// write and rename, a mapped index remains valid
+	const auto path = fs::path{filename};
+	if (path.has_parent_path())
+		fs::create_directories(path.parent_path());
+	const auto tmp = filename + ".tmp";
+	{
+		std::ofstream ofs{tmp.c_str(), std::ios::binary};
+		ofs.write(data.data(), static_cast<std::streamsize>(data.size()));
+		if (!ofs)
+			throw std::runtime_error{"unable to write meta index: " + tmp};
+	}
+	fs::rename(tmp, filename);
+}
+}
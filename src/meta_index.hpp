@@ -0,0 +1,71 @@
+#ifndef MKWEB__META_INDEX__HPP
+#define MKWEB__META_INDEX__HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <experimental/optional>
+#include "meta_info.hpp"
+
+namespace mkweb
+{
+/// Persistent index of the meta information of all source files.
+///
+/// The index is a binary file, memory mapped for reading. Entries are found
+/// by path and are only valid as long as size, modification time and inode
+/// of the file match. Files without meta information are part of the index
+/// as well, to not read them again.
+///
+/// The file is native to the machine (byte order, alignment), and only meant
+/// as a cache. An invalid or incompatible file is ignored.
+class meta_index
+{
+public:
+	struct file_status {
+		std::uint64_t size = 0;
+		std::int64_t mtime = 0; // nanoseconds
+		std::uint64_t inode = 0;
+	};
+
+	struct entry {
+		std::string path;
+		file_status status;
+		std::experimental::optional<meta_info> meta;
+	};
+
+	/// Determines the status of the specified file.
+	///
+	/// \return `false` if the file is not accessible or not a regular file.
+	static bool status(const std::string & path, file_status & st);
+
+	/// Maps the specified index file, if it exists and is valid.
+	meta_index(const std::string & filename);
+	~meta_index();
+
+	meta_index(const meta_index &) = delete;
+	meta_index & operator=(const meta_index &) = delete;
+
+	/// Number of entries.
+	std::size_t size() const;
+
+	/// Looks up the entry of a file.
+	///
+	/// \param[in] path Path of the file.
+	/// \param[in] st Current status of the file.
+	/// \param[out] meta Meta information of the file, empty if it has none.
+	/// \return `true` if the entry was found and is still valid.
+	bool find(const std::string & path, const file_status & st,
+		std::experimental::optional<meta_info> & meta) const;
+
+	/// Writes the entries to the index file, replacing it atomically.
+	static void write(const std::string & filename, std::vector<entry> entries);
+
+private:
+	const void * data_ = nullptr;
+	std::size_t length_ = 0;
+
+	bool valid_range(std::uint64_t offset, std::uint64_t size) const;
+};
+}
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef MKWEB__META_INFO__HPP
+#define MKWEB__META_INFO__HPP
+
+#include <string>
+#include <vector>
+#include "posix_time.hpp"
+
+namespace mkweb
+{
+/// Meta information about a document.
+struct meta_info {
+	posix_time date;
+	std::string title;
+	std::vector<std::string> authors;
+	std::vector<std::string> tags;
+	std::string language;
+	std::string summary;
+	std::vector<std::string> plugins;
+};
+}
+
+#endif
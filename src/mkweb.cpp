@@ -1,6 +1,12 @@
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstring>
 #include <fstream>
 #include <iostream>
-#include <map>
+#include <mutex>
+#include <set>
 #include <sstream>
 #include <string>
 #include <unordered_map>
@@ -17,11 +23,29 @@
 
 #include <fmt/format.h>
 
+#include <unistd.h>
+
 #include "system.hpp"
+#include "unix_socket.hpp"
 #include "config.hpp"
+#include "dependencies.hpp"
+#include "doc_template.hpp"
+#include "document_store.hpp"
+#include "front_matter.hpp"
+#include "hash.hpp"
+#include "json_link_filter.hpp"
+#include "markdown.hpp"
+#include "meta_index.hpp"
+#include "meta_info.hpp"
+#include "path_resolver.hpp"
+#include "plugin_registry.hpp"
 #include "posix_time.hpp"
-#include "subprocess.hpp"
+#include "process_executor.hpp"
+#include "render_cache.hpp"
+#include "trace.hpp"
 #include "version.hpp"
+#include "watcher.hpp"
+#include "worker_pool.hpp"
 
 namespace mkweb
 {
@@ -29,67 +53,138 @@ namespace fs
 {
 using path = std::experimental::filesystem::path;
 using copy_options = std::experimental::filesystem::copy_options;
+using directory_iterator = std::experimental::filesystem::directory_iterator;
 using recursive_directory_iterator
 	= std::experimental::filesystem::recursive_directory_iterator;
 using std::experimental::filesystem::exists;
 using std::experimental::filesystem::is_regular_file;
 using std::experimental::filesystem::is_directory;
+using std::experimental::filesystem::is_symlink;
+using file_time_type = std::experimental::filesystem::file_time_type;
 using std::experimental::filesystem::last_write_time;
 using std::experimental::filesystem::temp_directory_path;
+using std::experimental::filesystem::remove;
 using std::experimental::filesystem::remove_all;
 using std::experimental::filesystem::copy;
 using std::experimental::filesystem::create_directories;
 using std::experimental::filesystem::canonical;
+using std::experimental::filesystem::rename;
 }
 
-/// Meta information about a document.
-struct meta_info {
-	posix_time date;
-	std::string title;
-	std::vector<std::string> authors;
-	std::vector<std::string> tags;
-	std::string language;
-	std::string summary;
-	std::vector<std::string> plugins;
+/// How documents are rendered.
+enum class render_mode {
+	two_pass, ///< source to JSON, links rewritten by mkweb, JSON to HTML
+	single_pass, ///< source to HTML, links rewritten by a Lua filter within pandoc
+};
+
+/// Fingerprint of a theme or plugin file, taken once per build.
+struct shared_file {
+	dependencies::file_entry status; ///< size and modification time
+	std::string cache_hash; ///< hash of the contents for the render cache, taken on demand
+};
+
+/// Counters of a build, see `--stats`.
+struct build_statistics {
+	std::size_t pages_rendered = 0; ///< by pandoc or in-process
+	std::size_t pages_cached = 0; ///< restored from the render cache
+	std::size_t pages_skipped = 0; ///< up to date
+	std::size_t pages_ignored = 0; ///< not of a type to be processed
+	std::size_t pages_failed = 0;
+	std::size_t pages_native = 0; ///< generated pages, see `--native-pages`
+	std::size_t pandoc_processes = 0;
+	std::uint64_t bytes_to_pandoc = 0;
+	std::uint64_t bytes_from_pandoc = 0;
+	std::size_t static_copied = 0;
+	std::size_t static_up_to_date = 0;
+	std::size_t plugin_files_installed = 0;
+
+	/// Durations of rendering documents in milliseconds, by destination.
+	std::vector<std::pair<std::string, double>> latencies;
 };
 
 /// Contains all global data.
 static struct {
-	std::unordered_map<std::string, meta_info> meta;
-	std::unordered_map<std::string, std::vector<std::string>> tags;
-	std::unordered_map<std::string, std::vector<std::string>> years;
-	std::map<posix_time, std::vector<std::string>, std::greater<>> dates;
+	document_store docs;
 	std::unordered_set<std::string> plugins;
 
 	std::string tag_list;
 	std::string year_list;
 	std::string page_list;
-} global;
 
-/// Returns meta information about the specified file.
-static std::experimental::optional<meta_info> get_meta_for_source(
-	const std::string & filename_in)
-{
-	const auto it = global.meta.find(filename_in);
-	if (it != global.meta.end())
-		return it->second;
-	return {};
-}
+	// parameters for pandoc the same for all documents (`-V`/`-M` pairs), passed
+	// by a defaults file if pandoc supports them, see `prepare_shared_params`
+	std::vector<std::string> shared_params;
+	std::string defaults_file;
+	dependencies::record shared_record;
+	std::string shared_params_hash;
+
+	// resolved once, read concurrently while rendering documents
+	path_resolver resolver;
+
+	// URLs of all documents with meta data, by identifier
+	std::vector<std::string> urls;
+
+	// theme and plugin files and plugin manifests, valid for one build
+	std::unordered_map<std::string, shared_file> shared_files;
+	plugin_registry registry;
+	std::unique_ptr<doc_template> page_template;
+
+	std::size_t jobs = 1;
+	std::size_t batch_size = 1;
+
+	render_mode mode = render_mode::two_pass;
+	bool native_pages = false; // generated pages rendered without pandoc
+	std::string link_filter;
+
+	// build state, kept between runs
+	std::string state_directory;
+	std::unique_ptr<dependencies> deps;
+	std::unique_ptr<render_cache> cache;
+
+	// durations of the phases in milliseconds, in order of their first occurrence
+	std::vector<std::pair<std::string, double>> timings;
 
-/// Reads meta information from the header of a markdown file.
-static std::string read_meta_string_from_markdown(const std::string & path)
+	// spans of the build, see `--profile`
+	std::unique_ptr<trace> profile;
+
+	build_statistics stats;
+} global;
+
+/// Measures the duration of a phase of the build for its lifetime, durations
+/// of the same phase are accumulated, see `--timings`. Recorded as span of
+/// the profile as well, if there is one.
+class phase_timer
 {
-	std::ifstream ifs{path.c_str()};
+public:
+	explicit phase_timer(const std::string & name)
+		: name_(name)
+		, start_(std::chrono::steady_clock::now())
+	{
+	}
 
-	std::string line;
-	while (std::getline(ifs, line) && (line != "---"))
-		;
-	std::string contents;
-	while (std::getline(ifs, line) && (line != "---")) {
-		contents += line + '\n';
+	~phase_timer()
+	{
+		const auto now = std::chrono::steady_clock::now();
+		if (global.profile)
+			global.profile->complete(name_, "phase", start_, now);
+
+		const auto ms = std::chrono::duration<double, std::milli>(now - start_).count();
+		auto i = std::find_if(begin(global.timings), end(global.timings),
+			[&](const std::pair<std::string, double> & t) { return t.first == name_; });
+		if (i == end(global.timings)) {
+			global.timings.emplace_back(name_, ms);
+		} else {
+			i->second += ms;
+		}
 	}
-	return contents;
-}
+
+	phase_timer(const phase_timer &) = delete;
+	phase_timer & operator=(const phase_timer &) = delete;
+
+private:
+	const std::string name_;
+	const std::chrono::steady_clock::time_point start_;
+};
 
 /// Collects information from the node into the container.
 template <class Container> static void collect(const YAML::Node & node, Container & c)
@@ -118,13 +213,17 @@ static void collect(const YAML::Node & node, std::string & s)
 
 /// Read meta data from the specified file.
 ///
-/// Meta data is in YAML within the header of the markdown file.
+/// Meta data is in YAML within the header of the markdown file. Common headers
+/// are parsed directly, see `parse_front_matter`, all others by the YAML parser.
 static meta_info read_meta(const std::string & path)
 {
-	const auto txt = read_meta_string_from_markdown(path);
-	const auto doc = YAML::Load(txt);
+	const auto txt = read_front_matter(path);
 
 	meta_info info;
+	if (parse_front_matter(txt, info))
+		return info;
+
+	const auto doc = YAML::Load(txt);
 
 	if (!doc["title"])
 		throw std::runtime_error{"essential information missing: 'title'"};
@@ -147,7 +246,13 @@ static meta_info read_meta(const std::string & path)
 
 /// Collects information recursively down the directory tree for each file.
 ///
-/// Meta data is collected into the global data.
+/// Meta data is collected into the global data. Meta data of files unchanged
+/// since the last run is taken from the persistent index, only changed files
+/// are read.
+///
+/// Files are read on as many threads as configured. Their meta data is merged
+/// into the global data in the order of the directory traversal, the result
+/// is the same as reading them one after another.
 static void collect_information(const std::string & source_root_directory)
 {
 	const fs::path source_path{source_root_directory};
@@ -155,29 +260,86 @@ static void collect_information(const std::string & source_root_directory)
 	if (!fs::exists(source_path) || !fs::is_directory(source_path))
 		return;
 
-	for (auto it = fs::recursive_directory_iterator{source_path};
-		 it != fs::recursive_directory_iterator{}; ++it) {
+	// only documents to be processed have meta data, everything else is not even read
+	const auto filetypes = system::cfg().get_source_process_filetypes();
+	auto is_document = [&filetypes](const fs::path & path) {
+		return std::find(begin(filetypes), end(filetypes), path.extension().string())
+			!= end(filetypes);
+	};
+
+	// entries are checked to be regular files later, concurrently
+	std::vector<meta_index::entry> entries;
+	for (const auto & entry : fs::recursive_directory_iterator{source_path}) {
+		if (is_document(entry.path()))
+			entries.push_back({entry.path().string(), {}, {}});
+	}
 
-		if (!fs::is_regular_file(it->path()))
-			continue;
+	const auto index_filename = global.state_directory + "/meta.idx";
+	std::vector<char> valid(entries.size(), 0);
+	std::atomic<std::size_t> num_changed{0};
+	{
+		const meta_index index{index_filename};
+
+		auto collect_range = [&](std::size_t first, std::size_t last) {
+			for (auto i = first; i < last; ++i) {
+				auto & entry = entries[i];
+				if (!meta_index::status(entry.path, entry.status))
+					continue;
+				valid[i] = 1;
+
+				if (index.find(entry.path, entry.status, entry.meta))
+					continue;
+				++num_changed;
+				const trace_span span{global.profile.get(), entry.path, "meta"};
+				try {
+					entry.meta = read_meta(entry.path);
+				} catch (...) {
+					// no relevant meta data found for file, there is nothing to be done
+				}
+			}
+		};
 
-		try {
-			const auto path = it->path().string();
-			const auto info = read_meta(path);
+		static const std::size_t chunk_size = 64;
+		const auto num_chunks = (entries.size() + chunk_size - 1) / chunk_size;
+		if ((global.jobs < 2) || (num_chunks < 2)) {
+			collect_range(0, entries.size());
+		} else {
+			worker_pool pool{std::min(global.jobs, num_chunks)};
+			for (std::size_t first = 0; first < entries.size(); first += chunk_size) {
+				const auto last = std::min(first + chunk_size, entries.size());
+				pool.submit([&collect_range, first, last] { collect_range(first, last); });
+			}
+			pool.wait();
+		}
+
+		// drop everything not being a regular file
+		std::size_t n = 0;
+		for (std::size_t i = 0; i < entries.size(); ++i) {
+			if (!valid[i])
+				continue;
+			if (n != i)
+				entries[n] = std::move(entries[i]);
+			++n;
+		}
+		entries.resize(n);
+
+		for (const auto & entry : entries) {
+			if (!entry.meta)
+				continue;
+
+			const auto & info = *entry.meta;
 
-			global.meta[path] = info;
+			global.docs.add(entry.path, info);
 			for (const auto & plugin : info.plugins)
 				global.plugins.insert(plugin);
-			for (const auto & tag : info.tags)
-				global.tags[tag].push_back(path);
-			global.years[fmt::sprintf("%04u", info.date.year())].push_back(path);
-			global.dates[info.date].push_back(path);
-
-		} catch (...) {
-			// no relevant meta data found for file, there is nothing to be done
-			continue;
 		}
+
+		// files removed since the last run are no longer part of the index
+		if ((num_changed == 0) && (entries.size() == index.size()))
+			return;
 	}
+
+	meta_index::write(index_filename, std::move(entries));
 }
 
 /// Splits specified path into its parts.
@@ -202,24 +364,108 @@ template <typename Iterator> static std::string join_path(Iterator begin, Iterat
 /// Replaces the root of links with the configured one.
 static std::string replace_root(const std::string & link)
 {
-	auto parts = split_path(link);
-
-	if (parts.size() < 2)
-		return link;
-
-	const auto path_map = system::cfg().get_path_map();
-	const auto entry = std::find_if(
-		begin(path_map), end(path_map), [&](const auto & a) { return a.base == parts[0]; });
+	return global.resolver.resolve(link);
+}
 
-	if (entry == end(path_map))
-		return link;
+/// Returns the string as Lua string literal.
+static std::string lua_quote(const std::string & s)
+{
+	std::string result = "\"";
+	for (const unsigned char c : s) {
+		if ((c == '"') || (c == '\\')) {
+			result += '\\';
+			result += c;
+		} else if ((c < 0x20) || (c == 0x7f)) {
+			result += fmt::sprintf("\\%03u", c);
+		} else {
+			result += c;
+		}
+	}
+	return result + '"';
+}
 
-	if (entry->absolute) {
-		parts[0] = entry->url;
-	} else {
-		parts[0] = system::cfg().get_site_url() + entry->url;
+/// Writes a pandoc Lua filter, rewriting links the same way as `replace_root`,
+/// including the decomposition of paths into parts by the filesystem library.
+///
+/// Like `fix_links_recursive`, the contents of links and images are not traversed.
+/// This requires pandoc 2.17 or newer.
+static void write_link_filter(const std::string & filename)
+{
+	std::ofstream ofs{filename.c_str()};
+
+	ofs << "-- generated by mkweb, rewrites links according to the configured path map\n"
+		   "traverse = 'topdown'\n"
+		   "\n"
+		   "local path_map = {\n";
+	const auto & site_url = system::cfg().get_site_url();
+	std::unordered_set<std::string> bases;
+	for (const auto & entry : system::cfg().get_path_map()) {
+		if (!bases.insert(entry.base).second)
+			continue; // first entry wins
+		ofs << "\t[" << lua_quote(entry.base)
+			<< "] = " << lua_quote(entry.absolute ? entry.url : site_url + entry.url)
+			<< ",\n";
 	}
-	return join_path(parts.begin(), parts.end());
+	ofs << "}\n";
+
+	ofs << R"(
+local function split_path(s)
+	local parts = {}
+	local pos = 1
+	if s:sub(1, 2) == '//' and s:sub(3, 3) ~= '' and s:sub(3, 3) ~= '/' then
+		local e = s:find('/', 3, true) or (#s + 1)
+		parts[#parts + 1] = s:sub(1, e - 1)
+		pos = e
+	end
+	if s:sub(pos, pos) == '/' then
+		parts[#parts + 1] = '/'
+		while s:sub(pos, pos) == '/' do pos = pos + 1 end
+	end
+	while pos <= #s do
+		local e = s:find('/', pos, true)
+		if not e then
+			parts[#parts + 1] = s:sub(pos)
+			break
+		end
+		parts[#parts + 1] = s:sub(pos, e - 1)
+		pos = e
+		while s:sub(pos, pos) == '/' do pos = pos + 1 end
+		if pos > #s then parts[#parts + 1] = '.' end
+	end
+	return parts
+end
+
+local function join_path(parts)
+	local p = ''
+	for _, x in ipairs(parts) do
+		if p == '' or x:sub(1, 1) == '/' or p:sub(-1) == '/' then
+			p = p .. x
+		else
+			p = p .. '/' .. x
+		end
+	end
+	return p
+end
+
+local function replace_root(link)
+	local parts = split_path(link)
+	if #parts < 2 then return link end
+	local url = path_map[parts[1]]
+	if url == nil then return link end
+	parts[1] = url
+	return join_path(parts)
+end
+
+function Link(el)
+	el.target = replace_root(el.target)
+	return el, false
+end
+
+function Image(el)
+	el.src = replace_root(el.src)
+	return el, false
+end
+)";
 }
 
 /// Prepares the tag list as a string containing HTML.
@@ -244,32 +490,31 @@ static std::string prepare_tag_list(std::vector<std::string> tags)
 }
 
 /// Returns a string representing the global tag list in HTML.
-static std::string prepare_global_tag_list(
-	const std::unordered_map<std::string, std::vector<std::string>> & tags)
+static std::string prepare_global_tag_list()
 {
 	std::vector<std::string> ids;
-	ids.reserve(tags.size());
-	for (const auto & tag : tags)
-		ids.push_back(tag.first);
+	ids.reserve(global.docs.num_tags());
+	for (document_store::id tag = 0; tag < global.docs.num_tags(); ++tag)
+		ids.push_back(global.docs.tag(tag));
 	return prepare_tag_list(ids);
 }
 
+/// Returns the name of the year, as used for its overview page.
+static std::string year_name(std::uint32_t year)
+{
+	return fmt::sprintf("%04u", year);
+}
+
 /// Returns a string containing links to year overview pages.
-static std::string prepare_global_year_list(
-	const std::unordered_map<std::string, std::vector<std::string>> & years)
+static std::string prepare_global_year_list()
 {
 	const auto site_url = system::cfg().get_site_url();
-
-	std::vector<std::string> ids;
-	ids.reserve(years.size());
-	for (const auto & year : years)
-		ids.push_back(year.first);
-
-	std::sort(rbegin(ids), rend(ids));
+	const auto & years = global.docs.years();
 
 	std::ostringstream os;
 	os << "<br>";
-	for (const auto year : ids) {
+	for (auto i = years.rbegin(); i != years.rend(); ++i) {
+		const auto year = year_name(i->first);
 		os << "<a href=\"" << site_url << "year/" << year << ".html\">" << year << "</a>";
 		os << ' ';
 	}
@@ -302,60 +547,31 @@ static std::string convert_path(const std::string & fn)
 	return std::string{};
 }
 
-/// Sorts the specified container of IDs according to the sort criteria
-/// defined by the sort description.
-///
-/// \param[in,out] ids The container to be sorted.
-/// \param[in] desc Sort description.
-///
-static void sort(std::vector<std::pair<std::string, std::string>> & ids,
-	const config::sort_description & desc)
+/// Returns the URL of a document with meta data.
+static const std::string & url_of(document_store::id doc)
 {
-	switch (desc.dir) {
-		case config::sort_direction::ascending:
-			std::sort(begin(ids), end(ids),
-				[](const auto & a, const auto & b) { return a.first < b.first; });
-			break;
-		case config::sort_direction::descending:
-			std::sort(begin(ids), end(ids),
-				[](const auto & a, const auto & b) { return a.first > b.first; });
-			break;
-	}
+	return global.urls[doc];
 }
 
-/// Returns a container, IDs sorted according to the specified criteria.
+/// Returns all documents, sorted according to the specified criteria.
 ///
-/// \param[in] meta Meta information about pages.
 /// \param[in] sort_desc Sorting criteria.
-/// \return Container of sorted IDs.
+/// \return Identifiers of the documents, sorted.
 ///
-static auto sorted_ids_of_global_pagelist(
-	const std::unordered_map<std::string, meta_info> & meta,
+static std::vector<document_store::id> sorted_ids_of_global_pagelist(
 	const config::sort_description & sort_desc)
 {
-	// extract sorting criteria, build map key->filename
-	std::vector<std::pair<std::string, std::string>> ids;
-	if (sort_desc.key == "date") {
-		for (const auto & fn : meta) {
-			ids.push_back(std::make_pair(fn.second.date.str(), fn.first));
-		}
-	} else if (sort_desc.key == "title") {
-		for (const auto & fn : meta) {
-			ids.push_back(std::make_pair(fn.second.title, fn.first));
-		}
-	} else {
-		throw std::runtime_error{"sort key not supported: " + sort_desc.key};
-	}
-
-	sort(ids, sort_desc);
-	return ids;
+	const auto descending = sort_desc.dir == config::sort_direction::descending;
+	if (sort_desc.key == "date")
+		return global.docs.sorted(document_store::sort_key::date, descending);
+	if (sort_desc.key == "title")
+		return global.docs.sorted(document_store::sort_key::title, descending);
+	throw std::runtime_error{"sort key not supported: " + sort_desc.key};
 }
 
-/// Returns a string (HTML) with a list of all pages, created from the
-/// specified meta information. The list will be sorted according to the
-/// configuration.
-static std::string prepare_global_pagelist(
-	const std::unordered_map<std::string, meta_info> & meta)
+/// Returns a string (HTML) with a list of all pages. The list will be sorted
+/// according to the configuration.
+static std::string prepare_global_pagelist()
 {
 	// generate HTML list of sorted entries
 	const auto site_url = system::cfg().get_site_url();
@@ -364,19 +580,16 @@ static std::string prepare_global_pagelist(
 
 	auto count = 0;
 
-	const auto ids = sorted_ids_of_global_pagelist(meta, sort_desc);
+	const auto ids = sorted_ids_of_global_pagelist(sort_desc);
 
 	std::ostringstream os;
 	os << "<ul>";
-	for (const auto & entry : ids) {
+	for (const auto doc : ids) {
 		if ((num_entries != 0) && (count >= num_entries))
 			break;
 		++count;
 
-		const auto filename = entry.second;
-		const auto title = meta.find(filename)->second.title; // single-thread, still valid
-		const auto url = replace_root(convert_path(filename));
-		os << "<li><a href=\"" << url << "\">" << title << "</a></li>";
+		os << "<li><a href=\"" << url_of(doc) << "\">" << global.docs[doc].title << "</a></li>";
 	}
 	os << "</ul>";
 
@@ -393,38 +606,14 @@ static std::string prepare_global_pagelist(
 /// The list will be sorted according to the configuration.
 static std::string prepare_page_tag_list(const std::string & filename_in)
 {
-	const auto meta = get_meta_for_source(filename_in);
-	if (!meta)
+	const auto doc = global.docs.find(filename_in);
+	if (!doc)
 		return std::string{};
-	return prepare_tag_list(meta->tags);
-}
-
-/// Finds out if a conversion of a specific document is necessary or not.
-///
-/// \param[in] filename_in Source document.
-/// \param[in] filename_out Destination filename.
-///
-static bool conversion_necessary(
-	const std::string & filename_in, const std::string & filename_out)
-{
-	if (!fs::exists(filename_in))
-		return false;
-	if (!fs::exists(filename_out))
-		return true;
 
-	const auto mtime_out = fs::last_write_time(filename_out);
-	if (mtime_out < fs::last_write_time(filename_in))
-		return true;
-
-	const auto th = system::get_theme();
-	if (mtime_out < fs::last_write_time(th.get_template()))
-		return true;
-	if (!th.get_style().empty() && (mtime_out < fs::last_write_time(th.get_style())))
-		return true;
-	if (!th.get_footer().empty() && (mtime_out < fs::last_write_time(th.get_footer())))
-		return true;
-
-	return false;
+	std::vector<std::string> tags;
+	for (const auto tag : global.docs[*doc].tags)
+		tags.push_back(global.docs.tag(tag));
+	return prepare_tag_list(tags);
 }
 
 /// Makes sure the entire path specified by the filename/filepath
@@ -440,45 +629,178 @@ static bool ensure_path_for_file(const std::string & filename)
 	return fs::create_directories(path);
 }
 
-/// Reads and returns JSON representation (generated by pandoc) of the specified
-/// document.
-static std::string read_json_str_from_document(const std::string & path)
+/// Reads and returns the contents of the specified file. If the file does not
+/// exist, the default value will be returned.
+///
+/// \param[in] filename Filename of the file to read.
+/// \param[in] default_value Value to be returned if the file does not exist.
+static std::string read_file_contents(
+	const std::string & filename, const std::string & default_value)
 {
-	utils::subprocess p{{system::pandoc(), "-t", "json", path}};
+	if (!fs::exists(filename)) {
+		return default_value;
+	}
 	std::ostringstream os;
-
-	p.exec();
-	p.out() >> std::noskipws;
-	std::copy(std::istream_iterator<char>{p.out()}, std::istream_iterator<char>{},
-		std::ostream_iterator<char>{os});
-	p.wait();
+	std::ifstream ifs{filename.c_str()};
+	os << ifs.rdbuf();
 	return os.str();
 }
 
-/// Uses pandoc to write the destination document using the JSON data.
+/// Creates a uniquely named directory for temporary files.
+static std::string create_temp_directory()
+{
+	std::string path = (fs::temp_directory_path() / "mkwebtmp-XXXXXX").string();
+	if (::mkdtemp(&path[0]) == nullptr)
+		throw std::runtime_error{"Unable to create temporary directory"};
+	return path;
+}
+
+/// A temporary directory, removed including all its contents on destruction.
+class temp_directory
+{
+public:
+	temp_directory()
+		: path_(create_temp_directory())
+	{
+	}
+
+	~temp_directory() { fs::remove_all(path_); }
+
+	temp_directory(const temp_directory &) = delete;
+	temp_directory & operator=(const temp_directory &) = delete;
+
+	const std::string & path() const { return path_; }
+
+private:
+	const std::string path_;
+};
+
+/// Marks the end of a document if multiple documents are read by one pandoc process.
+static const std::string batch_marker = "<!-- mkweb-batch-end -->";
+
+/// Returns the metadata key under which the front matter of the batched document
+/// with the specified index is kept.
+static std::string batch_meta_key(std::size_t index)
+{
+	return "mkweb-batch-" + std::to_string(index);
+}
+
+/// Prepares a markdown document to be read together with others by one pandoc process.
 ///
-/// \param[in] params Parameters to execute pandoc.
-/// \param[in] content JSON data for pandoc to render into the destination
-///   document.
-/// \return `true` if successful, `false` otherwise.
+/// The YAML front matter is moved into a map with the specified key, keeping the
+/// metadata of the documents apart (pandoc merges all metadata blocks). The end of
+/// the document is marked with a raw HTML block.
+static std::string prepare_batch_document(const std::string & content, const std::string & key)
+{
+	const auto next_line = [&](std::string::size_type & pos) {
+		const auto end = content.find('\n', pos);
+		const auto line = content.substr(pos, end - pos);
+		pos = (end == std::string::npos) ? content.size() : end + 1;
+		return line;
+	};
+
+	const auto marked = [](const std::string & s) { return s + "\n\n" + batch_marker + '\n'; };
+
+	std::string::size_type pos = 0;
+	if (next_line(pos) != "---")
+		return marked(content);
+
+	std::vector<std::string> yaml;
+	bool closed = false;
+	bool empty = true;
+	while (pos < content.size()) {
+		const auto line = next_line(pos);
+		if ((line == "---") || (line == "...")) {
+			closed = true;
+			break;
+		}
+		if (line.find_first_not_of(" \t") != std::string::npos)
+			empty = false;
+		yaml.push_back(line);
+	}
+	if (!closed || empty)
+		return marked(content);
+
+	std::string result = "---\n" + key + ":\n";
+	for (const auto & line : yaml)
+		result += "  " + line + '\n';
+	result += "---\n";
+	return marked(result + content.substr(pos));
+}
+
+/// Prepares reading several markdown documents using a single pandoc process,
+/// the documents are written to the temporary directory.
 ///
-static bool write_document_from_json(
-	const std::vector<std::string> & params, const std::string & content)
+/// \param[in] sources Contents of the documents to read.
+/// \param[in] tmp The temporary directory.
+/// \return Parameters to execute pandoc.
+///
+static std::vector<std::string> prepare_batch_read(
+	const std::vector<std::string> & sources, const std::string & tmp)
 {
-	utils::subprocess p{params};
-	std::ostringstream os;
+	std::vector<std::string> params = {system::pandoc(), "--file-scope", "-t", "json"};
+	for (std::size_t i = 0; i < sources.size(); ++i) {
+		const auto fn = tmp + '/' + std::to_string(i) + ".md";
+		std::ofstream ofs{fn.c_str()};
+		ofs << prepare_batch_document(sources[i], batch_meta_key(i));
+		params.push_back(fn);
+	}
+	return params;
+}
 
-	p.exec();
+/// Separates the JSON representation of several markdown documents, read by
+/// a single pandoc process, see `prepare_batch_read`.
+///
+/// \param[in] output The JSON representation written by pandoc.
+/// \param[in] num_documents Number of documents read.
+/// \return The JSON documents in the order they were read, or an empty
+///   container if the documents could not be separated reliably. In this case
+///   they have to be read one by one.
+///
+static std::vector<nlohmann::json> split_batch(const std::string & output, std::size_t num_documents)
+{
+	auto data = nlohmann::json::parse(output, nullptr, false);
+	if (!data.is_object())
+		return {};
+
+	const auto & meta = data["meta"];
+	if (!meta.is_object() || !data["blocks"].is_array())
+		return {};
+
+	// metadata outside of the front matters cannot be associated with a document
+	for (const auto & entry : meta.items()) {
+		if (entry.key().compare(0, 12, "mkweb-batch-") != 0)
+			return {};
+	}
 
-	p.in() << content;
-	p.close_in();
+	std::vector<nlohmann::json> docs;
+	docs.reserve(num_documents);
+	for (std::size_t i = 0; i < num_documents; ++i) {
+		const auto m = meta.find(batch_meta_key(i));
+		nlohmann::json doc = {{"pandoc-api-version", data["pandoc-api-version"]},
+			{"meta", ((m != meta.end()) && ((*m)["c"].is_object())) ? (*m)["c"]
+																	 : nlohmann::json::object()},
+			{"blocks", nlohmann::json::array()}};
+		docs.push_back(std::move(doc));
+	}
 
-	p.err() >> std::noskipws;
-	std::copy(std::istream_iterator<char>{p.err()}, std::istream_iterator<char>{},
-		std::ostream_iterator<char>{os});
-	auto rc = p.wait();
+	std::size_t index = 0;
+	for (auto & block : data["blocks"]) {
+		const bool is_marker = (block["t"] == "RawBlock") && block["c"].is_array()
+			&& (block["c"].size() == 2) && block["c"][1].is_string()
+			&& (block["c"][1].get<std::string>().find(batch_marker) == 0);
+		if (is_marker) {
+			++index;
+			continue;
+		}
+		if (index >= docs.size())
+			return {};
+		docs[index]["blocks"].push_back(std::move(block));
+	}
+	if (index != docs.size())
+		return {};
 
-	return (rc == 0) && (os.tellp() == 0);
+	return docs;
 }
 
 /// Processes a link within the JSON node. Links need to point to the
@@ -541,66 +863,90 @@ static void append(Container & v, std::initializer_list<typename Container::valu
 		v.push_back(item);
 }
 
-/// Returns a string (HTML) to include a JavaScript script on the destination document.
-///
-/// \param[in] plugin The name of the plugin.
-/// \param[in] filename The filename (from the plugin) to load.
-///
-static std::string make_plugin_script_string(
-	const std::string & plugin, const std::string & filename)
+/// Returns the fingerprint of a theme or plugin file. The file is examined
+/// at its first use within a build, all documents share the result.
+static shared_file & get_shared_file(const std::string & path)
 {
-	return "<script type=\"text/javascript\" src=\"" + system::cfg().get_plugin_url(plugin)
-		+ filename + "\"></script>";
+	auto i = global.shared_files.find(path);
+	if (i == global.shared_files.end()) {
+		shared_file file{dependencies::status_of(path), {}};
+		i = global.shared_files.emplace(path, std::move(file)).first;
+	}
+	return i->second;
 }
 
-/// Creates a string for the HTML head section to load the necessary files for
-/// the specified plugin.
-///
-/// \param[in] plugin The plugin's name.
-/// \return HTML string.
+/// Forgets about theme and plugin files, they are examined again by the next build.
+static void forget_shared_files()
+{
+	global.shared_files.clear();
+	global.registry.clear();
+	global.page_template.reset();
+}
+
+/// Everything needed to render a document, prepared in advance.
 ///
-static std::string create_header_for_plugin(const std::string & plugin)
+/// Documents generated by mkweb (overviews, front page, sitemap) exist in
+/// memory only, they are passed to pandoc through its standard input. Their
+/// `filename_in` names them, there is no such file.
+struct render_job {
+	std::string filename_in;
+	std::string filename_out;
+	std::experimental::optional<std::string> source; ///< contents of a generated document
+	std::vector<std::string> params;
+	dependencies::record deps;
+	std::string reason;
+	std::string cache_key;
+};
+
+/// Returns the parameters for pandoc to read the source of the job into JSON.
+static std::vector<std::string> prepare_read_params(const render_job & job)
 {
-	std::ostringstream os;
-	auto cfg = YAML::LoadFile(system::get_plugin(plugin).get_config());
-	if (cfg["include"]) {
-		for (const auto & entry : cfg["include"]) {
-			os << make_plugin_script_string(plugin, entry.as<std::string>());
-		}
+	if (job.source)
+		return {system::pandoc(), "-f", "markdown", "-t", "json"};
+	return {system::pandoc(), "-t", "json", job.filename_in};
+}
+
+/// Removes defaults files of former builds from the state directory, see
+/// `prepare_shared_params`. The sidebar changes with every title or tag, each
+/// change leaves a file behind. Files used within the last hour are kept for
+/// builds which may still be running, as well as the file in use.
+static void prune_defaults_files(const std::string & current)
+{
+	const auto limit = fs::file_time_type::clock::now() - std::chrono::hours{1};
+
+	std::error_code ec;
+	for (const auto & entry : fs::directory_iterator{global.state_directory, ec}) {
+		const auto name = entry.path().filename().string();
+		if ((name.compare(0, 16, "pandoc-defaults-") != 0) || (entry.path() == current))
+			continue;
+		const auto mtime = fs::last_write_time(entry.path(), ec);
+		if (!ec && (mtime < limit))
+			fs::remove(entry.path(), ec);
 	}
-	return os.str();
 }
 
-/// Prepares parameters for pandoc to generate the destination document.
+/// Prepares the parameters for pandoc which are the same for all documents,
+/// site information and sidebar fragments, after the site has been collected.
 ///
-/// \param[in] filename_in The source filename.
-/// \param[in] filename_out The destination filename.
-/// \param[in] tags_list Tags list for the page.
-static std::vector<std::string> prepare_pandoc_params(const std::string & filename_in,
-	const std::string & filename_out, const std::string & tags_list)
+/// The sidebar fragments grow with the site, with many tags they take hundreds
+/// of kilobytes. If pandoc supports defaults files (2.8 and newer), the
+/// parameters are written to one in the state directory, passed by reference
+/// instead of being copied into the arguments of every process.
+///
+/// The file is named after the hash of its contents and never modified once
+/// written, pandoc processes of concurrent builds (e.g. watch mode and a build
+/// server) read exactly the parameters recorded for their documents. Files of
+/// former builds are removed after a while.
+static void prepare_shared_params()
 {
-	const auto th = system::get_theme();
-
 	// clang-format off
 	std::vector<std::string> params {
-		system::pandoc(),
-		"-f", "json",
-		"-t", "html5",
-		"-o", filename_out,
-		"-H", th.get_style(),
 		"-M", "title-prefix=" + system::cfg().get_site_title(),
 		"-V", "siteurl=" + system::cfg().get_site_url(),
 		"-V", "sitetitle=" + system::cfg().get_site_title(),
-		"--template", th.get_template(),
-		"--standalone",
-		"--preserve-tabs",
-		"--toc", "--toc-depth=2",
-		"--mathml"
 	};
 	// clang-format on
 
-	if (!th.get_footer().empty())
-		append(params, {"-A", th.get_footer()});
 	if (!system::cfg().get_site_subtitle().empty())
 		append(params, {"-V", "sitesubtitle=" + system::cfg().get_site_subtitle()});
 	if (system::cfg().get_tags_enable())
@@ -611,19 +957,9 @@ static std::vector<std::string> prepare_pandoc_params(const std::string & filena
 		append(params, {"-V", "social=" + system::cfg().get_social()});
 	if (system::cfg().get_menu_enable())
 		append(params, {"-V", "menu=" + system::cfg().get_menu()});
-	if (system::cfg().get_page_tags_enable() && !tags_list.empty())
-		append(params, {"-V", "pagetags=" + tags_list});
 	if (system::cfg().get_pagelist().enable && !global.page_list.empty())
 		append(params, {"-V", "globalpagelist=" + global.page_list});
 
-	const auto meta = get_meta_for_source(filename_in);
-	if (meta) {
-		for (const auto & plugin : meta->plugins) {
-			append(params, {"-H", system::get_plugin(plugin).get_style()});
-			append(params, {"-V", "header-string=" + create_header_for_plugin(plugin)});
-		}
-	}
-
 	// theme specific stuff
 	if (!system::cfg().get_theme().site_title_background.empty())
 		append(params,
@@ -631,65 +967,871 @@ static std::vector<std::string> prepare_pandoc_params(const std::string & filena
 	if (!system::cfg().get_theme().copyright.empty())
 		append(params, {"-V", "copyright=" + system::cfg().get_theme().copyright});
 
-	return params;
+	// recorded and hashed once, instead of for every document
+	global.shared_record = {};
+	sha256 h;
+	auto variables = nlohmann::json::object();
+	auto metadata = nlohmann::json::object();
+	for (std::size_t i = 0; (i + 1) < params.size(); i += 2) {
+		const auto & arg = params[i + 1];
+		const auto pos = arg.find('=');
+		const auto name = arg.substr(0, pos);
+		const auto value = arg.substr(pos + 1);
+		global.shared_record.add_value(params[i] + ' ' + name, value);
+		h.update(params[i]);
+		h.update("", 1);
+		h.update(arg);
+		h.update("", 1);
+		((params[i] == "-V") ? variables : metadata)[name] = value;
+	}
+	global.shared_params = std::move(params);
+	global.shared_params_hash = h.str();
+
+	global.defaults_file.clear();
+	if (!system::pandoc_version_at_least(2, 8))
+		return;
+
+	const auto filename
+		= global.state_directory + "/pandoc-defaults-" + global.shared_params_hash + ".yaml";
+	if (!fs::exists(filename)) {
+		// write and rename, a reader never sees a partially written file
+		const auto tmp = filename + ".tmp." + std::to_string(::getpid());
+		fs::create_directories(global.state_directory);
+		{
+			// JSON is a subset of YAML, strings are escaped properly
+			std::ofstream ofs{tmp.c_str()};
+			ofs << nlohmann::json{{"variables", variables}, {"metadata", metadata}}.dump()
+				<< '\n';
+			if (!ofs)
+				throw std::runtime_error{"unable to write file: " + tmp};
+		}
+		fs::rename(tmp, filename);
+	} else {
+		// in use again, not to be pruned by concurrent builds
+		std::error_code ec;
+		fs::last_write_time(filename, fs::file_time_type::clock::now(), ec);
+	}
+	global.defaults_file = filename;
+	prune_defaults_files(filename);
 }
 
-/// Processes a document.
+/// Prepares parameters for pandoc to generate the destination document.
 ///
-/// \param[in] filename_in Filename of the source document.
-/// \param[in] filename_out Filename of the destinatino document.
-/// \param[in] tags_list List of tags for the document.
-static void process_document(const std::string & filename_in, const std::string & filename_out,
-	const std::string & tags_list = std::string{})
+/// \param[in] job The document, source and destination.
+/// \param[in] tags_list Tags list for the page.
+static std::vector<std::string> prepare_pandoc_params(
+	const render_job & job, const std::string & tags_list)
 {
-	if (!conversion_necessary(filename_in, filename_out)) {
-		std::cout << "skip    " << filename_out << '\n';
-		return;
+	const auto & filename_in = job.filename_in;
+	const auto & filename_out = job.filename_out;
+
+	const auto & th = system::get_theme();
+
+	// clang-format off
+	std::vector<std::string> params {
+		system::pandoc(),
+		"-t", "html5",
+		"-o", filename_out,
+		"-H", th.get_style(),
+		"--template", th.get_template(),
+		"--standalone",
+		"--toc", "--toc-depth=2",
+		"--mathml"
+	};
+	// clang-format on
+
+	switch (global.mode) {
+		case render_mode::two_pass:
+			append(params, {"-f", "json", "--preserve-tabs"});
+			break;
+		case render_mode::single_pass:
+			// '--preserve-tabs' would affect reading of the source, which it does
+			// not with two passes, therefore omitted to get the same result.
+			append(params, {"--lua-filter", global.link_filter});
+			if (job.source) {
+				append(params, {"-f", "markdown"});
+			} else {
+				params.push_back(filename_in);
+			}
+			break;
 	}
 
-	std::cout << "        " << filename_out << '\n';
-	ensure_path_for_file(filename_out);
+	if (!th.get_footer().empty())
+		append(params, {"-A", th.get_footer()});
+	if (global.defaults_file.empty()) {
+		params.insert(end(params), begin(global.shared_params), end(global.shared_params));
+	} else {
+		append(params, {"-d", global.defaults_file});
+	}
+	if (system::cfg().get_page_tags_enable() && !tags_list.empty())
+		append(params, {"-V", "pagetags=" + tags_list});
 
-	// conversion from source file to JSON and processing
-	auto content = nlohmann::json::parse(read_json_str_from_document(filename_in));
-	fix_links_recursive(content);
+	const auto doc = global.docs.find(filename_in);
+	if (doc) {
+		for (const auto id : global.docs[*doc].plugins) {
+			const auto & plugin = global.registry.get(global.docs.plugin(id));
+			append(params, {"-H", plugin.style});
+			append(params, {"-V", "header-string=" + plugin.header});
+		}
+	}
 
-	// perform final conversion to HTML
-	const auto params = prepare_pandoc_params(filename_in, filename_out, tags_list);
-	const auto success = write_document_from_json(params, content.dump());
-	if (!success)
-		throw std::runtime_error{"unable to write file: " + filename_out};
+	return params;
 }
 
-/// Processes a single document.
+/// Returns `true` if the document is rendered in-process, see `render_builtin`.
+static bool renders_builtin(const render_job & job)
+{
+	const auto & renderer = system::cfg().get_renderer();
+	return renderer.builtin
+		&& contains(fs::path{job.filename_in}.extension().string(), renderer.filetypes);
+}
+
+/// Returns the inputs of a destination document, derived from the parameters
+/// for pandoc: files passed to pandoc and values of variables and metadata
+/// (configuration, sidebar fragments). Everything else which influences the
+/// result is recorded as well.
 ///
-/// \param[in] source_directory Source directory in which the source
-///   document is to be found.
-/// \param[in] destination_directory The directory in which the destination
-///   document will be created.
-/// \param[in] filename_in The filename of the document to process.
+/// The source is recorded by its contents only, a generated document is
+/// recorded as value.
 ///
-static void process_single(const std::string & source_directory,
-	const std::string & destination_directory, const std::string & filename_in)
+/// \param[in] job The document, its parameters prepared by `prepare_pandoc_params`.
+static dependencies::record make_dependency_record(const render_job & job)
 {
-	auto filename_out = convert_path(filename_in);
+	const auto & filename_in = job.filename_in;
+	const auto & params = job.params;
 
-	if (!filename_out.empty()) {
-		filename_out = destination_directory + filename_out.substr(source_directory.size());
-		process_document(filename_in, filename_out, prepare_page_tag_list(filename_in));
+	dependencies::record r;
+	if (job.source) {
+		r.add_value("source", *job.source);
 	} else {
-		std::cout << "ignore: " << filename_in << '\n';
+		r.add_file(filename_in, "source");
+	}
+	r.add_value("pandoc", params.front() + ' ' + system::pandoc_version());
+
+	for (std::size_t i = 1; i < params.size(); ++i) {
+		const auto & param = params[i];
+		const auto has_arg = (i + 1) < params.size();
+		if (((param == "-H") || (param == "-A") || (param == "--template")) && has_arg) {
+			r.add_file(get_shared_file(params[++i]).status);
+		} else if (((param == "-V") || (param == "-M")) && has_arg) {
+			const auto & arg = params[++i];
+			const auto pos = arg.find('=');
+			r.add_value(param + ' ' + arg.substr(0, pos),
+				(pos == std::string::npos) ? std::string{} : arg.substr(pos + 1));
+		} else if ((param == "-d") && has_arg) {
+			++i; // generated, its parameters are recorded as if passed directly
+			r.values.insert(begin(global.shared_record.values), end(global.shared_record.values));
+		} else if (((param == "-o") || (param == "--lua-filter")) && has_arg) {
+			++i; // destination and generated filter, both not inputs
+		} else if (param != filename_in) {
+			r.add_value("options", param);
+		}
 	}
+
+	// links are rewritten according to the configuration
+	for (const auto & entry : system::cfg().get_path_map())
+		r.add_value("path_map", entry.base + ' ' + entry.url + (entry.absolute ? " 1" : " 0"));
+	r.add_value("site_url", system::cfg().get_site_url());
+	r.add_value("mode", std::to_string(static_cast<int>(global.mode)));
+	if (renders_builtin(job))
+		r.add_value("renderer", "builtin");
+
+	return r;
 }
 
-/// Returns `true` if the specified path is a subdirectory of the directory.
-///
-/// \param[in] path Path to check if it is a subdirectory.
-/// \param[in] directory Directory to check against.
+/// Returns the key of the document within the render cache: a hash over the
+/// contents of all input files and all parameters which influence the result.
 ///
-static bool is_subdir(const std::string & path, const std::string & directory)
+/// Paths of input files are not part of the key, the cache may be shared between
+/// machines. The extension of the source is, it determines how pandoc reads it.
+static std::string make_cache_key(const render_job & job)
 {
-	const auto p = fs::canonical(path);
+	sha256 h;
+	auto add = [&h](const std::string & s) {
+		h.update(s);
+		h.update("", 1);
+	};
+
+	add("mkweb-render-1");
+	add(system::pandoc_version());
+	add(fs::path{job.filename_in}.extension().string());
+	add(job.source ? sha256::str(*job.source) : global.cache->file_hash(job.filename_in));
+
+	const auto & params = job.params;
+	for (std::size_t i = 1; i < params.size(); ++i) {
+		const auto & param = params[i];
+		const auto has_arg = (i + 1) < params.size();
+		if (((param == "-H") || (param == "-A") || (param == "--template")
+				|| (param == "--lua-filter"))
+			&& has_arg) {
+			add(param);
+			auto & file = get_shared_file(params[++i]);
+			if (file.cache_hash.empty())
+				file.cache_hash = global.cache->file_hash(file.status.path);
+			add(file.cache_hash);
+		} else if ((param == "-d") && has_arg) {
+			++i;
+			add(param);
+			add(global.shared_params_hash);
+		} else if ((param == "-o") && has_arg) {
+			++i;
+		} else if (param != job.filename_in) {
+			add(param);
+		}
+	}
+
+	for (const auto & entry : system::cfg().get_path_map()) {
+		add(entry.base);
+		add(entry.url);
+		add(entry.absolute ? "1" : "0");
+	}
+	add(system::cfg().get_site_url());
+	add(std::to_string(static_cast<int>(global.mode)));
+	if (renders_builtin(job))
+		add("builtin");
+
+	return h.str();
+}
+
+/// Completes the job and appends it, if a conversion is necessary at all.
+///
+/// Everything depending on the configuration is resolved here, the rendering
+/// itself may then happen on any thread.
+///
+/// \param[in] job The document, source and destination.
+/// \param[in] tags_list List of tags for the document.
+/// \param[out] jobs Container to append the job to.
+static void prepare_job(
+	render_job && job, const std::string & tags_list, std::vector<render_job> & jobs)
+{
+	const auto & filename_out = job.filename_out;
+	job.params = prepare_pandoc_params(job, tags_list);
+	job.deps = make_dependency_record(job);
+	job.reason = global.deps->check(filename_out, job.deps);
+
+	if (job.reason.empty()) {
+		std::cout << "skip    " << filename_out << '\n';
+		++global.stats.pages_skipped;
+		return;
+	}
+	if (global.cache)
+		job.cache_key = make_cache_key(job);
+
+	ensure_path_for_file(filename_out);
+	jobs.push_back(std::move(job));
+}
+
+/// Prepares the rendering of a document, if a conversion is necessary at all.
+///
+/// \param[in] filename_in Filename of the source document.
+/// \param[in] filename_out Filename of the destinatino document.
+/// \param[in] tags_list List of tags for the document.
+/// \param[out] jobs Container to append the job to.
+static void prepare_document(const std::string & filename_in, const std::string & filename_out,
+	const std::string & tags_list, std::vector<render_job> & jobs)
+{
+	if (!fs::exists(filename_in))
+		return;
+
+	render_job job;
+	job.filename_in = filename_in;
+	job.filename_out = filename_out;
+	prepare_job(std::move(job), tags_list, jobs);
+}
+
+/// Prepares the rendering of a document generated in memory, if a conversion
+/// is necessary at all.
+///
+/// \param[in] name Name of the document, a markdown filename.
+/// \param[in] source Contents of the document, markdown.
+/// \param[in] filename_out Filename of the destination document.
+/// \param[out] jobs Container to append the job to.
+static void prepare_generated(const std::string & name, std::string source,
+	const std::string & filename_out, std::vector<render_job> & jobs)
+{
+	render_job job;
+	job.filename_in = name;
+	job.filename_out = filename_out;
+	job.source = std::move(source);
+	prepare_job(std::move(job), {}, jobs);
+}
+
+/// Returns the text with characters special to HTML escaped.
+static std::string escape_html(const std::string & s)
+{
+	std::string result;
+	result.reserve(s.size());
+	for (const auto c : s) {
+		switch (c) {
+			case '&':
+				result += "&amp;";
+				break;
+			case '<':
+				result += "&lt;";
+				break;
+			case '>':
+				result += "&gt;";
+				break;
+			case '"':
+				result += "&quot;";
+				break;
+			default:
+				result += c;
+				break;
+		}
+	}
+	return result;
+}
+
+/// Returns the contents of a file to include, without trailing line breaks.
+static std::string read_include(const std::string & filename)
+{
+	auto s = read_file_contents(filename, {});
+	while (!s.empty() && (s.back() == '\n'))
+		s.pop_back();
+	return s;
+}
+
+/// Returns the template of the theme, parsed once per build.
+static const doc_template & get_page_template(const std::string & filename)
+{
+	if (!global.page_template)
+		global.page_template = std::make_unique<doc_template>(read_file_contents(filename, {}));
+	return *global.page_template;
+}
+
+/// Returns the variables of the template pandoc would use with the parameters,
+/// see `prepare_pandoc_params`. Meta data from the command line is text.
+///
+/// \param[in] params Parameters for pandoc.
+/// \param[out] template_filename The template to fill.
+static doc_template::variables get_template_variables(
+	const std::vector<std::string> & params, std::string & template_filename)
+{
+	doc_template::variables vars;
+
+	// variables are inserted as they are, meta data is text
+	auto add = [&vars](const std::string & param, const std::string & arg) {
+		const auto pos = arg.find('=');
+		const auto value = (pos == std::string::npos) ? std::string{"true"} : arg.substr(pos + 1);
+		vars[arg.substr(0, pos)].push_back((param == "-V") ? value : escape_html(value));
+	};
+
+	for (std::size_t i = 1; i < params.size(); ++i) {
+		const auto & param = params[i];
+		const auto has_arg = (i + 1) < params.size();
+		if (((param == "-V") || (param == "-M")) && has_arg) {
+			add(param, params[++i]);
+		} else if ((param == "-d") && has_arg) {
+			++i;
+			const auto & shared = global.shared_params;
+			for (std::size_t k = 0; (k + 1) < shared.size(); k += 2)
+				add(shared[k], shared[k + 1]);
+		} else if ((param == "-H") && has_arg) {
+			vars["header-includes"].push_back(read_include(params[++i]));
+		} else if ((param == "-A") && has_arg) {
+			vars["include-after"].push_back(read_include(params[++i]));
+		} else if ((param == "--template") && has_arg) {
+			template_filename = params[++i];
+		} else if (((param == "-o") || (param == "-f") || (param == "-t")
+					   || (param == "--lua-filter"))
+			&& has_arg) {
+			++i;
+		}
+	}
+	return vars;
+}
+
+/// Adds the fields of the front matter to the variables of the template, the
+/// way pandoc does, including `pagetitle` and `author-meta` as plain text.
+///
+/// \param[in,out] vars Variables of the template.
+/// \param[in] front_matter Meta data, YAML.
+/// \param[in] render Renders a value into HTML, returns nothing if it cannot.
+/// \return `false` if a value is not supported.
+static bool add_meta_variables(doc_template::variables & vars, const std::string & front_matter,
+	const std::function<std::experimental::optional<std::string>(const std::string &)> & render)
+{
+	auto add = [&](std::vector<std::string> & values, const YAML::Node & node) {
+		const auto html = render(node.as<std::string>());
+		if (html)
+			values.push_back(*html);
+		return static_cast<bool>(html);
+	};
+
+	const auto meta = YAML::Load(front_matter);
+	if (meta.IsMap()) {
+		for (const auto & field : meta) {
+			auto & values = vars[field.first.as<std::string>()];
+			if (field.second.IsScalar()) {
+				if (!add(values, field.second))
+					return false;
+			} else if (field.second.IsSequence()) {
+				for (const auto & value : field.second) {
+					if (!value.IsScalar() || !add(values, value))
+						return false;
+				}
+			} else {
+				return false;
+			}
+		}
+	}
+
+	if (vars.count("title") && !vars.count("pagetitle")) {
+		for (const auto & title : vars["title"])
+			vars["pagetitle"].push_back(strip_tags(title));
+	}
+	const auto authors = vars.find("author");
+	if (authors != vars.end()) {
+		for (const auto & author : authors->second)
+			vars["author-meta"].push_back(strip_tags(author));
+	}
+	return true;
+}
+
+/// Splits a document into its front matter and the text, the way pandoc
+/// reads a YAML metadata block at the start of the document.
+///
+/// \return `false` if the front matter is not terminated.
+static bool split_front_matter(
+	const std::string & source, std::string & front_matter, std::string & text)
+{
+	if (source.compare(0, 4, "---\n") != 0) {
+		front_matter.clear();
+		text = source;
+		return true;
+	}
+
+	for (auto pos = source.find('\n'); pos != std::string::npos;
+		 pos = source.find('\n', pos + 1)) {
+		const auto line = source.substr(pos + 1, 4);
+		if ((line == "---\n") || (line == "...\n") || (line == "---") || (line == "...")) {
+			const auto end = std::min(pos + 5, source.size());
+			front_matter = source.substr(0, end);
+			text = source.substr(end);
+			return true;
+		}
+	}
+	return false;
+}
+
+/// Renders the document in-process, see `render_markdown`. The template of
+/// the theme is filled like for generated pages, see `render_native`.
+///
+/// \return The document, nothing if it is left to pandoc.
+static std::experimental::optional<std::string> render_builtin(const render_job & job)
+{
+	const auto source = job.source ? *job.source : read_file_contents(job.filename_in, {});
+
+	std::string front_matter;
+	std::string text;
+	if (!split_front_matter(source, front_matter, text))
+		return {};
+
+	bool toc = false;
+	int toc_depth = 3;
+	for (const auto & param : job.params) {
+		if (param == "--toc")
+			toc = true;
+		else if (param.compare(0, 12, "--toc-depth=") == 0)
+			toc_depth = std::stoi(param.substr(12));
+	}
+
+	const auto doc = render_markdown(text, replace_root, toc ? toc_depth : 0);
+	if (!doc)
+		return {};
+
+	std::string template_filename;
+	auto vars = get_template_variables(job.params, template_filename);
+	auto render_value
+		= [](const std::string & value) { return render_markdown_inline(value, replace_root); };
+	try {
+		if (!add_meta_variables(vars, front_matter, render_value))
+			return {};
+	} catch (const YAML::Exception &) {
+		return {};
+	}
+	if (!doc->toc.empty())
+		vars["toc"].push_back(doc->toc);
+	vars["body"].push_back(doc->body);
+
+	return get_page_template(template_filename).render(vars);
+}
+
+/// Returns `true` if pandoc succeeded: terminated normally, without writing errors.
+static bool succeeded(const process_executor::result & r)
+{
+	return (r.exit_code == 0) && r.errors.empty();
+}
+
+/// Returns `true` if the source of the job may be read together with other
+/// documents, see `prepare_batch_read`.
+static bool batchable(const render_job & job)
+{
+	if (global.mode != render_mode::two_pass)
+		return false;
+
+	const auto ext = fs::path{job.filename_in}.extension().string();
+	return (ext == ".md") || (ext == ".markdown");
+}
+
+/// Groups jobs into batches, each batch is read by one pandoc process.
+///
+/// Batches are kept small enough to give all workers something to do.
+static std::vector<std::vector<const render_job *>> make_batches(
+	const std::vector<const render_job *> & jobs)
+{
+	const auto num_batchable = std::count_if(
+		begin(jobs), end(jobs), [](const render_job * job) { return batchable(*job); });
+	const auto size = std::min(global.batch_size,
+		(static_cast<std::size_t>(num_batchable) + global.jobs - 1) / global.jobs);
+
+	std::vector<std::vector<const render_job *>> batches;
+	std::vector<const render_job *> batch;
+	for (const auto job : jobs) {
+		if ((size < 2) || !batchable(*job)) {
+			batches.push_back({job});
+			continue;
+		}
+		batch.push_back(job);
+		if (batch.size() >= size) {
+			batches.push_back(std::move(batch));
+			batch.clear();
+		}
+	}
+	if (!batch.empty())
+		batches.push_back(std::move(batch));
+	return batches;
+}
+
+/// Renders all specified documents, as many in parallel as configured.
+///
+/// Documents found in the render cache are restored instead.
+///
+/// All pandoc processes are driven by this thread, see `process_executor`. A
+/// document is read into JSON and written by two processes running at the same
+/// time, its links are rewritten as the JSON representation is streamed from one
+/// to the other. Completions of processes continue the rendering of their documents.
+///
+/// Errors do not stop the rendering of the remaining documents, they are
+/// collected and reported at the end.
+static void render_documents(const std::vector<render_job> & jobs)
+{
+	using result = process_executor::result;
+
+	std::vector<std::string> errors;
+
+	// documents are timed from the start of their first process to their
+	// completion, see `--stats` and `--profile`
+	const auto profile = global.profile.get();
+	std::vector<trace::clock::time_point> started(jobs.size());
+	std::vector<std::uint64_t> span_ids(jobs.size(), 0);
+	auto index = [&](const render_job & job) {
+		return static_cast<std::size_t>(&job - jobs.data());
+	};
+	auto begin_document = [&](const render_job & job, trace::clock::time_point t) {
+		const auto i = index(job);
+		if (started[i] != trace::clock::time_point{})
+			return;
+		started[i] = t;
+		if (profile)
+			span_ids[i] = profile->next_id();
+	};
+
+	std::vector<const render_job *> pending;
+	for (const auto & job : jobs) {
+		const trace_span span{global.cache ? profile : nullptr, job.filename_out, "cache"};
+		if (global.cache && global.cache->restore(job.cache_key, job.filename_out)) {
+			global.deps->update(job.filename_out, job.deps);
+			std::cout << "cached  " << job.filename_out << " (" << job.reason << ")\n";
+			++global.stats.pages_cached;
+			continue;
+		}
+		pending.push_back(&job);
+	}
+
+	auto finish = [&](const render_job & job, const std::string & error) {
+		std::cout << "        " << job.filename_out << " (" << job.reason << ")\n" << std::flush;
+		const auto i = index(job);
+		if (started[i] != trace::clock::time_point{}) {
+			const auto now = trace::clock::now();
+			global.stats.latencies.emplace_back(job.filename_out,
+				std::chrono::duration<double, std::milli>(now - started[i]).count());
+			if (profile) {
+				profile->async(job.filename_out, "document", span_ids[i], started[i], now,
+					{{"reason", job.reason}, {"error", error}});
+			}
+		}
+		++(error.empty() ? global.stats.pages_rendered : global.stats.pages_failed);
+		if (error.empty()) {
+			global.deps->update(job.filename_out, job.deps);
+			if (global.cache)
+				global.cache->store(job.cache_key, job.filename_out);
+		} else {
+			global.deps->remove(job.filename_out);
+			errors.push_back(job.filename_out + ": " + error);
+		}
+	};
+
+	auto write_failed
+		= [](const render_job & job) { return "unable to write file: " + job.filename_out; };
+
+	// documents rendered in-process, concurrently, unsupported ones are left to pandoc
+	std::vector<const render_job *> builtin;
+	std::vector<const render_job *> remaining;
+	for (const auto job : pending)
+		(renders_builtin(*job) ? builtin : remaining).push_back(job);
+	if (!builtin.empty()) {
+		try {
+			get_page_template(system::get_theme().get_template());
+		} catch (const std::runtime_error &) {
+			// template not supported, everything rendered by pandoc
+			remaining = pending;
+			builtin.clear();
+		}
+	}
+
+	std::vector<std::experimental::optional<std::string>> builtin_results(builtin.size());
+	std::vector<std::string> builtin_errors(builtin.size());
+	std::vector<double> builtin_durations(builtin.size(), 0.0);
+	if (!builtin.empty()) {
+		worker_pool pool{std::min(global.jobs, builtin.size())};
+		for (std::size_t i = 0; i < builtin.size(); ++i) {
+			pool.submit([&, i] {
+				const trace_span span{profile, builtin[i]->filename_out, "builtin"};
+				const auto t = std::chrono::steady_clock::now();
+				try {
+					builtin_results[i] = render_builtin(*builtin[i]);
+				} catch (const std::exception & e) {
+					builtin_errors[i] = e.what();
+				}
+				builtin_durations[i] = std::chrono::duration<double, std::milli>(
+					std::chrono::steady_clock::now() - t)
+										   .count();
+			});
+		}
+		pool.wait();
+	}
+
+	for (std::size_t i = 0; i < builtin.size(); ++i) {
+		const auto & job = *builtin[i];
+		if (!builtin_errors[i].empty()) {
+			finish(job, builtin_errors[i]);
+		} else if (!builtin_results[i]) {
+			remaining.push_back(&job);
+		} else {
+			std::ofstream ofs{job.filename_out.c_str(), std::ios::binary};
+			ofs << *builtin_results[i];
+			ofs.close();
+			global.stats.latencies.emplace_back(job.filename_out, builtin_durations[i]);
+			finish(job, ofs ? std::string{} : write_failed(job));
+		}
+	}
+	pending = std::move(remaining);
+
+	process_executor executor{global.jobs};
+
+	// a terminated pandoc process for the documents, its span nested within
+	// the one of its document, batches have spans of their own
+	auto record = [&](const std::string & name,
+					  const std::vector<const render_job *> & documents, const result & r,
+					  std::uint64_t input_size, std::uint64_t output_size) {
+		++global.stats.pandoc_processes;
+		global.stats.bytes_to_pandoc += input_size;
+		global.stats.bytes_from_pandoc += output_size;
+		for (const auto job : documents)
+			begin_document(*job, r.started);
+		if (profile) {
+			const auto id = (documents.size() == 1) ? span_ids[index(*documents.front())]
+													: profile->next_id();
+			profile->async(name, "document", id, r.started, r.terminated,
+				{{"input bytes", std::to_string(input_size)},
+					{"output bytes", std::to_string(output_size)},
+					{"exit code", std::to_string(r.exit_code)}});
+		}
+	};
+
+	// a pandoc process for the documents
+	auto submit = [&](const std::string & name, std::vector<const render_job *> documents,
+					  std::vector<std::string> params, std::string input,
+					  process_executor::completion done) {
+		const auto input_size = input.size();
+		executor.submit(std::move(params), std::move(input),
+			[&, name, documents, input_size, done = std::move(done)](result && r) {
+				record(name, documents, r, input_size, r.output.size());
+				done(std::move(r));
+			});
+	};
+
+	// final conversion to HTML, from the JSON representation
+	auto write = [&](const render_job & job, std::string content) {
+		submit("pandoc write", {&job}, job.params, std::move(content),
+			[&, job_ptr = &job](result && r) {
+				finish(*job_ptr, succeeded(r) ? std::string{} : write_failed(*job_ptr));
+			});
+	};
+
+	// a single document, links rewritten between reading and writing
+	auto render = [&](const render_job & job) {
+		if (global.mode == render_mode::single_pass) {
+			submit("pandoc", {&job}, job.params, job.source ? *job.source : std::string{},
+				[&, job_ptr = &job](result && r) {
+					finish(*job_ptr, succeeded(r) ? std::string{} : write_failed(*job_ptr));
+				});
+			return;
+		}
+
+		// the JSON representation is never held as a whole, only the parts in transit
+		struct link_stream {
+			json_link_filter filter{replace_root};
+			std::uint64_t bytes_read = 0;
+			std::uint64_t bytes_written = 0;
+		};
+		auto stream = std::make_shared<link_stream>();
+		auto input = job.source ? *job.source : std::string{};
+		const auto input_size = input.size();
+		executor.submit_pipe(
+			prepare_read_params(job), std::move(input),
+			[stream](const char * data, std::size_t size, bool end, std::string & out) {
+				const auto out_size = out.size();
+				if (end) {
+					stream->filter.finish(out);
+				} else {
+					stream->filter.feed(data, size, out);
+				}
+				stream->bytes_read += size;
+				stream->bytes_written += out.size() - out_size;
+			},
+			job.params,
+			[&, job_ptr = &job, stream, input_size](process_executor::pipe_result && r) {
+				record("pandoc read", {job_ptr}, r.first, input_size, stream->bytes_read);
+				record("pandoc write", {job_ptr}, r.second, stream->bytes_written,
+					r.second.output.size());
+				if (r.first.exit_code != 0) {
+					finish(*job_ptr, write_failed(*job_ptr));
+				} else if (!r.filter_error.empty()) {
+					finish(*job_ptr, r.filter_error);
+				} else if (!succeeded(r.second)) {
+					finish(*job_ptr, write_failed(*job_ptr));
+				} else {
+					finish(*job_ptr, {});
+				}
+			});
+	};
+
+	// several documents read by one process, then written one by one
+	auto render_batch = [&](const std::vector<const render_job *> & batch) {
+		if (batch.size() < 2) {
+			render(*batch.front());
+			return;
+		}
+
+		const auto tmp = create_temp_directory();
+		std::vector<std::string> params;
+		try {
+			std::vector<std::string> sources;
+			for (const auto job : batch) {
+				sources.push_back(
+					job->source ? *job->source : read_file_contents(job->filename_in, {}));
+			}
+			params = prepare_batch_read(sources, tmp);
+		} catch (...) {
+			fs::remove_all(tmp);
+			for (const auto job : batch)
+				render(*job);
+			return;
+		}
+
+		submit("pandoc read batch", batch, params, {}, [&, tmp, batch](result && r) {
+			std::error_code ec;
+			fs::remove_all(tmp, ec);
+
+			const trace_span span{profile, "split batch", "links"};
+			std::vector<std::string> contents;
+			try {
+				auto docs = (r.exit_code == 0) ? split_batch(r.output, batch.size())
+											   : std::vector<nlohmann::json>{};
+				for (auto & doc : docs) {
+					fix_links_recursive(doc);
+					contents.push_back(doc.dump());
+				}
+			} catch (...) {
+				contents.clear();
+			}
+
+			// not separable, read one by one
+			if (contents.empty()) {
+				for (const auto job : batch)
+					render(*job);
+				return;
+			}
+
+			for (std::size_t i = 0; i < batch.size(); ++i)
+				write(*batch[i], std::move(contents[i]));
+		});
+	};
+
+	for (const auto & batch : make_batches(pending))
+		render_batch(batch);
+	executor.run();
+
+	global.deps->save();
+
+	if (!errors.empty()) {
+		for (const auto & error : errors)
+			std::cerr << "error: " << error << '\n';
+		throw std::runtime_error{fmt::sprintf("unable to render %u document(s)", errors.size())};
+	}
+}
+
+/// Prepares a single document for rendering.
+///
+/// \param[in] source_directory Source directory in which the source
+///   document is to be found.
+/// \param[in] destination_directory The directory in which the destination
+///   document will be created.
+/// \param[in] filename_in The filename of the document to process.
+/// \param[out] jobs Container to append the job to.
+///
+static void prepare_single(const std::string & source_directory,
+	const std::string & destination_directory, const std::string & filename_in,
+	std::vector<render_job> & jobs)
+{
+	auto filename_out = convert_path(filename_in);
+
+	if (!filename_out.empty()) {
+		filename_out = destination_directory + filename_out.substr(source_directory.size());
+		prepare_document(filename_in, filename_out, prepare_page_tag_list(filename_in), jobs);
+	} else {
+		std::cout << "ignore: " << filename_in << '\n';
+		++global.stats.pages_ignored;
+	}
+}
+
+/// Processes a single document.
+///
+/// \param[in] source_directory Source directory in which the source
+///   document is to be found.
+/// \param[in] destination_directory The directory in which the destination
+///   document will be created.
+/// \param[in] filename_in The filename of the document to process.
+///
+static void process_single(const std::string & source_directory,
+	const std::string & destination_directory, const std::string & filename_in)
+{
+	std::vector<render_job> jobs;
+	prepare_single(source_directory, destination_directory, filename_in, jobs);
+	render_documents(jobs);
+}
+
+/// Returns `true` if the specified path is a subdirectory of the directory.
+///
+/// \param[in] path Path to check if it is a subdirectory.
+/// \param[in] directory Directory to check against.
+///
+static bool is_subdir(const std::string & path, const std::string & directory)
+{
+	const auto p = fs::canonical(path);
 	const auto d = fs::canonical(directory);
 
 	return std::equal(d.begin(), d.end(), p.begin());
@@ -709,33 +1851,16 @@ static void process_pages(const std::string source_directory,
 				"error: " + specific_dir + " is not a subdir of " + source_directory};
 	}
 
+	std::vector<render_job> jobs;
 	for (const auto & entry : fs::recursive_directory_iterator{source_directory}) {
 		fs::path path{entry.path()};
 		if (!specific_dir.empty() && fs::is_directory(path) && (specific_dir != path))
 			continue;
 		if (fs::is_regular_file(path)) {
-			process_single(source_directory, destination_directory, path.string());
+			prepare_single(source_directory, destination_directory, path.string(), jobs);
 		}
 	}
-}
-
-/// Reads and returns the contents of the specified file. If the file does not
-/// exist, the default value will be returned.
-///
-/// \param[in] filename Filename of the file to read.
-/// \param[in] default_value Value to be returned if the file does not exist.
-static std::string read_file_contents(
-	const std::string & filename, const std::string & default_value)
-{
-	if (!fs::exists(filename)) {
-		return default_value;
-	}
-	std::ostringstream os;
-	std::ifstream ifs{filename.c_str()};
-	ifs >> std::noskipws;
-	std::copy(std::istream_iterator<char>{ifs}, std::istream_iterator<char>{},
-		std::ostream_iterator<char>{os});
-	return os.str();
+	render_documents(jobs);
 }
 
 /// Returns the markdown header for a tag overview document.
@@ -792,108 +1917,205 @@ static std::string get_title_newest_entries()
 		system::get_theme().get_title_newest_entries(), "Newest Entries:");
 }
 
-static std::string create_temp_directory()
+/// A document generated by mkweb (overviews, front page, sitemap): a list of
+/// links to documents, with an optional paragraph in front of the list.
+struct generated_page {
+	struct entry {
+		std::string date; ///< shown in front of the link, optional
+		std::string title;
+		std::string link;
+		std::string summary; ///< paragraph below the link, optional
+	};
+
+	std::string filename_out;
+	std::string front_matter; ///< meta data, YAML including the delimiters
+	std::string intro; ///< paragraph in front of the list, optional
+	std::string date_separator = " "; ///< between date and link
+	bool loose = false; ///< entries separated by empty lines, as paragraphs
+	std::vector<entry> entries;
+};
+
+/// Returns the page as markdown, to be rendered by pandoc.
+static std::string to_markdown(const generated_page & page)
 {
-	std::string path = (fs::temp_directory_path() / "mkwebtmp-XXXXXX").string();
-	if (::mkdtemp(&path[0]) == nullptr)
-		throw std::runtime_error{"Unable to create temporary directory"};
-	return path;
+	std::ostringstream os;
+	os << page.front_matter << '\n';
+	if (!page.intro.empty())
+		os << page.intro << "\n\n";
+	for (const auto & entry : page.entries) {
+		os << "- ";
+		if (!entry.date.empty())
+			os << '`' << entry.date << '`' << page.date_separator;
+		os << '[' << entry.title << "](" << entry.link << ")\n";
+		if (!entry.summary.empty())
+			os << "\n    " << entry.summary << '\n';
+		if (page.loose)
+			os << '\n';
+	}
+	return os.str();
 }
 
-/// Returns a sorted container.
-template <typename Container, typename Comparison>
-Container sorted(const Container & c, Comparison comp)
+/// Returns the body of the page in HTML, the way pandoc renders its markdown.
+/// Titles and summaries are taken as plain text.
+static std::string to_html(const generated_page & page)
 {
-	Container t = c;
-	std::sort(begin(t), end(t), comp);
-	return t;
+	std::ostringstream os;
+	if (!page.intro.empty())
+		os << "<p>" << escape_html(page.intro) << "</p>\n";
+	if (page.entries.empty())
+		return os.str();
+
+	os << "<ul>\n";
+	for (const auto & entry : page.entries) {
+		std::string item;
+		if (!entry.date.empty())
+			item += "<code>" + escape_html(entry.date) + "</code>"
+				+ escape_html(page.date_separator);
+		item += "<a href=\"" + escape_html(replace_root(entry.link)) + "\">"
+			+ escape_html(entry.title) + "</a>";
+
+		if (page.loose) {
+			os << "<li><p>" << item << "</p>";
+			if (!entry.summary.empty())
+				os << "\n<p>" << escape_html(entry.summary) << "</p>";
+			os << "</li>\n";
+		} else {
+			os << "<li>" << item << "</li>\n";
+		}
+	}
+	os << "</ul>";
+	return os.str();
 }
 
-/// Returns a comparison function for the specified name.
-static std::function<bool(const std::string &, const std::string &)> get_overview_sorting(
-	const std::string & name)
+/// Renders the page without pandoc, the template of the theme is filled
+/// natively. Variables are the ones pandoc would use, derived from the same
+/// parameters, meta data from the front matter.
+///
+/// The destination is only written if its contents change.
+///
+/// \return `false` if the meta data is not supported, the page is left to pandoc.
+static bool render_native(const generated_page & page)
 {
-	static const std::map<config::sort_description,
-		std::function<bool(const std::string &, const std::string &)>>
-		func_map = {
-			{{config::sort_direction::ascending, "date"},
-				[](const auto & a, const auto & b) {
-					return global.meta[a].date < global.meta[b].date;
-				}},
-			{{config::sort_direction::descending, "date"},
-				[](const auto & a, const auto & b) {
-					return global.meta[a].date > global.meta[b].date;
-				}},
-			{{config::sort_direction::ascending, "title"},
-				[](const auto & a, const auto & b) {
-					return global.meta[a].title < global.meta[b].title;
-				}},
-			{{config::sort_direction::descending, "title"},
-				[](const auto & a, const auto & b) {
-					return global.meta[a].title > global.meta[b].title;
-				}},
-		};
+	const trace_span span{global.profile.get(), page.filename_out, "native"};
+	render_job job;
+	job.filename_in = fs::path{page.filename_out}.replace_extension(".md").string();
+	job.filename_out = page.filename_out;
+	job.source = std::string{};
+	const auto params = prepare_pandoc_params(job, {});
+
+	std::string template_filename;
+	auto vars = get_template_variables(params, template_filename);
+	try {
+		if (!add_meta_variables(vars, page.front_matter,
+				[](const std::string & value) { return escape_html(value); }))
+			return false;
+	} catch (const YAML::Exception &) {
+		return false;
+	}
+	vars["body"].push_back(to_html(page));
+
+	const auto html = get_page_template(template_filename).render(vars);
+
+	// a document rendered by pandoc before is no longer
+	global.deps->remove(page.filename_out);
+
+	if (fs::exists(page.filename_out) && (read_file_contents(page.filename_out, {}) == html)) {
+		std::cout << "skip    " << page.filename_out << '\n';
+		++global.stats.pages_skipped;
+		return true;
+	}
 
+	ensure_path_for_file(page.filename_out);
+	std::ofstream ofs{page.filename_out.c_str(), std::ios::binary};
+	ofs << html;
+	if (!ofs)
+		throw std::runtime_error{"unable to write file: " + page.filename_out};
+	std::cout << "native  " << page.filename_out << '\n';
+	++global.stats.pages_native;
+	return true;
+}
+
+/// Renders generated pages, natively or by pandoc, see `render_native`.
+static void render_generated(const std::vector<generated_page> & pages)
+{
+	std::vector<render_job> jobs;
+	for (const auto & page : pages) {
+		if (global.native_pages && render_native(page))
+			continue;
+		prepare_generated(fs::path{page.filename_out}.replace_extension(".md").string(),
+			to_markdown(page), page.filename_out, jobs);
+	}
+	render_documents(jobs);
+}
+
+/// Returns the order of the entries of the specified overview.
+///
+/// \return Sort key, and `true` if descending.
+static std::pair<document_store::sort_key, bool> get_overview_sorting(const std::string & name)
+{
 	config::sort_description desc;
 
 	if (name == "year")
 		desc = system::cfg().get_yearlist().sorting;
 
-	const auto i = func_map.find(desc);
-	if (i != func_map.end())
-		return i->second;
+	const auto descending = desc.dir == config::sort_direction::descending;
+	if (desc.key == "date")
+		return {document_store::sort_key::date, descending};
+	if (desc.key == "title")
+		return {document_store::sort_key::title, descending};
 
-	// default comparator
-	return [](
-		const auto & a, const auto & b) { return global.meta[a].title > global.meta[b].title; };
+	// default order
+	return {document_store::sort_key::title, true};
 }
 
-static std::function<std::string(const meta_info &)> get_overview_decoration(
+/// Returns a function providing the date shown in front of entries of the
+/// specified overview, if any.
+static std::function<std::string(const document_store::document &)> get_overview_date(
 	const std::string & name)
 {
-	if (name == "year")
-		return [](const meta_info & info) { return "`" + info.date.str_date() + "` "; };
+	if (name == "year") {
+		return [](const document_store::document & doc) {
+			return doc.date.str_date();
+		};
+	}
 
-	return [](const meta_info &) { return std::string{}; };
+	return [](const document_store::document &) { return std::string{}; };
 }
 
-/// Creates a temporary document for the desired overview and processes it.
+/// An overview page and the documents it lists, e.g. of a tag.
+struct overview_item {
+	std::string id;
+	const std::vector<document_store::id> * documents;
+};
+
+/// Creates the documents of the desired overview in memory and renders them.
+/// Overview pages which did not change are not rendered again.
 ///
-static void process_overview(
-	const std::unordered_map<std::string, std::vector<std::string>> & items,
-	const std::string & name, const std::string & file_meta_info)
+static void process_overview(const std::vector<overview_item> & items, const std::string & name,
+	const std::string & file_meta_info)
 {
 	const auto date_str = posix_time::now().str_date();
 	const auto author = system::cfg().get_author();
 
 	const auto path = system::cfg().get_destination() + '/' + name;
 	ensure_path_for_file(path + '/');
-	auto tmp = create_temp_directory();
 
 	const auto sorting = get_overview_sorting(name);
-	const auto decoration = get_overview_decoration(name);
-
-	for (auto const & entry : items) {
-		const std::string id = entry.first;
-		try {
-			// write meta data
-			std::ofstream ofs{(tmp + '/' + id + ".md").c_str()};
-			ofs << fmt::sprintf(file_meta_info, id, author, date_str) << '\n';
-
-			// write list of links
-			for (const auto & fn : sorted(entry.second, sorting)) {
-				const auto info = global.meta[fn];
-				const auto link = fs::path{fn}.replace_extension(".html").string();
-				ofs << "- " << decoration(info) << "[" << info.title << "](" << link << ")\n";
-			}
-		} catch (...) {
-			fs::remove_all(tmp);
-			throw std::runtime_error{"error in processing " + name + " file for: " + id};
+	const auto date_of = get_overview_date(name);
+
+	std::vector<generated_page> pages;
+	for (const auto & item : items) {
+		generated_page page;
+		page.filename_out = path + '/' + item.id + ".html";
+		page.front_matter = fmt::sprintf(file_meta_info, item.id, author, date_str);
+		for (const auto doc : global.docs.sorted(*item.documents, sorting.first, sorting.second)) {
+			const auto & info = global.docs[doc];
+			page.entries.push_back({date_of(info), info.title, url_of(doc), {}});
 		}
+		pages.push_back(std::move(page));
 	}
 
-	process_pages(tmp, path);
-	fs::remove_all(tmp);
+	render_generated(pages);
 }
 
 /// Creates a front page.
@@ -904,49 +2126,28 @@ static void process_front()
 	const auto date_str = posix_time::now().str_date();
 	const auto author = system::cfg().get_author();
 
-	auto tmp = create_temp_directory();
-
-	const auto index_filename = tmp + "/index.md";
 	const auto destination_filename = system::cfg().get_destination() + "/index.html";
 
 	try {
-		std::ofstream ofs{index_filename.c_str()};
-		ofs << fmt::sprintf(get_meta_contents(), author, date_str) << '\n';
-		ofs << get_title_newest_entries() << "\n\n";
-
-		const auto num = system::cfg().get_num_news();
-		auto count = 0;
-		for (const auto & date : global.dates) {
-			if (count >= num)
-				break;
-			const auto date_str = date.first.str_date();
-			for (const auto & fn : date.second) {
-				if (count >= num)
-					break;
-				++count;
-
-				const auto & info = global.meta[fn];
-
-				const auto link = replace_root(convert_path(fn));
-				ofs << "  - `" << date_str << "` : [" << info.title << "](" << link << ")\n";
-
-				if (!info.summary.empty()) {
-					ofs << '\n' << "    " << info.summary << '\n';
-				}
-
-				ofs << '\n';
-			}
+		generated_page page;
+		page.filename_out = destination_filename;
+		page.front_matter = fmt::sprintf(get_meta_contents(), author, date_str);
+		page.intro = get_title_newest_entries();
+		page.date_separator = " : ";
+		page.loose = true;
+
+		const auto num = std::max(system::cfg().get_num_news(), 0);
+		const auto newest = global.docs.sorted(document_store::sort_key::date, true);
+		for (std::size_t i = 0; i < std::min(newest.size(), static_cast<std::size_t>(num)); ++i) {
+			const auto & info = global.docs[newest[i]];
+			page.entries.push_back({info.date.str_date(), info.title,
+				url_of(newest[i]), info.summary});
 		}
 
-		ofs.close();
-		ensure_path_for_file(destination_filename);
-		process_document(index_filename, destination_filename);
+		render_generated({page});
 	} catch (...) {
-		fs::remove_all(tmp);
 		throw std::runtime_error{"error in processing front page"};
 	}
-
-	fs::remove_all(tmp);
 }
 
 /// Creates the sitemap.
@@ -962,35 +2163,24 @@ static void process_sitemap()
 	const auto date_str = posix_time::now().str_date();
 	const auto author = system::cfg().get_author();
 
-	auto tmp = create_temp_directory();
-
-	const auto index_filename = tmp + "/sitemap.md";
 	const auto destination_filename
 		= system::cfg().get_destination() + "/" + system::get_sitemap_filename();
 
 	try {
-		std::ofstream ofs{index_filename.c_str()};
-		ofs << fmt::sprintf(get_meta_sitemap(), author, date_str) << '\n';
-
-		for (const auto & entry : sorted_ids_of_global_pagelist(global.meta, sitemap.sorting)) {
-			const auto meta = get_meta_for_source(entry.second);
-			if (!meta)
-				continue;
-
-			const auto link = replace_root(convert_path(entry.second));
-			ofs << " - `" << meta->date.str_date() << "` [" << meta->title << "](" << link
-				<< ")\n";
+		generated_page page;
+		page.filename_out = destination_filename;
+		page.front_matter = fmt::sprintf(get_meta_sitemap(), author, date_str);
+
+		for (const auto doc : sorted_ids_of_global_pagelist(sitemap.sorting)) {
+			const auto & info = global.docs[doc];
+			page.entries.push_back(
+				{info.date.str_date(), info.title, url_of(doc), {}});
 		}
 
-		ofs.close();
-		ensure_path_for_file(destination_filename);
-		process_document(index_filename, destination_filename);
+		render_generated({page});
 	} catch (...) {
-		fs::remove_all(tmp);
 		throw std::runtime_error{"error in processing site map"};
 	}
-
-	fs::remove_all(tmp);
 }
 
 /// Creates a redirecion page. Useful to have such file in a directory to
@@ -1020,20 +2210,40 @@ static void process_redirect(const std::string & directory)
 	}
 }
 
+/// Numbers of files handled by `copy`.
+struct copy_counts {
+	std::size_t copied = 0;
+	std::size_t up_to_date = 0; ///< destination not older than the source
+};
+
+/// Copies an entry unless the destination is up to date, symbolic links are skipped.
+static void copy_entry(const fs::path & from, const fs::path & to, copy_counts & counts)
+{
+	ensure_path_for_file(to.string());
+	if (fs::is_regular_file(from) && !fs::is_symlink(from)) {
+		const auto up_to_date
+			= fs::exists(to) && (fs::last_write_time(to) >= fs::last_write_time(from));
+		++(up_to_date ? counts.up_to_date : counts.copied);
+	}
+	fs::copy(from, to, fs::copy_options::update_existing | fs::copy_options::skip_symlinks);
+}
+
 /// Copies files or directories. It is possible to specify a function to ignore
 /// specific entries.
 ///
 /// \param[in] from File or directory to copy from.
 /// \param[in] from File or directory to copy to.
 /// \param[in] ignore Function to ask if an item has to be copied or not.
+/// \return Numbers of files copied and up to date.
 ///
-static void copy(
+static copy_counts copy(
 	const fs::path & from, const fs::path & to, std::function<bool(const fs::path &)> ignore)
 {
+	copy_counts counts;
+
 	if (fs::is_regular_file(from) && !ignore(from)) {
-		ensure_path_for_file(to.string());
-		fs::copy(from, to, fs::copy_options::update_existing | fs::copy_options::skip_symlinks);
-		return;
+		copy_entry(from, to, counts);
+		return counts;
 	}
 
 	if (fs::is_directory(from)) {
@@ -1046,40 +2256,42 @@ static void copy(
 
 			// replace top path of source with the destination path and copy file
 			const fs::path & dst = to / join_path(++path.begin(), path.end());
-			ensure_path_for_file(dst.string());
-			fs::copy(
-				path, dst, fs::copy_options::update_existing | fs::copy_options::skip_symlinks);
+			copy_entry(path, dst, counts);
 		}
-		return;
 	}
+	return counts;
 }
 
 /// Default option to copy without ignoring anything.
-static void copy(const fs::path & from, const fs::path & to)
+static copy_counts copy(const fs::path & from, const fs::path & to)
 {
 	// ignore none
-	copy(from, to, [](const fs::path &) -> bool { return false; });
+	return copy(from, to, [](const fs::path &) -> bool { return false; });
 }
 
 /// Copies static files to the destination directory.
 static void process_copy_file()
 {
+	const phase_timer timer{"copy"};
 	std::cout << "copy files\n";
 
 	// if no static directory is configured, we assume the source directory to
 	// contain files to copy. Just let's ignore the file types we are already
 	// processing. if there is a static directory, just copy this and ignore the
 	// source directory.
+	copy_counts counts;
 	if (system::cfg().get_static().empty()) {
-		mkweb::copy(system::cfg().get_static(), system::cfg().get_destination(),
+		counts = mkweb::copy(system::cfg().get_static(), system::cfg().get_destination(),
 			[](const fs::path & path) {
 				return fs::is_regular_file(path)
 					&& contains(path.extension().string(),
 						   system::cfg().get_source_process_filetypes());
 			});
 	} else {
-		mkweb::copy(system::cfg().get_static(), system::cfg().get_destination());
+		counts = mkweb::copy(system::cfg().get_static(), system::cfg().get_destination());
 	}
+	global.stats.static_copied += counts.copied;
+	global.stats.static_up_to_date += counts.up_to_date;
 }
 
 /// Copies all necessary files of a plugin to the destination directory.
@@ -1091,34 +2303,569 @@ static void copy_plugin_files(const std::string & plugin)
 {
 	std::cout << "install plugin: " << plugin << '\n';
 
-	const auto plg = system::get_plugin(plugin);
-	const auto cfg = YAML::LoadFile(plg.get_config());
+	const auto & plg = global.registry.get(plugin);
 
-	if (!cfg || !cfg["install"])
+	if (!plg.install)
 		throw std::runtime_error{"error: unable to read configuration for plugin: " + plugin};
 
 	const auto destination_path = fs::path{system::cfg().get_plugin_path(plugin)}; // TODO: correct?
-	const auto plugin_path = fs::path{plg.get_path()};
+	const auto plugin_path = fs::path{plg.path};
 
-	for (const auto & entry : cfg["install"]) {
-		const auto f = entry.as<std::string>();
+	for (const auto & f : *plg.install) {
 		const auto fn = plugin_path / f;
 		if (!fs::exists(fn))
 			throw std::runtime_error{
 				"error: unable to copy file '" + f + "' of plugin " + plugin};
 		if (fs::is_regular_file(fn)) {
 			std::cout << "  copy [f] " << fn << " -> " << destination_path << '\n';
-			mkweb::copy(fn, destination_path.string());
+			global.stats.plugin_files_installed
+				+= mkweb::copy(fn, destination_path.string()).copied;
 		} else if (fs::is_directory(fn)) {
 			std::cout << "  copy [d] " << fn << " -> " << (destination_path / f) << '\n';
 			ensure_path_for_file(destination_path.string());
 			fs::copy(fn, destination_path / f, fs::copy_options::overwrite_existing
 					| fs::copy_options::recursive | fs::copy_options::skip_symlinks);
+			for (const auto & entry : fs::recursive_directory_iterator(fn)) {
+				if (fs::is_regular_file(entry.path()) && !fs::is_symlink(entry.path()))
+					++global.stats.plugin_files_installed;
+			}
 		} else {
 			throw std::runtime_error{"error: '" + f + "' is not a file or directory"};
 		}
 	}
 }
+
+/// Prints statistics of the render cache.
+static void print_cache_stats(const std::string & title, const render_cache::statistics & s)
+{
+	const auto lookups = s.hits + s.misses;
+	std::cout << fmt::sprintf("%s: %u hits, %u misses (%.1f%% hit rate), %u stored, %u evicted\n",
+		title, s.hits, s.misses, (lookups > 0) ? (100.0 * s.hits / lookups) : 0.0, s.stores,
+		s.evictions);
+}
+
+/// Returns the percentile of sorted values, by nearest rank.
+static double percentile(const std::vector<double> & values, double p)
+{
+	if (values.empty())
+		return 0.0;
+	const auto rank = static_cast<std::size_t>(std::ceil(p / 100.0 * values.size()));
+	return values[std::max<std::size_t>(rank, 1) - 1];
+}
+
+/// Writes the statistics of the build as JSON: counters, latencies of
+/// rendering documents, the slowest documents and durations of the phases.
+///
+/// \param[in] filename The file to write.
+/// \param[in] num_slowest Maximum number of slowest documents to list.
+static void write_stats(const std::string & filename, std::size_t num_slowest)
+{
+	const auto & s = global.stats;
+
+	auto latencies = s.latencies;
+	std::sort(begin(latencies), end(latencies),
+		[](const std::pair<std::string, double> & a, const std::pair<std::string, double> & b) {
+			return a.second > b.second;
+		});
+	std::vector<double> values;
+	for (auto i = latencies.rbegin(); i != latencies.rend(); ++i)
+		values.push_back(i->second);
+
+	nlohmann::json stats = {
+		{"pages",
+			{{"rendered", s.pages_rendered}, {"cached", s.pages_cached},
+				{"skipped", s.pages_skipped}, {"ignored", s.pages_ignored},
+				{"failed", s.pages_failed}, {"native", s.pages_native}}},
+		{"pandoc",
+			{{"processes", s.pandoc_processes}, {"bytes_in", s.bytes_to_pandoc},
+				{"bytes_out", s.bytes_from_pandoc}}},
+		{"static", {{"copied", s.static_copied}, {"up_to_date", s.static_up_to_date}}},
+		{"plugins", {{"files_installed", s.plugin_files_installed}}},
+		{"latency_ms",
+			{{"count", values.size()}, {"p50", percentile(values, 50.0)},
+				{"p95", percentile(values, 95.0)}, {"p99", percentile(values, 99.0)},
+				{"max", values.empty() ? 0.0 : values.back()}}},
+	};
+
+	auto & slowest = stats["slowest"] = nlohmann::json::array();
+	for (std::size_t i = 0; i < std::min(num_slowest, latencies.size()); ++i)
+		slowest.push_back({{"document", latencies[i].first}, {"ms", latencies[i].second}});
+
+	auto & timings = stats["timings_ms"] = nlohmann::json::object();
+	for (const auto & t : global.timings)
+		timings[t.first] = t.second;
+
+	std::ofstream ofs{filename.c_str()};
+	ofs << stats.dump(2) << '\n';
+	if (!ofs)
+		throw std::runtime_error{"unable to write file: " + filename};
+}
+
+/// Reads the configuration and resolves everything derived from it.
+static void read_configuration(const std::string & filename)
+{
+	system::reset(std::make_shared<config>(filename));
+	global.resolver
+		= path_resolver{system::cfg().get_path_map(), system::cfg().get_site_url()};
+	if (global.mode == render_mode::single_pass)
+		write_link_filter(global.link_filter);
+}
+
+/// Collects the meta information of all documents and prepares the lists
+/// derived from it. Information of a previous run is discarded.
+static void collect_site()
+{
+	const phase_timer timer{"collect"};
+	global.docs.clear();
+	global.plugins.clear();
+	global.urls.clear();
+	forget_shared_files();
+
+	collect_information(system::cfg().get_source());
+	global.docs.finish();
+	global.urls.reserve(global.docs.size());
+	for (document_store::id doc = 0; doc < global.docs.size(); ++doc)
+		global.urls.push_back(replace_root(convert_path(global.docs.path(doc))));
+	global.tag_list = prepare_global_tag_list();
+	global.year_list = prepare_global_year_list();
+	global.page_list = prepare_global_pagelist();
+	prepare_shared_params();
+}
+
+/// Generates all pages of the site: overviews, documents, front page and sitemap.
+static void generate_site()
+{
+	{
+		const phase_timer timer{"overviews"};
+		std::vector<overview_item> tags;
+		for (document_store::id tag = 0; tag < global.docs.num_tags(); ++tag)
+			tags.push_back({global.docs.tag(tag), &global.docs.tagged(tag)});
+		process_overview(tags, "tag", get_meta_tags());
+
+		std::vector<overview_item> years;
+		for (const auto & year : global.docs.years())
+			years.push_back({year_name(year.first), &year.second});
+		process_overview(years, "year", get_meta_years());
+	}
+	{
+		const phase_timer timer{"pages"};
+		process_pages(system::cfg().get_source(), system::cfg().get_destination());
+	}
+	{
+		const phase_timer timer{"front"};
+		process_front();
+	}
+	{
+		const phase_timer timer{"sitemap"};
+		process_sitemap();
+	}
+	{
+		const phase_timer timer{"redirect"};
+		process_redirect(system::cfg().get_destination());
+	}
+}
+
+/// Copies the files of all used plugins.
+static void copy_plugins()
+{
+	const phase_timer timer{"plugins"};
+	std::cout << "copy plugins\n";
+	for (const auto & plugin : global.plugins)
+		copy_plugin_files(plugin);
+}
+
+/// Set by signals to stop watching or serving.
+static volatile std::sig_atomic_t stop_requested = 0;
+
+/// Lets SIGINT and SIGTERM request to stop, instead of terminating immediately.
+/// Work in progress is finished, waiting for changes or clients is interrupted.
+static void install_stop_handler()
+{
+	struct sigaction sa;
+	std::memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = [](int) { stop_requested = 1; };
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_RESTART; // waiting with poll or accept is interrupted nevertheless
+	::sigaction(SIGINT, &sa, nullptr);
+	::sigaction(SIGTERM, &sa, nullptr);
+}
+
+/// Tags of watched directories, see `watch`.
+enum watch_tag : int {
+	watch_source = 1 << 0,
+	watch_static = 1 << 1,
+	watch_theme = 1 << 2,
+	watch_plugins = 1 << 3,
+	watch_config = 1 << 4,
+};
+
+/// Returns `true` if the path is the directory or within it, comparing
+/// the parts of the paths, ignoring `.`.
+static bool is_within(const std::string & path, const std::string & directory)
+{
+	auto parts = [](const std::string & s) {
+		auto v = split_path(s);
+		v.erase(std::remove_if(begin(v), end(v),
+					[](const std::string & part) { return part.empty() || (part == "."); }),
+			end(v));
+		return v;
+	};
+	const auto p = parts(path);
+	const auto dir = parts(directory);
+	return (p.size() >= dir.size()) && std::equal(begin(dir), end(dir), begin(p));
+}
+
+/// Returns `true` if both contain the same meta information.
+static bool same_meta(const meta_info & a, const meta_info & b)
+{
+	return !(a.date < b.date) && !(b.date < a.date) && (a.title == b.title)
+		&& (a.authors == b.authors) && (a.tags == b.tags) && (a.language == b.language)
+		&& (a.summary == b.summary) && (a.plugins == b.plugins);
+}
+
+/// Reads the meta information of a single document again, assuming all other
+/// documents to be unchanged.
+///
+/// \return `true` if the meta information is unchanged, `false` if it has
+///   changed and everything has to be collected again, because it is part
+///   of the global lists.
+static bool refresh_meta(const std::string & path)
+{
+	std::experimental::optional<meta_info> meta;
+	try {
+		meta = read_meta(path);
+	} catch (...) {
+		// no relevant meta data found for file
+	}
+
+	const auto doc = global.docs.find(path);
+	if (!meta || !doc)
+		return !meta && !doc;
+	return same_meta(*meta, global.docs.meta(*doc));
+}
+
+/// Returns `true` if a change within the source directory is handled by
+/// rendering the changed document on its own, see `watch`: the document was
+/// rendered before and its meta information is unchanged. Files which are not
+/// documents, like temporary files of editors, need no handling at all.
+/// Otherwise, e.g. for added or removed documents and directories, the whole
+/// site has to be collected again.
+static bool renders_alone(const std::string & path)
+{
+	const auto & source = system::cfg().get_source();
+	if (path.compare(0, source.size(), source) != 0)
+		return false;
+
+	const auto out = convert_path(path);
+	const auto destination
+		= system::cfg().get_destination() + (out.empty() ? path : out).substr(source.size());
+	std::error_code ec;
+	if (out.empty()) {
+		// removed directories have left their destination behind
+		if (fs::is_directory(path, ec))
+			return false;
+		return fs::exists(path, ec) || !fs::exists(destination, ec);
+	}
+	return fs::is_regular_file(path, ec) && fs::exists(destination, ec) && refresh_meta(path);
+}
+
+/// Watches sources, static files, theme, plugins and the configuration, and
+/// generates the site again after changes, until interrupted.
+///
+/// Documents modified without changing their meta information are rendered
+/// on their own, like the build server does. Otherwise everything is collected
+/// again, only documents whose dependencies have changed are rendered again,
+/// see `dependencies`. The meta information of unchanged files is taken from
+/// the index.
+static void watch(const std::string & config_filename)
+{
+	install_stop_handler();
+
+	const auto config_path = fs::path{config_filename};
+	const auto config_name = config_path.filename().string();
+	const auto config_directory
+		= config_path.has_parent_path() ? config_path.parent_path().string() : std::string{"."};
+
+	watcher w;
+	auto add_watches = [&] {
+		w.add(system::cfg().get_source(), watch_source);
+		w.add(system::cfg().get_static(), watch_static);
+		w.add(fs::path{system::get_theme().get_template()}.parent_path().string(), watch_theme);
+		for (const auto & plugin : global.plugins)
+			w.add(system::get_plugin(plugin).get_path(), watch_plugins);
+		w.add(config_directory, watch_config, false);
+	};
+	add_watches();
+
+	std::cout << "watching for changes\n" << std::flush;
+	while (!stop_requested) {
+		int changed = 0;
+		std::set<std::string> sources; // changed paths within the source directory
+		try {
+			for (const auto & c : w.wait(std::chrono::milliseconds{100})) {
+				if (c.tag == watcher::overflow) {
+					changed = ~0;
+					continue;
+				}
+
+				// generated files are of no interest
+				if (is_within(c.path, system::cfg().get_destination())
+					|| is_within(c.path, global.state_directory))
+					continue;
+
+				auto tag = c.tag;
+				if ((tag & watch_config) && (fs::path{c.path}.filename() != config_name))
+					tag &= ~watch_config;
+				if (tag & watch_source)
+					sources.insert(c.path);
+				changed |= tag;
+			}
+		} catch (const std::exception & e) {
+			// e.g. a new directory not being watchable, keep watching the others
+			std::cerr << "error: " << e.what() << '\n';
+			continue;
+		}
+		if (!changed || stop_requested)
+			continue;
+
+		const auto t0 = std::chrono::steady_clock::now();
+		try {
+			if (changed & watch_config)
+				read_configuration(config_filename);
+
+			const auto collect = (changed & (watch_theme | watch_plugins | watch_config))
+				|| !std::all_of(begin(sources), end(sources), renders_alone);
+			if (!collect) {
+				std::vector<render_job> jobs;
+				for (const auto & path : sources) {
+					if (!convert_path(path).empty())
+						prepare_single(system::cfg().get_source(),
+							system::cfg().get_destination(), path, jobs);
+				}
+				render_documents(jobs);
+			} else if (changed & (watch_source | watch_theme | watch_plugins | watch_config)) {
+				const auto plugins = global.plugins;
+				collect_site();
+				generate_site();
+				if ((changed & (watch_plugins | watch_config)) || (global.plugins != plugins))
+					copy_plugins();
+			}
+			if (changed & (watch_static | watch_config))
+				process_copy_file();
+
+			// directories may have been configured differently, plugins added
+			add_watches();
+		} catch (const std::exception & e) {
+			std::cerr << "error: " << e.what() << '\n';
+		}
+		const auto t1 = std::chrono::steady_clock::now();
+		std::cout << fmt::sprintf("done in %.3f s, watching for changes\n",
+						 std::chrono::duration<double>(t1 - t0).count())
+				  << std::flush;
+	}
+}
+
+/// Redirects everything written to `std::cout` and `std::cerr` for its lifetime.
+class output_redirect
+{
+public:
+	output_redirect(std::ostream & os)
+		: out_(std::cout.rdbuf(os.rdbuf()))
+		, err_(std::cerr.rdbuf(os.rdbuf()))
+	{
+	}
+
+	~output_redirect()
+	{
+		std::cout.rdbuf(out_);
+		std::cerr.rdbuf(err_);
+	}
+
+	output_redirect(const output_redirect &) = delete;
+	output_redirect & operator=(const output_redirect &) = delete;
+
+private:
+	std::streambuf * out_;
+	std::streambuf * err_;
+};
+
+/// State of the build server, kept between requests.
+struct server_state {
+	std::string config_filename;
+	fs::file_time_type config_time;
+};
+
+/// Handles a request of a client, see `serve`.
+static void handle_request(
+	server_state & state, const nlohmann::json & request, nlohmann::json & response)
+{
+	using clock = std::chrono::steady_clock;
+	auto t = clock::now();
+	auto lap = [&](const char * phase) {
+		const auto now = clock::now();
+		response["timings"][phase] = std::chrono::duration<double, std::milli>(now - t).count();
+		t = now;
+	};
+
+	const auto command = request.value("command", std::string{});
+	const auto file = request.value("file", std::string{});
+
+	// theme and plugin files may have changed since the last request
+	forget_shared_files();
+
+	// everything depends on the configuration, it is read again after changes
+	const auto config_time = fs::last_write_time(state.config_filename);
+	if (config_time != state.config_time) {
+		read_configuration(state.config_filename);
+		collect_site();
+		state.config_time = config_time;
+		lap("config");
+	}
+
+	if (command == "build") {
+		collect_site();
+		lap("collect");
+		generate_site();
+		lap("generate");
+		process_copy_file();
+		copy_plugins();
+		lap("copy");
+	} else if (command == "render") {
+		if (file.empty())
+			throw std::runtime_error{"no file specified"};
+		if (!fs::exists(file))
+			throw std::runtime_error{"specified file does not exist: " + file};
+		if (fs::is_directory(file)) {
+			collect_site();
+			lap("collect");
+			process_pages(system::cfg().get_source(), system::cfg().get_destination(), file);
+		} else if (fs::is_regular_file(file)) {
+			if (!refresh_meta(file))
+				collect_site();
+			lap("collect");
+			process_single(system::cfg().get_source(), system::cfg().get_destination(), file);
+		} else {
+			throw std::runtime_error{"unable to process file type"};
+		}
+		lap("render");
+	} else if (command == "query") {
+		if (file.empty()) {
+			response["result"] = {{"documents", global.docs.size()},
+				{"tags", global.docs.num_tags()}, {"years", global.docs.years().size()},
+				{"plugins", global.plugins.size()}};
+		} else {
+			const auto doc = global.docs.find(file);
+			if (!doc)
+				throw std::runtime_error{"no meta information: " + file};
+			const auto meta = global.docs.meta(*doc);
+			response["result"] = {{"title", meta.title}, {"date", meta.date.str()},
+				{"authors", meta.authors}, {"tags", meta.tags}, {"language", meta.language},
+				{"summary", meta.summary}, {"plugins", meta.plugins}};
+		}
+	} else if (command == "shutdown") {
+		stop_requested = 1;
+	} else {
+		throw std::runtime_error{"unknown command: " + command};
+	}
+}
+
+/// Serves requests of clients on the socket, until asked to shut down or
+/// interrupted.
+///
+/// Requests and responses are JSON objects, one per line. A request contains
+/// the `command` (`build`, `render`, `query` or `shutdown`) and optionally
+/// a `file`, relative to the working directory of the server. The response
+/// contains whether the request succeeded (`ok`), an `error` message, the
+/// `output` written while handling the request, the `timings` of its phases
+/// in milliseconds and the `result` of a query.
+///
+/// Any number of clients may be connected, keeping their connections open
+/// between requests. Requests are handled one after another, clients in turn.
+/// The collected information is kept between requests, rendering a single
+/// document only reads the document itself again. Everything is collected
+/// again if the configuration or the meta information of the document has
+/// changed, and for `build`.
+static void serve(const std::string & socket_path, const std::string & config_filename)
+{
+	install_stop_handler();
+
+	socket_server server{socket_path};
+	server_state state{config_filename, fs::last_write_time(config_filename)};
+	std::cout << "listening on " << socket_path << '\n' << std::flush;
+
+	while (!stop_requested) {
+		const auto request = server.receive();
+		if (!request)
+			continue;
+
+		const auto t0 = std::chrono::steady_clock::now();
+
+		std::string command;
+		nlohmann::json response;
+		std::ostringstream output;
+		{
+			const output_redirect redirect{output};
+			try {
+				const auto message = nlohmann::json::parse(request->message);
+				command = message.value("command", std::string{});
+				handle_request(state, message, response);
+				response["ok"] = true;
+			} catch (const std::exception & e) {
+				response["ok"] = false;
+				response["error"] = e.what();
+			}
+		}
+
+		const auto total
+			= std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0)
+				  .count();
+		response["output"] = output.str();
+		response["timings"]["total"] = total;
+		std::cout << fmt::sprintf("%s: %.1f ms%s\n", command, total,
+						 response["ok"].get<bool>() ? "" : " (failed)")
+				  << std::flush;
+
+		// a client gone meanwhile does not concern the others
+		try {
+			request->client->send(response.dump());
+		} catch (const std::exception & e) {
+			std::cerr << "error: " << e.what() << '\n';
+		}
+	}
+}
+
+/// Sends a request to the build server and prints its response.
+///
+/// \return The exit code, `0` if the request succeeded.
+static int run_client(
+	const std::string & socket_path, const std::string & command, const std::string & file)
+{
+	auto connection = socket_connection::connect(socket_path);
+
+	nlohmann::json request{{"command", command}};
+	if (!file.empty())
+		request["file"] = file;
+	connection.send(request.dump());
+
+	std::string message;
+	if (!connection.receive(message))
+		throw std::runtime_error{"no response from server"};
+	const auto response = nlohmann::json::parse(message);
+
+	std::cout << response.value("output", std::string{});
+	if (response.count("result"))
+		std::cout << response["result"].dump(2) << '\n';
+	if (response.count("timings")) {
+		for (auto it = response["timings"].begin(); it != response["timings"].end(); ++it)
+			std::cout << fmt::sprintf("%-10s %8.1f ms\n", it.key(), it.value().get<double>());
+	}
+
+	if (!response.value("ok", false)) {
+		std::cerr << "error: " << response.value("error", std::string{}) << '\n';
+		return 1;
+	}
+	return 0;
+}
 }
 
 int main(int argc, char ** argv)
@@ -1128,8 +2875,22 @@ int main(int argc, char ** argv)
 	std::string config_filename = "config.yml";
 	std::string config_pandoc = "";
 	std::string config_file;
+	int config_jobs = 0;
+	int config_batch = 1;
+	bool config_single_pass = false;
+	bool config_native_pages = false;
+	std::string config_cache_dir;
+	bool config_cache_stats = false;
+	bool config_timings = false;
+	std::string config_profile;
+	std::string config_stats;
+	int config_stats_slowest = 10;
 	bool config_copy = false;
 	bool config_plugins = false;
+	bool config_watch = false;
+	bool config_serve = false;
+	std::string config_socket;
+	std::string config_client;
 
 	// clang-format off
 	cxxopts::Options options{argv[0], std::string{mkweb::project_name()} + " - Static Website Generator"};
@@ -1150,12 +2911,68 @@ int main(int argc, char ** argv)
 			"Specify a file or directory to process. This file or directory must be a "
 			"part of the configured source directory within the configuration file.",
 			cxxopts::value<std::string>(config_file))
+		("j,jobs",
+			"Number of documents to render in parallel. Defaults to the number of "
+			"available cores.",
+			cxxopts::value<int>(config_jobs))
+		("batch",
+			"Number of documents read by a single pandoc process. Larger batches "
+			"save process startups, at the cost of latency per document. "
+			"Defaults to 1 (no batching).",
+			cxxopts::value<int>(config_batch))
+		("single-pass",
+			"Renders each document with a single pandoc process, rewriting links "
+			"with a Lua filter. Requires pandoc 2.17 or newer.",
+			cxxopts::value<bool>(config_single_pass))
+		("native-pages",
+			"Renders generated pages (overviews, front page, sitemap) without pandoc, "
+			"filling the template of the theme natively. Titles are taken as plain text.",
+			cxxopts::value<bool>(config_native_pages))
+		("cache-dir",
+			"Directory of the render cache, enables the cache. Overrides the "
+			"configuration.",
+			cxxopts::value<std::string>(config_cache_dir))
+		("cache-stats",
+			"Shows statistics of the render cache of all runs.",
+			cxxopts::value<bool>(config_cache_stats))
+		("timings",
+			"Shows the durations of the phases of the build.",
+			cxxopts::value<bool>(config_timings))
+		("profile",
+			"Writes a profile of the build to the specified file: spans of phases, "
+			"documents and processes in the Chrome trace event format (chrome://tracing, "
+			"Perfetto).",
+			cxxopts::value<std::string>(config_profile))
+		("stats",
+			"Writes statistics of the build to the specified file as JSON: numbers of "
+			"pages rendered, skipped and ignored, pandoc processes, bytes piped, files "
+			"copied, latencies of rendering documents and the slowest documents.",
+			cxxopts::value<std::string>(config_stats))
+		("stats-slowest",
+			"Number of slowest documents listed by --stats. Defaults to 10.",
+			cxxopts::value<int>(config_stats_slowest))
 		("copy",
 			"Copies files from 'static' to 'destination'.",
 			cxxopts::value<bool>(config_copy))
 		("plugins",
 			"Copies plugin files.",
 			cxxopts::value<bool>(config_plugins))
+		("watch",
+			"Generates the site, then watches for changes and generates it again "
+			"until interrupted.",
+			cxxopts::value<bool>(config_watch))
+		("serve-socket",
+			"Runs as build server, keeping the collected information between requests "
+			"of clients on a Unix domain socket.",
+			cxxopts::value<bool>(config_serve))
+		("socket",
+			"Path of the socket of the build server. Defaults to 'server.sock' within "
+			"the state directory, next to the configuration file.",
+			cxxopts::value<std::string>(config_socket))
+		("client",
+			"Sends a request to the build server: build, render (--file), query "
+			"(optionally --file) or shutdown.",
+			cxxopts::value<std::string>(config_client))
 		;
 	// clang-format on
 
@@ -1179,6 +2996,13 @@ int main(int argc, char ** argv)
 		return 0;
 	}
 
+	global.state_directory = (fs::path{config_filename}.parent_path() / ".mkweb").string();
+	if (config_socket.empty())
+		config_socket = global.state_directory + "/server.sock";
+
+	if (!config_client.empty())
+		return run_client(config_socket, config_client, config_file);
+
 	// validation
 	if (!fs::exists(config_filename))
 		throw std::runtime_error{"config file not readable: " + config_filename};
@@ -1188,19 +3012,61 @@ int main(int argc, char ** argv)
 		system::set_pandoc(config_pandoc);
 	}
 
+	global.jobs = (config_jobs > 0) ? static_cast<std::size_t>(config_jobs)
+									: worker_pool::default_size();
+	global.batch_size = (config_batch > 0) ? static_cast<std::size_t>(config_batch) : 1u;
+
+	if (config_watch && !config_file.empty())
+		throw std::runtime_error{"--watch processes the entire site, it cannot be combined with --file"};
+	if (config_serve && (config_watch || !config_file.empty()))
+		throw std::runtime_error{"--serve-socket cannot be combined with --watch or --file"};
+
+	if (!config_profile.empty())
+		global.profile = std::make_unique<trace>();
+
 	// read configuration
-	system::reset(std::make_shared<config>(config_filename));
+	read_configuration(config_filename);
+
+	global.deps = std::make_unique<dependencies>(global.state_directory + "/deps.json");
+
+	const auto cache_config = system::cfg().get_cache();
+	if (!config_cache_dir.empty() || cache_config.enable) {
+		auto directory = config_cache_dir;
+		if (directory.empty())
+			directory = cache_config.directory.empty() ? global.state_directory + "/cache"
+													   : cache_config.directory;
+		const auto max_size = static_cast<std::uintmax_t>(std::max(cache_config.max_size, 0));
+		global.cache = std::make_unique<render_cache>(directory, max_size * 1024 * 1024);
+	}
+	if (config_cache_stats) {
+		if (!global.cache)
+			throw std::runtime_error{"render cache not enabled"};
+		print_cache_stats("cache (all runs)", global.cache->total_stats());
+		return 0;
+	}
+
+	std::unique_ptr<temp_directory> tmp;
+	if (config_single_pass) {
+		if (!system::pandoc_version_at_least(2, 17))
+			throw std::runtime_error{"single pass rendering requires pandoc 2.17 or newer"};
+		tmp = std::make_unique<temp_directory>();
+		global.mode = render_mode::single_pass;
+		global.link_filter = tmp->path() + "/links.lua";
+		write_link_filter(global.link_filter);
+	}
+	global.native_pages = config_native_pages;
 
 	// collect and prepare information
-	collect_information(system::cfg().get_source());
-	global.tag_list = prepare_global_tag_list(global.tags);
-	global.year_list = prepare_global_year_list(global.years);
-	global.page_list = prepare_global_pagelist(global.meta);
+	collect_site();
 
 	// generate site
-	if (!config_file.empty()) {
+	if (config_serve) {
+		fs::create_directories(global.state_directory);
+		serve(config_socket, config_filename);
+	} else if (!config_file.empty()) {
 		if (!fs::exists(config_file))
 			throw std::runtime_error{"specified file does not exist: " + config_file};
+		const phase_timer timer{"pages"};
 		if (fs::is_directory(config_file)) {
 			process_pages(
 				system::cfg().get_source(), system::cfg().get_destination(), config_file);
@@ -1211,12 +3077,7 @@ int main(int argc, char ** argv)
 			throw std::runtime_error{"unable to process file type"};
 		}
 	} else {
-		process_overview(global.tags, "tag", get_meta_tags());
-		process_overview(global.years, "year", get_meta_years());
-		process_pages(system::cfg().get_source(), system::cfg().get_destination());
-		process_front();
-		process_sitemap();
-		process_redirect(system::cfg().get_destination());
+		generate_site();
 		config_copy = true;
 		config_plugins = true;
 	}
@@ -1225,10 +3086,28 @@ int main(int argc, char ** argv)
 		process_copy_file();
 	}
 	if (config_plugins) {
-		std::cout << "copy plugins\n";
-		for (const auto & plugin : global.plugins)
-			copy_plugin_files(plugin);
+		copy_plugins();
+	}
+
+	if (config_watch) {
+		watch(config_filename);
+	}
+
+	if (global.cache) {
+		global.cache->finish();
+		print_cache_stats("cache", global.cache->stats());
 	}
 
+	if (config_timings) {
+		for (const auto & t : global.timings)
+			std::cout << fmt::sprintf("timing  %-10s %10.3f ms\n", t.first, t.second);
+	}
+
+	if (global.profile)
+		global.profile->write(config_profile);
+
+	if (!config_stats.empty())
+		write_stats(config_stats, static_cast<std::size_t>(std::max(config_stats_slowest, 0)));
+
 	return 0;
 }
@@ -0,0 +1,86 @@
+#include "path_resolver.hpp"
+#include <experimental/filesystem>
+
+namespace mkweb
+{
+namespace fs
+{
+using std::experimental::filesystem::path;
+}
+
+namespace
+{
+/// Appends a part to the path, the same way as `fs::path::operator/=`.
+void append_part(std::string & path, const char * part, std::size_t size)
+{
+	if (!path.empty() && (path.back() != '/'))
+		path += '/';
+	path.append(part, size);
+}
+}
+
+path_resolver::path_resolver(
+	const std::vector<config::path_map_entry> & entries, const std::string & site_url)
+{
+	for (const auto & entry : entries) {
+		roots_.emplace(entry.base, entry.absolute ? entry.url : site_url + entry.url);
+		if (entry.base == "/")
+			has_root_directory_ = true;
+	}
+}
+
+std::string path_resolver::resolve(const std::string & link) const
+{
+	// the root directory is a part on its own, those are rare enough to be decomposed
+	if (link.empty() || (link[0] == '/'))
+		return has_root_directory_ ? resolve_generic(link) : link;
+
+	// a link consisting of only one part is never replaced
+	const auto end_of_root = link.find('/');
+	if (end_of_root == std::string::npos)
+		return link;
+
+	const auto root = roots_.find(link.substr(0, end_of_root));
+	if (root == roots_.end())
+		return link;
+
+	// repeated separators are skipped, a trailing separator results in the part `.`
+	auto result = root->second;
+	const auto size = link.size();
+	auto i = end_of_root;
+	while (i < size) {
+		while ((i < size) && (link[i] == '/'))
+			++i;
+		if (i == size) {
+			append_part(result, ".", 1);
+			break;
+		}
+		auto end = link.find('/', i);
+		if (end == std::string::npos)
+			end = size;
+		append_part(result, link.data() + i, end - i);
+		i = end;
+	}
+	return result;
+}
+
+std::string path_resolver::resolve_generic(const std::string & link) const
+{
+	const fs::path p{link};
+	std::vector<std::string> parts{p.begin(), p.end()};
+
+	if (parts.size() < 2)
+		return link;
+
+	const auto root = roots_.find(parts[0]);
+	if (root == roots_.end())
+		return link;
+
+	parts[0] = root->second;
+
+	fs::path result;
+	for (const auto & part : parts)
+		result /= part;
+	return result.string();
+}
+}
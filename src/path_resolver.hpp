@@ -0,0 +1,41 @@
+#ifndef MKWEB__PATH_RESOLVER__HPP
+#define MKWEB__PATH_RESOLVER__HPP
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "config.hpp"
+
+namespace mkweb
+{
+/// Replaces the root of links according to the configured path map.
+///
+/// The path map is compiled into a lookup of the first path component,
+/// links are rewritten without being decomposed into all of their parts.
+/// The result is the same as decomposing the link with the filesystem
+/// library, replacing the first part and joining the parts again.
+///
+/// Resolving is thread safe, the resolver is not modified after construction.
+class path_resolver
+{
+public:
+	path_resolver() = default;
+
+	/// \param[in] entries The path map, the first entry of a base takes precedence.
+	/// \param[in] site_url Prepended to URLs of entries not being absolute.
+	path_resolver(const std::vector<config::path_map_entry> & entries,
+		const std::string & site_url);
+
+	/// Returns the link with its root replaced, or the unchanged link if
+	/// its root is not part of the path map.
+	std::string resolve(const std::string & link) const;
+
+private:
+	std::unordered_map<std::string, std::string> roots_; // base -> replacement
+	bool has_root_directory_ = false; // the map contains the base `/`
+
+	std::string resolve_generic(const std::string & link) const;
+};
+}
+
+#endif
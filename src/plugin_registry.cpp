@@ -0,0 +1,61 @@
+#include "plugin_registry.hpp"
+#include <yaml-cpp/yaml.h>
+#include "config.hpp"
+#include "system.hpp"
+
+namespace mkweb
+{
+namespace
+{
+/// Returns the entries of a list within the manifest.
+std::vector<std::string> get_list(const YAML::Node & node)
+{
+	std::vector<std::string> result;
+	for (const auto & entry : node)
+		result.push_back(entry.as<std::string>());
+	return result;
+}
+
+/// Returns a string containing a HTML script element to load the specified file.
+std::string make_script_string(const std::string & plugin, const std::string & filename)
+{
+	return "<script type=\"text/javascript\" src=\"" + system::cfg().get_plugin_url(plugin)
+		+ filename + "\"></script>";
+}
+}
+
+std::unique_ptr<plugin_registry::entry> plugin_registry::load(const std::string & name)
+{
+	const auto plg = system::get_plugin(name);
+	const auto manifest = YAML::LoadFile(plg.get_config());
+
+	auto e = std::make_unique<entry>();
+	e->name = name;
+	e->path = plg.get_path();
+	e->style = plg.get_style();
+	if (manifest["include"])
+		e->include = get_list(manifest["include"]);
+	if (manifest && manifest["install"])
+		e->install = get_list(manifest["install"]);
+
+	for (const auto & filename : e->include)
+		e->header += make_script_string(name, filename);
+
+	return e;
+}
+
+const plugin_registry::entry & plugin_registry::get(const std::string & name)
+{
+	std::lock_guard<std::mutex> lock{mtx_};
+	auto & e = entries_[name];
+	if (!e)
+		e = load(name);
+	return *e;
+}
+
+void plugin_registry::clear()
+{
+	std::lock_guard<std::mutex> lock{mtx_};
+	entries_.clear();
+}
+}
@@ -0,0 +1,51 @@
+#ifndef MKWEB__PLUGIN_REGISTRY__HPP
+#define MKWEB__PLUGIN_REGISTRY__HPP
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <experimental/optional>
+
+namespace mkweb
+{
+/// Plugins used by documents, each one with its manifest (`files.yml`)
+/// loaded once and everything derived from it prepared in advance.
+///
+/// Looking up plugins is thread safe. Entries stay valid until the registry
+/// is cleared.
+class plugin_registry
+{
+public:
+	struct entry {
+		std::string name;
+		std::string path; ///< directory of the plugin, with trailing separator
+		std::string style; ///< file to include into the HTML head section
+		std::string header; ///< script elements for all files to include
+		std::vector<std::string> include; ///< files to load by the document
+		std::experimental::optional<std::vector<std::string>> install; ///< files to copy
+	};
+
+	plugin_registry() = default;
+
+	plugin_registry(const plugin_registry &) = delete;
+	plugin_registry & operator=(const plugin_registry &) = delete;
+
+	/// Returns the plugin, its manifest is loaded at the first lookup.
+	///
+	/// \exception YAML::Exception The manifest is missing or not readable.
+	const entry & get(const std::string & name);
+
+	/// Forgets about all plugins, manifests are loaded again.
+	void clear();
+
+private:
+	std::unordered_map<std::string, std::unique_ptr<entry>> entries_;
+	std::mutex mtx_;
+
+	static std::unique_ptr<entry> load(const std::string & name);
+};
+}
+
+#endif
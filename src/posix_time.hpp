@@ -1,6 +1,9 @@
 #ifndef MKWEB__POSIX_TIME__HPP
 #define MKWEB__POSIX_TIME__HPP
 
+#include <cstdint>
+#include <cstring>
+#include <string>
 #include <tuple>
 #include <ctime>
 
@@ -35,6 +38,32 @@ public:
 		return t;
 	}
 
+	/// Counterpart of the accessors, all values are interpreted as returned by them.
+	static posix_time from_fields(uint32_t year, uint32_t month, uint32_t day, uint32_t hour,
+		uint32_t minute, uint32_t second)
+	{
+		posix_time t;
+		t.t.tm_year = static_cast<int>(year) - 1900;
+		t.t.tm_mon = static_cast<int>(month);
+		t.t.tm_mday = static_cast<int>(day);
+		t.t.tm_hour = static_cast<int>(hour);
+		t.t.tm_min = static_cast<int>(minute);
+		t.t.tm_sec = static_cast<int>(second);
+		return t;
+	}
+
+	/// Returns an integer ordering the same as the fields do, also for dates
+	/// not within the calendar (e.g. `2020-02-30`), which are kept as they are.
+	std::int64_t key() const
+	{
+		std::int64_t k = t.tm_year;
+		k = k * 16 + t.tm_mon;
+		k = k * 32 + t.tm_mday;
+		k = k * 32 + t.tm_hour;
+		k = k * 64 + t.tm_min;
+		return k * 64 + t.tm_sec;
+	}
+
 	std::string str() const
 	{
 		char buf[32];
@@ -0,0 +1,532 @@
+#include "process_executor.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <system_error>
+#include <fcntl.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char ** environ;
+
+namespace mkweb
+{
+namespace
+{
+enum channel_type { IN = 0, OUT = 1, ERR = 2, PID = 3 };
+
+constexpr std::size_t read_size = 64 * 1024;
+
+[[noreturn]] void throw_errno()
+{
+	throw std::system_error(errno, std::system_category());
+}
+
+int pidfd_open(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+	return static_cast<int>(::syscall(SYS_pidfd_open, pid, 0));
+#else
+	(void)pid;
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+void set_nonblocking(int fd)
+{
+	const auto flags = ::fcntl(fd, F_GETFL);
+	if ((flags == -1) || (::fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1))
+		throw_errno();
+}
+
+/// Writes to a pipe, without being terminated by SIGPIPE if the child has
+/// closed its input. The signal is blocked on this thread and discarded.
+ssize_t write_nosignal(int fd, const char * data, std::size_t size)
+{
+	sigset_t pipe_set;
+	sigset_t old_set;
+	sigemptyset(&pipe_set);
+	sigaddset(&pipe_set, SIGPIPE);
+	::pthread_sigmask(SIG_BLOCK, &pipe_set, &old_set);
+
+	const auto n = ::write(fd, data, size);
+	const auto error = errno;
+	if ((n < 0) && (error == EPIPE) && !sigismember(&old_set, SIGPIPE)) {
+		const timespec zero{0, 0};
+		::sigtimedwait(&pipe_set, nullptr, &zero);
+	}
+
+	::pthread_sigmask(SIG_SETMASK, &old_set, nullptr);
+	errno = error;
+	return n;
+}
+}
+
+/// A running child, its descriptors are indexed by `channel_type`.
+struct process_executor::process {
+	/// Identifies a descriptor of a process within epoll events.
+	struct endpoint {
+		process * owner;
+		int channel;
+	};
+
+	pid_t pid = -1;
+	int fds[4] = {-1, -1, -1, -1};
+	bool watched[4] = {false, false, false, false};
+	endpoint endpoints[4];
+	std::string input;
+	std::size_t written = 0;
+	bool input_open = false; // more input is passed on by the upstream process
+	bool exited = false;
+	result res;
+	completion done;
+
+	// connected processes, linked while both are running
+	process * upstream = nullptr;
+	process * downstream = nullptr;
+	pass_function pass; // set if the output is passed on
+	bool passing = true; // otherwise the output is discarded
+
+	process()
+	{
+		for (int channel = IN; channel <= PID; ++channel)
+			endpoints[channel] = {this, channel};
+	}
+
+	~process()
+	{
+		for (auto & fd : fds) {
+			if (fd >= 0)
+				::close(fd);
+		}
+	}
+
+	process(const process &) = delete;
+	process & operator=(const process &) = delete;
+};
+
+process_executor::process_executor(std::size_t max_running)
+	: max_running_(std::max<std::size_t>(max_running, 1))
+	, epfd_(::epoll_create1(EPOLL_CLOEXEC))
+{
+	if (epfd_ == -1)
+		throw_errno();
+}
+
+process_executor::~process_executor()
+{
+	for (const auto & p : running_) {
+		if (p->exited)
+			continue;
+		::kill(p->pid, SIGKILL);
+		while ((::waitpid(p->pid, nullptr, 0) == -1) && (errno == EINTR))
+			;
+	}
+	running_.clear();
+	::close(epfd_);
+}
+
+void process_executor::submit(std::vector<std::string> args, std::string input, completion done)
+{
+	task t;
+	t.args = std::move(args);
+	t.input = std::move(input);
+	t.done = std::move(done);
+	queue_.push_back(std::move(t));
+	start_queued();
+}
+
+std::future<process_executor::result> process_executor::submit(
+	std::vector<std::string> args, std::string input)
+{
+	auto promise = std::make_shared<std::promise<result>>();
+	auto future = promise->get_future();
+	submit(std::move(args), std::move(input),
+		[promise](result && r) { promise->set_value(std::move(r)); });
+	return future;
+}
+
+void process_executor::submit_pipe(std::vector<std::string> first, std::string input, filter f,
+	std::vector<std::string> second, pipe_completion done)
+{
+	// both results are delivered together, after the second one
+	struct pipe_state {
+		pipe_result res;
+		pipe_completion done;
+		int remaining = 2;
+	};
+	auto state = std::make_shared<pipe_state>();
+	state->done = std::move(done);
+	auto complete = [state] {
+		if (--state->remaining == 0)
+			state->done(std::move(state->res));
+	};
+
+	task t;
+	t.args = std::move(first);
+	t.input = std::move(input);
+	t.done = [state, complete](result && r) {
+		state->res.first = std::move(r);
+		complete();
+	};
+	t.next_args = std::move(second);
+	t.pass = [state, f](const char * data, std::size_t size, bool end, std::string & out) {
+		try {
+			f(data, size, end, out);
+			return true;
+		} catch (const std::exception & e) {
+			state->res.filter_error = e.what();
+			return false;
+		}
+	};
+	t.next_done = [state, complete](result && r) {
+		state->res.second = std::move(r);
+		complete();
+	};
+	queue_.push_back(std::move(t));
+	start_queued();
+}
+
+void process_executor::start_queued()
+{
+	while (!queue_.empty() && (slots_ < max_running_)) {
+		auto t = std::move(queue_.front());
+		queue_.pop_front();
+		try {
+			start(t);
+		} catch (const std::system_error & e) {
+			fail(std::move(t.done), e.what());
+			if (t.next_done)
+				fail(std::move(t.next_done), e.what());
+		}
+	}
+}
+
+void process_executor::fail(completion done, const std::string & reason)
+{
+	// completes like a process which failed
+	auto p = std::make_unique<process>();
+	p->exited = true;
+	p->res.errors = reason;
+	p->res.started = p->res.terminated = std::chrono::steady_clock::now();
+	p->done = std::move(done);
+	finished_.push_back(std::move(p));
+}
+
+void process_executor::start(task & t)
+{
+	if (t.next_args.empty()) {
+		auto & p = spawn(t.args);
+		p.input = std::move(t.input);
+		p.done = std::move(t.done);
+		++slots_;
+		end_input(p);
+		return;
+	}
+
+	// the second process is started first, it waits for its input
+	auto & second = spawn(t.next_args);
+	second.done = std::move(t.next_done);
+	second.input_open = true;
+	++slots_;
+
+	process * first = nullptr;
+	try {
+		first = &spawn(t.args);
+	} catch (const std::system_error & e) {
+		end_input(second);
+		fail(std::move(t.done), e.what());
+		return;
+	}
+	first->input = std::move(t.input);
+	first->done = std::move(t.done);
+	first->pass = std::move(t.pass);
+	first->downstream = &second;
+	second.upstream = first;
+	end_input(*first);
+}
+
+process_executor::process & process_executor::spawn(std::vector<std::string> & args)
+{
+	auto p = std::make_unique<process>();
+
+	// pipes are not inherited by other children, the ends of the child are
+	// duplicated onto its standard streams, which clears the flag for them
+	int pipes[3][2] = {{-1, -1}, {-1, -1}, {-1, -1}};
+	auto close_pipes = [&pipes] {
+		for (auto & pipe : pipes) {
+			for (auto & fd : pipe) {
+				if (fd >= 0)
+					::close(fd);
+				fd = -1;
+			}
+		}
+	};
+	for (auto & pipe : pipes) {
+		if (::pipe2(pipe, O_CLOEXEC) == -1) {
+			const auto error = errno;
+			close_pipes();
+			throw std::system_error(error, std::system_category());
+		}
+	}
+
+	std::vector<char *> argv;
+	for (auto & arg : args)
+		argv.push_back(&arg[0]);
+	argv.push_back(nullptr);
+
+	posix_spawn_file_actions_t actions;
+	::posix_spawn_file_actions_init(&actions);
+	::posix_spawn_file_actions_adddup2(&actions, pipes[IN][0], STDIN_FILENO);
+	::posix_spawn_file_actions_adddup2(&actions, pipes[OUT][1], STDOUT_FILENO);
+	::posix_spawn_file_actions_adddup2(&actions, pipes[ERR][1], STDERR_FILENO);
+
+	const auto rc = ::posix_spawnp(&p->pid, argv[0], &actions, nullptr, argv.data(), environ);
+	::posix_spawn_file_actions_destroy(&actions);
+	if (rc != 0) {
+		close_pipes();
+		throw std::system_error(rc, std::system_category());
+	}
+
+	p->res.started = std::chrono::steady_clock::now();
+
+	// the parent keeps its ends only
+	::close(pipes[IN][0]);
+	::close(pipes[OUT][1]);
+	::close(pipes[ERR][1]);
+	p->fds[IN] = pipes[IN][1];
+	p->fds[OUT] = pipes[OUT][0];
+	p->fds[ERR] = pipes[ERR][0];
+	p->fds[PID] = pidfd_open(p->pid);
+
+	auto & proc = *p;
+	running_.push_back(std::move(p));
+
+	for (int channel = IN; channel <= ERR; ++channel)
+		set_nonblocking(proc.fds[channel]);
+	watch(proc, OUT, EPOLLIN);
+	watch(proc, ERR, EPOLLIN);
+	watch(proc, PID, EPOLLIN);
+	return proc;
+}
+
+void process_executor::watch(process & p, int channel, unsigned int events)
+{
+	if ((p.fds[channel] < 0) || p.watched[channel])
+		return;
+	epoll_event ev{};
+	ev.events = events;
+	ev.data.ptr = &p.endpoints[channel];
+	if (::epoll_ctl(epfd_, EPOLL_CTL_ADD, p.fds[channel], &ev) == -1)
+		throw_errno();
+	p.watched[channel] = true;
+}
+
+void process_executor::unwatch(process & p, int channel)
+{
+	if (!p.watched[channel])
+		return;
+	::epoll_ctl(epfd_, EPOLL_CTL_DEL, p.fds[channel], nullptr);
+	p.watched[channel] = false;
+}
+
+void process_executor::close_channel(process & p, int channel)
+{
+	auto & fd = p.fds[channel];
+	if (fd < 0)
+		return;
+	unwatch(p, channel);
+	::close(fd);
+	fd = -1;
+}
+
+void process_executor::end_input(process & p)
+{
+	p.input_open = false;
+	if (p.written < p.input.size()) {
+		watch(p, IN, EPOLLOUT);
+	} else {
+		close_channel(p, IN);
+		std::string{}.swap(p.input);
+	}
+}
+
+void process_executor::pass_on(process & p, const char * data, std::size_t size, bool end)
+{
+	auto * d = p.downstream;
+	if (!d || !p.passing || !d->input_open)
+		return; // discarded
+
+	// only the part not written yet is kept
+	d->input.erase(0, d->written);
+	d->written = 0;
+	if (!p.pass(data, size, end, d->input)) {
+		p.passing = false;
+		end = true;
+	}
+
+	if (end) {
+		end_input(*d);
+		return;
+	}
+	if (!d->input.empty())
+		watch(*d, IN, EPOLLOUT);
+	if (d->input.size() >= read_size)
+		unwatch(p, OUT); // until the downstream process caught up
+}
+
+void process_executor::resume(process * p)
+{
+	if (!p || (p->fds[OUT] < 0))
+		return;
+	const auto * d = p->downstream;
+	if (!d || !p->passing || !d->input_open || (d->input.size() - d->written < read_size))
+		watch(*p, OUT, EPOLLIN);
+}
+
+void process_executor::handle(process & p, int channel)
+{
+	switch (channel) {
+		case IN: {
+			const auto n = write_nosignal(p.fds[IN], p.input.data() + p.written,
+				p.input.size() - p.written);
+			if (n >= 0) {
+				p.written += static_cast<std::size_t>(n);
+			} else if ((errno != EAGAIN) && (errno != EINTR)) {
+				// child does not read its input anymore
+				p.written = p.input.size();
+				p.input_open = false;
+			}
+			if (p.written >= p.input.size()) {
+				std::string{}.swap(p.input);
+				p.written = 0;
+				if (p.input_open) {
+					unwatch(p, IN); // until more is passed on
+				} else {
+					close_channel(p, IN);
+				}
+			}
+			resume(p.upstream);
+			break;
+		}
+
+		case OUT:
+			if (p.pass) {
+				buffer_.resize(read_size);
+				const auto n = ::read(p.fds[OUT], buffer_.data(), read_size);
+				if (n > 0) {
+					pass_on(p, buffer_.data(), static_cast<std::size_t>(n), false);
+				} else if ((n == 0) || ((errno != EAGAIN) && (errno != EINTR))) {
+					close_channel(p, OUT);
+					pass_on(p, nullptr, 0, true);
+				}
+				break;
+			}
+			[[fallthrough]];
+		case ERR: {
+			auto & s = (channel == OUT) ? p.res.output : p.res.errors;
+			const auto size = s.size();
+			s.resize(size + read_size);
+			const auto n = ::read(p.fds[channel], &s[size], read_size);
+			s.resize(size + static_cast<std::size_t>(std::max<ssize_t>(n, 0)));
+			if ((n == 0) || ((n < 0) && (errno != EAGAIN) && (errno != EINTR)))
+				close_channel(p, channel);
+			break;
+		}
+
+		case PID: {
+			int status = 0;
+			const auto rc = ::waitpid(p.pid, &status, WNOHANG);
+			if (rc == p.pid) {
+				p.exited = true;
+				p.res.exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+				close_channel(p, PID);
+			} else if ((rc == -1) && (errno != EINTR)) {
+				p.exited = true;
+				close_channel(p, PID);
+			}
+			break;
+		}
+	}
+
+	finish_if_done(p);
+}
+
+void process_executor::finish_if_done(process & p)
+{
+	if ((p.fds[OUT] >= 0) || (p.fds[ERR] >= 0))
+		return;
+
+	if (!p.exited) {
+		if (p.fds[PID] >= 0)
+			return; // termination is reported through the pidfd
+
+		// no pidfd: the child closed its output, it is about to terminate
+		int status = 0;
+		while ((::waitpid(p.pid, &status, 0) == -1) && (errno == EINTR))
+			;
+		p.exited = true;
+		p.res.exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+	}
+	close_channel(p, IN);
+	p.res.terminated = std::chrono::steady_clock::now();
+
+	// connected processes take one slot, it is freed as the second one finishes
+	if (p.upstream) {
+		p.upstream->downstream = nullptr;
+		resume(p.upstream); // its remaining output is discarded
+		p.upstream = nullptr;
+	} else if (p.downstream) {
+		p.downstream->upstream = nullptr;
+		p.downstream = nullptr;
+	} else {
+		--slots_;
+	}
+
+	// completions are delivered after all events at hand are handled
+	const auto i = std::find_if(begin(running_), end(running_),
+		[&p](const std::unique_ptr<process> & q) { return q.get() == &p; });
+	finished_.push_back(std::move(*i));
+	running_.erase(i);
+}
+
+void process_executor::run()
+{
+	std::vector<epoll_event> events(64);
+
+	for (;;) {
+		start_queued();
+
+		if (!finished_.empty()) {
+			// callbacks may submit processes, the list may grow meanwhile
+			auto finished = std::move(finished_);
+			finished_.clear();
+			for (auto & p : finished)
+				p->done(std::move(p->res));
+			continue;
+		}
+
+		if (running_.empty())
+			return;
+
+		const auto n = ::epoll_wait(epfd_, events.data(), static_cast<int>(events.size()), -1);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			throw_errno();
+		}
+
+		// processes finishing meanwhile are kept until all events are handled
+		for (int i = 0; i < n; ++i) {
+			const auto & ep = *static_cast<process::endpoint *>(events[i].data.ptr);
+			if (ep.owner->watched[ep.channel])
+				handle(*ep.owner, ep.channel);
+		}
+	}
+}
+}
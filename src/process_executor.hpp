@@ -0,0 +1,142 @@
+#ifndef MKWEB__PROCESS_EXECUTOR__HPP
+#define MKWEB__PROCESS_EXECUTOR__HPP
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace mkweb
+{
+/// Runs many child processes at once, driven by a single thread.
+///
+/// The pipes of all children and their termination are watched with one
+/// `epoll` instance, termination through a `pidfd` (Linux 5.3 and newer,
+/// otherwise the child is reaped after it closed its output). Children
+/// beyond the limit of running processes are queued and started as others
+/// terminate.
+///
+/// Two processes may be connected, the output of the first streamed through
+/// a filter into the input of the second, see `submit_pipe`. Reading the
+/// output of the first is paused while the second has not consumed its input,
+/// only a few blocks of data are held in between.
+///
+/// Completions are delivered on the thread calling `run`, either to a
+/// callback or through a future. Callbacks may submit further processes,
+/// they must not throw.
+///
+/// \note This class is not thread safe, submitting and running has to
+///       happen on the same thread.
+class process_executor
+{
+public:
+	struct result {
+		int exit_code = -1; ///< exit code, `-1` if terminated by a signal
+		std::string output; ///< everything written to stdout
+		std::string errors; ///< everything written to stderr
+		std::chrono::steady_clock::time_point started; ///< when the child was spawned
+		std::chrono::steady_clock::time_point terminated; ///< when it was found terminated
+	};
+
+	using completion = std::function<void(result &&)>;
+
+	/// Results of two connected processes, see `submit_pipe`.
+	struct pipe_result {
+		result first; ///< its output is empty, it was passed on
+		result second;
+		std::string filter_error; ///< the filter failed, the input of the second is incomplete
+	};
+
+	using pipe_completion = std::function<void(pipe_result &&)>;
+
+	/// Passes output of the first process on to the second one. Called with
+	/// each block of output, then once with `end` set after the output has
+	/// been closed. The input of the second process is appended to `out`.
+	/// Throws if the output cannot be passed on.
+	using filter
+		= std::function<void(const char * data, std::size_t size, bool end, std::string & out)>;
+
+	/// \param[in] max_running Maximum number of children running at the same time.
+	explicit process_executor(std::size_t max_running);
+
+	/// Children still running are killed.
+	~process_executor();
+
+	process_executor(const process_executor &) = delete;
+	process_executor & operator=(const process_executor &) = delete;
+
+	/// Submits a process. It is started as soon as the limit of running
+	/// processes allows, by `run` at the latest. A process which cannot be
+	/// started completes with exit code `-1` and the reason as `errors`.
+	///
+	/// \param[in] args The command and its parameters.
+	/// \param[in] input Written to stdin of the child, which is closed afterwards.
+	/// \param[in] done Called with the result after the child has terminated.
+	void submit(std::vector<std::string> args, std::string input, completion done);
+
+	/// Submits a process, the result is delivered through the future.
+	std::future<result> submit(std::vector<std::string> args, std::string input = {});
+
+	/// Submits two processes running at the same time, the output of the first
+	/// is streamed through the filter into the input of the second. Both take
+	/// the place of a single process regarding the limit of running processes.
+	///
+	/// Should the filter fail, the input of the second process is closed and
+	/// the remaining output of the first one is discarded.
+	///
+	/// \param[in] first The command reading, and its parameters.
+	/// \param[in] input Written to stdin of the first process.
+	/// \param[in] f Turns output of the first process into input of the second.
+	/// \param[in] second The command writing, and its parameters.
+	/// \param[in] done Called with both results after both have terminated.
+	void submit_pipe(std::vector<std::string> first, std::string input, filter f,
+		std::vector<std::string> second, pipe_completion done);
+
+	/// Runs until all submitted processes, including the ones submitted by
+	/// callbacks, have terminated and their completions have been delivered.
+	void run();
+
+private:
+	/// Returns `false` if the output cannot be passed on, see `filter`.
+	using pass_function = std::function<bool(const char *, std::size_t, bool, std::string &)>;
+
+	struct task {
+		std::vector<std::string> args;
+		std::string input;
+		completion done;
+
+		// a second process, reading the output of the first one passed on
+		std::vector<std::string> next_args;
+		pass_function pass;
+		completion next_done;
+	};
+
+	struct process;
+
+	const std::size_t max_running_;
+	std::size_t slots_ = 0; // taken by running processes, connected ones take one
+	int epfd_ = -1;
+	std::deque<task> queue_;
+	std::vector<std::unique_ptr<process>> running_;
+	std::vector<std::unique_ptr<process>> finished_;
+	std::vector<char> buffer_;
+
+	void start_queued();
+	void start(task & t);
+	process & spawn(std::vector<std::string> & args);
+	void fail(completion done, const std::string & reason);
+	void handle(process & p, int channel);
+	void pass_on(process & p, const char * data, std::size_t size, bool end);
+	void end_input(process & p);
+	void resume(process * p);
+	void finish_if_done(process & p);
+	void watch(process & p, int channel, unsigned int events);
+	void unwatch(process & p, int channel);
+	void close_channel(process & p, int channel);
+};
+}
+
+#endif
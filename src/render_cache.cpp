@@ -0,0 +1,252 @@
+#include "render_cache.hpp"
+#include "hash.hpp"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <system_error>
+#include <tuple>
+#include <vector>
+#include <experimental/filesystem>
+#include <nlohmann/json.hpp>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+namespace mkweb
+{
+namespace fs
+{
+using path = std::experimental::filesystem::path;
+using copy_options = std::experimental::filesystem::copy_options;
+using file_time_type = std::experimental::filesystem::file_time_type;
+using recursive_directory_iterator
+	= std::experimental::filesystem::recursive_directory_iterator;
+using std::experimental::filesystem::copy_file;
+using std::experimental::filesystem::create_directories;
+using std::experimental::filesystem::file_size;
+using std::experimental::filesystem::is_regular_file;
+using std::experimental::filesystem::last_write_time;
+using std::experimental::filesystem::remove;
+using std::experimental::filesystem::rename;
+}
+
+namespace
+{
+/// Exclusive lock of a file, shared between processes.
+class file_lock
+{
+public:
+	file_lock(const std::string & filename)
+		: fd_(::open(filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644))
+	{
+		if (fd_ == -1)
+			throw std::system_error(errno, std::system_category());
+		while (::flock(fd_, LOCK_EX) == -1) {
+			if (errno != EINTR) {
+				::close(fd_);
+				throw std::system_error(errno, std::system_category());
+			}
+		}
+	}
+
+	~file_lock() { ::close(fd_); } // releases the lock
+
+	file_lock(const file_lock &) = delete;
+	file_lock & operator=(const file_lock &) = delete;
+
+private:
+	int fd_;
+};
+
+/// Returns a name unique among all threads and processes.
+std::string unique_name()
+{
+	static std::atomic<unsigned long> counter{0};
+	return std::to_string(::getpid()) + '-' + std::to_string(++counter);
+}
+
+render_cache::statistics read_stats(const std::string & filename)
+{
+	render_cache::statistics s;
+	std::ifstream ifs{filename.c_str()};
+	if (!ifs)
+		return s;
+	const auto data = nlohmann::json::parse(ifs, nullptr, false);
+	if (!data.is_object())
+		return s;
+	s.hits = data.value("hits", std::uintmax_t{0});
+	s.misses = data.value("misses", std::uintmax_t{0});
+	s.stores = data.value("stores", std::uintmax_t{0});
+	s.evictions = data.value("evictions", std::uintmax_t{0});
+	return s;
+}
+}
+
+render_cache::render_cache(const std::string & directory, std::uintmax_t max_size)
+	: directory_(directory)
+	, max_size_(max_size)
+{
+	fs::create_directories(directory_ + "/objects");
+	fs::create_directories(directory_ + "/tmp");
+}
+
+std::string render_cache::file_hash(const std::string & path)
+{
+	// files may change while running (watching, serving), hashes are valid for a status only
+	std::error_code ec;
+	const auto mtime = fs::last_write_time(path, ec).time_since_epoch().count();
+	const auto size = fs::file_size(path, ec);
+	{
+		std::lock_guard<std::mutex> lock{mtx_};
+		const auto i = file_hashes_.find(path);
+		if ((i != file_hashes_.end()) && (i->second.mtime == mtime) && (i->second.size == size))
+			return i->second.hash;
+	}
+
+	sha256 h;
+	std::ifstream ifs{path.c_str(), std::ios::binary};
+	std::vector<char> buf(64 * 1024);
+	while (ifs) {
+		ifs.read(buf.data(), buf.size());
+		h.update(buf.data(), static_cast<std::size_t>(ifs.gcount()));
+	}
+	const auto result = h.str();
+
+	std::lock_guard<std::mutex> lock{mtx_};
+	file_hashes_[path] = {mtime, size, result};
+	return result;
+}
+
+std::string render_cache::object_path(const std::string & key) const
+{
+	return directory_ + "/objects/" + key.substr(0, 2) + '/' + key.substr(2);
+}
+
+/// Returns a filename unique among all threads and processes.
+std::string render_cache::temp_path() const
+{
+	return directory_ + "/tmp/" + unique_name();
+}
+
+bool render_cache::restore(const std::string & key, const std::string & filename_out)
+{
+	const auto object = object_path(key);
+	// next to the destination to be renamed, concurrent builds may restore it as well
+	const auto tmp = filename_out + ".tmp." + unique_name();
+
+	// the object may be evicted by another process any time, which is a miss
+	std::error_code ec;
+	fs::copy_file(object, tmp, fs::copy_options::overwrite_existing, ec);
+	if (!ec)
+		fs::rename(tmp, filename_out, ec);
+	if (ec) {
+		fs::remove(tmp, ec);
+		std::lock_guard<std::mutex> lock{mtx_};
+		++stats_.misses;
+		return false;
+	}
+
+	// recently used objects are evicted last
+	fs::last_write_time(object, fs::file_time_type::clock::now(), ec);
+
+	std::lock_guard<std::mutex> lock{mtx_};
+	++stats_.hits;
+	return true;
+}
+
+void render_cache::store(const std::string & key, const std::string & filename_out)
+{
+	const auto object = object_path(key);
+	const auto tmp = temp_path();
+
+	// failing to store a document does not affect the result
+	std::error_code ec;
+	fs::create_directories(fs::path{object}.parent_path(), ec);
+	fs::copy_file(filename_out, tmp, fs::copy_options::overwrite_existing, ec);
+	if (!ec)
+		fs::rename(tmp, object, ec);
+	if (ec) {
+		fs::remove(tmp, ec);
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock{mtx_};
+	++stats_.stores;
+}
+
+/// Removes the least recently used objects, until the cache is below 90% of
+/// its maximum size. Not doing so would evict objects with every run.
+std::uintmax_t render_cache::evict()
+{
+	std::vector<std::tuple<fs::file_time_type, std::uintmax_t, fs::path>> objects;
+	std::uintmax_t total = 0;
+
+	std::error_code ec;
+	for (const auto & entry : fs::recursive_directory_iterator{directory_ + "/objects", ec}) {
+		if (!fs::is_regular_file(entry.path(), ec))
+			continue;
+		const auto size = fs::file_size(entry.path(), ec);
+		if (ec)
+			continue;
+		objects.emplace_back(fs::last_write_time(entry.path(), ec), size, entry.path());
+		total += size;
+	}
+	if (total <= max_size_)
+		return 0;
+
+	std::sort(begin(objects), end(objects));
+
+	std::uintmax_t count = 0;
+	const auto limit = max_size_ / 10 * 9;
+	for (const auto & object : objects) {
+		if (total <= limit)
+			break;
+		if (fs::remove(std::get<2>(object), ec)) {
+			total -= std::get<1>(object);
+			++count;
+		}
+	}
+	return count;
+}
+
+void render_cache::finish()
+{
+	file_lock cache_lock{directory_ + "/lock"};
+
+	statistics s = stats();
+	if (max_size_ > 0)
+		s.evictions = evict();
+
+	{
+		std::lock_guard<std::mutex> lock{mtx_};
+		stats_.evictions += s.evictions;
+	}
+
+	auto total = read_stats(directory_ + "/stats.json");
+	total.hits += s.hits;
+	total.misses += s.misses;
+	total.stores += s.stores;
+	total.evictions += s.evictions;
+
+	const nlohmann::json data = {{"hits", total.hits}, {"misses", total.misses},
+		{"stores", total.stores}, {"evictions", total.evictions}};
+
+	const auto tmp = temp_path();
+	{
+		std::ofstream ofs{tmp.c_str()};
+		ofs << data.dump() << '\n';
+	}
+	fs::rename(tmp, directory_ + "/stats.json");
+}
+
+render_cache::statistics render_cache::stats() const
+{
+	std::lock_guard<std::mutex> lock{mtx_};
+	return stats_;
+}
+
+render_cache::statistics render_cache::total_stats() const
+{
+	return read_stats(directory_ + "/stats.json");
+}
+}
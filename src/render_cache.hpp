@@ -0,0 +1,81 @@
+#ifndef MKWEB__RENDER_CACHE__HPP
+#define MKWEB__RENDER_CACHE__HPP
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace mkweb
+{
+/// Content addressed cache of rendered documents, similar to `ccache`.
+///
+/// Documents are stored under a key, which must be derived from everything the
+/// rendering depends on. The cache directory may be shared by several
+/// processes, also concurrently: objects are written to a temporary file and
+/// renamed, which is atomic. Eviction and statistics are serialized by an
+/// exclusive lock on a file within the cache directory.
+///
+/// Objects are evicted least recently used first, once the cache exceeds
+/// its maximum size.
+///
+/// Methods are thread safe.
+class render_cache
+{
+public:
+	struct statistics {
+		std::uintmax_t hits = 0;
+		std::uintmax_t misses = 0;
+		std::uintmax_t stores = 0;
+		std::uintmax_t evictions = 0;
+	};
+
+	/// \param[in] directory The cache directory, created if necessary.
+	/// \param[in] max_size Maximum size in bytes, `0` for no limit.
+	render_cache(const std::string & directory, std::uintmax_t max_size);
+
+	render_cache(const render_cache &) = delete;
+	render_cache & operator=(const render_cache &) = delete;
+
+	/// Returns the SHA-256 hash of the contents of the specified file. Hashes
+	/// are computed once per file.
+	std::string file_hash(const std::string & path);
+
+	/// Restores the document stored under the key to the specified file.
+	///
+	/// \return `true` if the document was found, `false` otherwise.
+	bool restore(const std::string & key, const std::string & filename_out);
+
+	/// Stores the specified file under the key.
+	void store(const std::string & key, const std::string & filename_out);
+
+	/// Evicts objects until the cache fits its maximum size, and adds the
+	/// statistics of this run to the ones recorded in the cache directory.
+	void finish();
+
+	/// Statistics of this run.
+	statistics stats() const;
+
+	/// Statistics recorded in the cache directory, of all runs.
+	statistics total_stats() const;
+
+private:
+	struct file_hash_entry {
+		std::int64_t mtime;
+		std::uintmax_t size;
+		std::string hash;
+	};
+
+	const std::string directory_;
+	const std::uintmax_t max_size_;
+	std::map<std::string, file_hash_entry> file_hashes_;
+	statistics stats_;
+	mutable std::mutex mtx_;
+
+	std::string object_path(const std::string & key) const;
+	std::string temp_path() const;
+	std::uintmax_t evict();
+};
+}
+
+#endif
@@ -12,16 +12,23 @@
 #define UTILS__SUBPROCESS__HPP
 
 #include <string>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
 #include <system_error>
 #include <vector>
 #include <istream>
 #include <ostream>
 #include <memory>
+#include <streambuf>
 
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
 #include <unistd.h>
 #include <sys/wait.h>
 
-#include <ext/stdio_filebuf.h>
+extern char ** environ;
 
 namespace utils
 {
@@ -29,23 +36,32 @@ namespace utils
 /// \brief Executes commands in a subprocess while providing streams
 ///        to communicate with the child process.
 ///
-/// \note This implementation is GCC specific.
+/// \note This class is not thread safe. However, distinct objects may be
+///       used concurrently from different threads.
 ///
-/// \note This class is not thread safe.
+/// The streams are buffered and transfer data in large blocks. While waiting
+/// for one of the streams, the outputs of the child (stdout and stderr) are
+/// read ahead and kept, a child blocking on a full pipe while the parent waits
+/// for something else would never terminate. This makes it safe to write
+/// the input of the child completely before reading its output and errors.
 ///
 /// Example:
 /// \code
 ///   utils::subprocess p{{"ls", "-l", "-a"}};
 ///
 ///   p.exec();
+///   std::cout << p.read_out();
+///   p.wait();
+/// \endcode
 ///
-///   p.out() >> std::noskipws;
-///   std::copy(
-///       std::istream_iterator<char>{p.out()},
-///       std::istream_iterator<char>{},
-///       std::ostream_iterator<char>{std::cout});
+/// Everything at once, without streams:
+/// \code
+///   utils::subprocess p{{"sort"}};
 ///
-///   p.wait();
+///   std::string out;
+///   std::string err;
+///   p.exec();
+///   const auto rc = p.communicate("b\na\n", out, err);
 /// \endcode
 ///
 /// This implementation is restartable, example:
@@ -72,6 +88,9 @@ namespace utils
 class subprocess final
 {
 public:
+	/// Size of the buffers of the streams, and of blocks read from the pipes.
+	static constexpr std::size_t buffer_size = 64 * 1024;
+
 	/// Initializes the object with a container of string, representing
 	/// the command to execute and its parameters.
 	///
@@ -88,12 +107,17 @@ public:
 
 	/// Closes all pipes. If not detached (default), it also waits for
 	/// the subprocess to terminate.
+	///
+	/// The pipes are closed before waiting, a child still reading its input
+	/// or writing its output would never terminate otherwise.
 	~subprocess()
 	{
+		close_in();
+		reset_all_streams();
+		close_all();
 		if (!detached) {
 			wait();
 		}
-		close_all();
 	}
 
 	/// Detaches the subprocess in the sense of not waiting for termination
@@ -105,24 +129,52 @@ public:
 	std::istream & out() { return *stream_out; }
 	std::istream & err() { return *stream_err; }
 
+	/// Reads everything the child writes to stdout, until it closes it.
+	std::string read_out() { return buffer_out->drain(); }
+
+	/// Reads everything the child writes to stderr, until it closes it.
+	std::string read_err() { return buffer_err->drain(); }
+
 	/// Closes the input stream, signalling the subprocess an end of file.
+	/// Buffered data is written before.
 	void close_in()
 	{
-		if (filebuf_in) {
-			filebuf_in->close();
+		if (stream_in) {
+			stream_in->flush();
 
-			filebuf_in.reset();
 			stream_in.reset();
+			buffer_in.reset();
 		}
+		io.close(IN);
 	}
 
-	/// Waits for the child process to terminate and returns its exit code.
+	/// Writes the input to the running child, closes its input, reads all
+	/// of its output and errors and waits for it to terminate.
 	///
 	/// \return The exit code of the child process.
+	int communicate(const std::string & input, std::string & output, std::string & errors)
+	{
+		in().write(input.data(), static_cast<std::streamsize>(input.size()));
+		close_in();
+		output = read_out();
+		errors = read_err();
+		return wait();
+	}
+
+	/// Waits for the child process to terminate and returns its exit code.
+	///
+	/// \return The exit code of the child process, `-1` if there is no child
+	///         process running.
 	int wait()
 	{
+		// never wait for `-1`, this would reap any child of the process,
+		// including the ones started concurrently by other threads
+		if (pid < 0)
+			return -1;
+
 		int status = 0;
-		::waitpid(pid, &status, 0);
+		while ((::waitpid(pid, &status, 0) == -1) && (errno == EINTR))
+			;
 		pid = -1;
 		return WEXITSTATUS(status);
 	}
@@ -155,8 +207,11 @@ public:
 		reset_all_streams();
 
 		// execution
-		setup_pipes(&destination.in());
+		setup_pipes(&destination);
 		execute();
+
+		// the child holds the input of the destination now
+		destination.close_in();
 		return *this;
 	}
 
@@ -180,9 +235,260 @@ public:
 	}
 
 private:
-	using file_buffer = __gnu_cxx::stdio_filebuf<char>;
-
 	enum pipe_end_type { READ = 0, WRITE = 1 };
+	enum channel_type { IN = 0, OUT = 1, ERR = 2 };
+
+	/// The ends of the pipes of the parent: input of the child, its output
+	/// and errors. All of them are non-blocking.
+	///
+	/// Waiting for one channel, the outputs of the child are read ahead and
+	/// kept until they are requested.
+	class channels
+	{
+	public:
+		channels() = default;
+		~channels()
+		{
+			for (int ch = IN; ch <= ERR; ++ch)
+				close(ch);
+		}
+
+		channels(const channels &) = delete;
+		channels & operator=(const channels &) = delete;
+
+		void open(int ch, int fd)
+		{
+			close(ch);
+			if (fd >= 0) {
+				const auto flags = ::fcntl(fd, F_GETFL);
+				if ((flags == -1) || (::fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1))
+					throw std::system_error(errno, std::system_category());
+			}
+			fds[ch] = fd;
+		}
+
+		void close(int ch)
+		{
+			if (fds[ch] >= 0) {
+				::close(fds[ch]);
+				fds[ch] = -1;
+			}
+			pending[ch].clear();
+		}
+
+		int fd(int ch) const { return fds[ch]; }
+
+		/// Reads from the output (`OUT`, `ERR`) of the child.
+		///
+		/// \return The number of bytes read, `0` at the end of file.
+		std::size_t read(int ch, char * buf, std::size_t n)
+		{
+			for (;;) {
+				if (!pending[ch].empty()) {
+					const auto k = std::min(n, pending[ch].size());
+					pending[ch].copy(buf, k);
+					pending[ch].erase(0, k);
+					return k;
+				}
+				if (fds[ch] < 0)
+					return 0;
+
+				if (!wait_for(ch))
+					continue;
+				const auto k = ::read(fds[ch], buf, n);
+				if (k > 0)
+					return static_cast<std::size_t>(k);
+				if ((k < 0) && ((errno == EAGAIN) || (errno == EINTR)))
+					continue;
+				close(ch);
+				return 0;
+			}
+		}
+
+		/// Writes everything to the input of the child.
+		///
+		/// \return `false` if the child does not read its input anymore.
+		bool write(const char * data, std::size_t n)
+		{
+			while (n > 0) {
+				if (fds[IN] < 0)
+					return false;
+				if (!wait_for(IN))
+					continue;
+				const auto k = ::write(fds[IN], data, n);
+				if (k < 0) {
+					if ((errno == EAGAIN) || (errno == EINTR))
+						continue;
+					return false;
+				}
+				data += k;
+				n -= static_cast<std::size_t>(k);
+			}
+			return true;
+		}
+
+	private:
+		int fds[3] = {-1, -1, -1};
+		std::string pending[3];
+
+		/// Waits until the channel is ready, reading ahead from the other
+		/// outputs meanwhile.
+		///
+		/// \return `true` if the channel is ready.
+		bool wait_for(int ch)
+		{
+			pollfd pfd[3];
+			int channel[3];
+			nfds_t n = 0;
+			for (int c = IN; c <= ERR; ++c) {
+				if ((fds[c] < 0) || ((c == IN) && (ch != IN)))
+					continue;
+				pfd[n] = {fds[c], static_cast<short>((c == IN) ? POLLOUT : POLLIN), 0};
+				channel[n] = c;
+				++n;
+			}
+
+			if (::poll(pfd, n, -1) == -1) {
+				if (errno == EINTR)
+					return false;
+				throw std::system_error(errno, std::system_category());
+			}
+
+			bool ready = false;
+			for (nfds_t i = 0; i < n; ++i) {
+				if (pfd[i].revents == 0)
+					continue;
+				if (channel[i] == ch) {
+					ready = true;
+				} else {
+					read_ahead(channel[i]);
+				}
+			}
+			return ready;
+		}
+
+		void read_ahead(int ch)
+		{
+			auto & s = pending[ch];
+			const auto size = s.size();
+			s.resize(size + buffer_size);
+			const auto k = ::read(fds[ch], &s[size], buffer_size);
+			s.resize(size + static_cast<std::size_t>(std::max<ssize_t>(k, 0)));
+			if ((k == 0) || ((k < 0) && (errno != EAGAIN) && (errno != EINTR))) {
+				::close(fds[ch]);
+				fds[ch] = -1; // data read so far remains pending
+			}
+		}
+	};
+
+	/// Stream buffer of the input of the child.
+	class in_buffer : public std::streambuf
+	{
+	public:
+		in_buffer(channels & io)
+			: io(io)
+			, buf(buffer_size)
+		{
+			setp(buf.data(), buf.data() + buf.size());
+		}
+
+	protected:
+		int_type overflow(int_type c) override
+		{
+			if (!flush_buffer())
+				return traits_type::eof();
+			if (!traits_type::eq_int_type(c, traits_type::eof())) {
+				*pptr() = traits_type::to_char_type(c);
+				pbump(1);
+			}
+			return traits_type::not_eof(c);
+		}
+
+		std::streamsize xsputn(const char * s, std::streamsize n) override
+		{
+			// large blocks are written directly
+			if (n < static_cast<std::streamsize>(buf.size()))
+				return std::streambuf::xsputn(s, n);
+			if (!flush_buffer() || !io.write(s, static_cast<std::size_t>(n)))
+				return 0;
+			return n;
+		}
+
+		int sync() override { return flush_buffer() ? 0 : -1; }
+
+	private:
+		channels & io;
+		std::vector<char> buf;
+
+		bool flush_buffer()
+		{
+			const auto n = static_cast<std::size_t>(pptr() - pbase());
+			setp(buf.data(), buf.data() + buf.size());
+			return (n == 0) || io.write(buf.data(), n);
+		}
+	};
+
+	/// Stream buffer of an output of the child, stdout or stderr.
+	class out_buffer : public std::streambuf
+	{
+	public:
+		out_buffer(channels & io, int ch)
+			: io(io)
+			, ch(ch)
+			, buf(buffer_size)
+		{
+			setg(buf.data(), buf.data(), buf.data());
+		}
+
+		/// Reads everything up to the end of file.
+		std::string drain()
+		{
+			std::string s{gptr(), egptr()};
+			setg(buf.data(), buf.data(), buf.data());
+			for (;;) {
+				const auto size = s.size();
+				s.resize(size + buffer_size);
+				const auto n = io.read(ch, &s[size], buffer_size);
+				s.resize(size + n);
+				if (n == 0)
+					return s;
+			}
+		}
+
+	protected:
+		int_type underflow() override
+		{
+			if (gptr() < egptr())
+				return traits_type::to_int_type(*gptr());
+			const auto n = io.read(ch, buf.data(), buf.size());
+			setg(buf.data(), buf.data(), buf.data() + n);
+			if (n == 0)
+				return traits_type::eof();
+			return traits_type::to_int_type(*gptr());
+		}
+
+		std::streamsize xsgetn(char * s, std::streamsize n) override
+		{
+			// buffered data first, large blocks are read directly
+			std::streamsize result = std::min<std::streamsize>(n, egptr() - gptr());
+			std::copy(gptr(), gptr() + result, s);
+			gbump(static_cast<int>(result));
+			while (result < n) {
+				if ((n - result) < static_cast<std::streamsize>(buf.size()))
+					return result + std::streambuf::xsgetn(s + result, n - result);
+				const auto k = io.read(ch, s + result, static_cast<std::size_t>(n - result));
+				if (k == 0)
+					break;
+				result += static_cast<std::streamsize>(k);
+			}
+			return result;
+		}
+
+	private:
+		channels & io;
+		const int ch;
+		std::vector<char> buf;
+	};
 
 	int pipe_in[2] = {-1, -1};
 	int pipe_out[2] = {-1, -1};
@@ -192,9 +498,11 @@ private:
 	std::vector<std::string> args;
 	bool detached;
 
-	std::unique_ptr<file_buffer> filebuf_in;
-	std::unique_ptr<file_buffer> filebuf_out;
-	std::unique_ptr<file_buffer> filebuf_err;
+	channels io;
+
+	std::unique_ptr<in_buffer> buffer_in;
+	std::unique_ptr<out_buffer> buffer_out;
+	std::unique_ptr<out_buffer> buffer_err;
 
 	std::unique_ptr<std::ostream> stream_in;
 	std::unique_ptr<std::istream> stream_out;
@@ -215,23 +523,41 @@ private:
 			throw std::runtime_error{"repeated start"};
 	}
 
-	void setup_pipes(std::ostream * destination = nullptr)
+	/// Creates a pipe which is not inherited by other child processes.
+	///
+	/// This matters if several subprocesses are started concurrently from
+	/// different threads: an inherited write end of a foreign pipe would
+	/// prevent the other child from ever seeing the end of its input.
+	/// The ends used by the child are duplicated onto its standard streams,
+	/// which clears the flag for them.
+	static void make_pipe(int p[2])
 	{
-		// in
-		if (::pipe(pipe_in) == -1)
+		if (::pipe2(p, O_CLOEXEC) == -1)
 			throw std::system_error(errno, std::system_category());
+	}
+
+	void setup_pipes(subprocess * destination = nullptr)
+	{
+		// in
+		make_pipe(pipe_in);
 
 		// out
 		if (destination) {
-			pipe_out[WRITE] = dynamic_cast<file_buffer *>(destination->rdbuf())->fd();
-		} else {
-			if (::pipe(pipe_out) == -1)
+			// own copy, the original belongs to the destination. The child
+			// writes to it, it must block like any other standard output.
+			const auto fd = destination->io.fd(IN);
+			pipe_out[WRITE] = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+			if (pipe_out[WRITE] == -1)
+				throw std::system_error(errno, std::system_category());
+			const auto flags = ::fcntl(fd, F_GETFL);
+			if ((flags == -1) || (::fcntl(fd, F_SETFL, flags & ~O_NONBLOCK) == -1))
 				throw std::system_error(errno, std::system_category());
+		} else {
+			make_pipe(pipe_out);
 		}
 
 		// err
-		if (::pipe(pipe_err) == -1)
-			throw std::system_error(errno, std::system_category());
+		make_pipe(pipe_err);
 	}
 
 	/// Closes all pipes and marks them invalid.
@@ -245,49 +571,27 @@ private:
 		close_pipe(pipe_err[WRITE]);
 	}
 
-	/// Destorys all streams and filebuffer objects.
+	/// Destroys all streams and buffers, and closes the channels.
 	void reset_all_streams()
 	{
-		filebuf_in.reset();
-		filebuf_out.reset();
-		filebuf_err.reset();
-
 		stream_in.reset();
 		stream_out.reset();
 		stream_err.reset();
-	}
 
-	/// Start child process and execute stuff.
-	void execute()
-	{
-		pid = ::fork();
-		if (pid == -1)
-			throw std::system_error(errno, std::system_category());
+		buffer_in.reset();
+		buffer_out.reset();
+		buffer_err.reset();
 
-		if (pid == 0) {
-			exec_child(); // does not return
-		} else {
-			exec_parent();
-		}
+		io.close(IN);
+		io.close(OUT);
+		io.close(ERR);
 	}
 
-	void exec_parent()
-	{
-		close_pipe(pipe_in[READ]);
-		close_pipe(pipe_out[WRITE]);
-		close_pipe(pipe_err[WRITE]);
-
-		filebuf_in = std::make_unique<file_buffer>(pipe_in[WRITE], std::ios_base::out, 1);
-		stream_in = std::make_unique<std::ostream>(filebuf_in.get());
-
-		filebuf_out = std::make_unique<file_buffer>(pipe_out[READ], std::ios_base::in, 1);
-		stream_out = std::make_unique<std::istream>(filebuf_out.get());
-
-		filebuf_err = std::make_unique<file_buffer>(pipe_err[READ], std::ios_base::in, 1);
-		stream_err = std::make_unique<std::istream>(filebuf_err.get());
-	}
-
-	void exec_child()
+	/// Starts the child process.
+	///
+	/// The child is spawned without copying the address space of the parent,
+	/// which matters for a parent of considerable size starting many children.
+	void execute()
 	{
 		struct mutable_string {
 			mutable_string(std::string s)
@@ -300,27 +604,56 @@ private:
 			mutable std::vector<char> data;
 		};
 
-		// substitute stdin, stdout and stderr with pipes
-		if (::dup2(pipe_in[READ], STDIN_FILENO) == -1)
-			throw std::system_error(errno, std::system_category());
-		if (::dup2(pipe_out[WRITE], STDOUT_FILENO) == -1)
-			throw std::system_error(errno, std::system_category());
-		if (::dup2(pipe_err[WRITE], STDERR_FILENO) == -1)
-			throw std::system_error(errno, std::system_category());
-
-		close_all();
-
-		// prepare parameters for 'execvp'
+		// prepare parameters for 'posix_spawnp'
 		std::vector<mutable_string> tm{args.begin(), args.end()};
 		std::vector<char *> params(tm.begin(), tm.end());
 		params.push_back(nullptr);
 
-		if (execvp(params[0], &params[0]) != -1)
-			throw std::system_error(errno, std::system_category());
+		// substitute stdin, stdout and stderr with pipes, all other
+		// descriptors are closed on execution
+		posix_spawn_file_actions_t actions;
+		::posix_spawn_file_actions_init(&actions);
+		::posix_spawn_file_actions_adddup2(&actions, pipe_in[READ], STDIN_FILENO);
+		::posix_spawn_file_actions_adddup2(&actions, pipe_out[WRITE], STDOUT_FILENO);
+		::posix_spawn_file_actions_adddup2(&actions, pipe_err[WRITE], STDERR_FILENO);
+
+		const auto rc = ::posix_spawnp(&pid, params[0], &actions, nullptr, &params[0], environ);
+		::posix_spawn_file_actions_destroy(&actions);
+		if (rc != 0) {
+			pid = -1;
+			close_all();
+			throw std::system_error(rc, std::system_category());
+		}
+
+		exec_parent();
+	}
+
+	void exec_parent()
+	{
+		close_pipe(pipe_in[READ]);
+		close_pipe(pipe_out[WRITE]);
+		close_pipe(pipe_err[WRITE]);
+
+		// the channels own the descriptors now and close them
+		io.open(IN, pipe_in[WRITE]);
+		io.open(OUT, pipe_out[READ]);
+		io.open(ERR, pipe_err[READ]);
+		pipe_in[WRITE] = -1;
+		pipe_out[READ] = -1;
+		pipe_err[READ] = -1;
+
+		buffer_in = std::make_unique<in_buffer>(io);
+		stream_in = std::make_unique<std::ostream>(buffer_in.get());
+
+		buffer_out = std::make_unique<out_buffer>(io, OUT);
+		stream_out = std::make_unique<std::istream>(buffer_out.get());
+
+		buffer_err = std::make_unique<out_buffer>(io, ERR);
+		stream_err = std::make_unique<std::istream>(buffer_err.get());
 	}
 };
 
-subprocess & operator>>(subprocess & source, subprocess & destination)
+inline subprocess & operator>>(subprocess & source, subprocess & destination)
 {
 	return source(destination());
 }
@@ -1,9 +1,12 @@
 #include "system.hpp"
 #include <experimental/filesystem>
+#include <sstream>
+#include <tuple>
 #include <cerrno>
 #include <unistd.h>
 #include <linux/limits.h>
 #include "config.hpp"
+#include "subprocess.hpp"
 #include "version.hpp"
 
 namespace mkweb
@@ -14,7 +17,9 @@ using std::experimental::filesystem::exists;
 }
 
 std::shared_ptr<config> system::cfg_;
+std::unique_ptr<theme> system::theme_;
 std::string system::pandoc_ = "pandoc";
+std::string system::pandoc_version_;
 
 std::string system::path_to_binary()
 {
@@ -34,15 +39,19 @@ std::string system::path_to_binary()
 
 std::string system::path_to_shared()
 {
-	return path_to_binary() + "/../shared/" + mkweb::project_name() + '/';
+	// the binary does not move while running
+	static const std::string path
+		= path_to_binary() + "/../shared/" + mkweb::project_name() + '/';
+	return path;
 }
 
 void system::reset(const std::shared_ptr<config> & cfg)
 {
 	cfg_ = cfg;
+	theme_.reset();
 }
 
-config & system::cfg()
+const config & system::cfg()
 {
 	return *cfg_;
 }
@@ -57,9 +66,11 @@ std::string system::get_sitemap_filename()
 	return "sitemap.html";
 }
 
-theme system::get_theme()
+const theme & system::get_theme()
 {
-	return theme{get_theme_path()};
+	if (!theme_)
+		theme_.reset(new theme{get_theme_path()});
+	return *theme_;
 }
 
 std::string system::get_theme_path()
@@ -80,5 +91,34 @@ std::string system::pandoc()
 void system::set_pandoc(const std::string & path)
 {
 	pandoc_ = path;
+	pandoc_version_.clear();
+}
+
+std::string system::pandoc_version()
+{
+	if (pandoc_version_.empty()) {
+		utils::subprocess p{{pandoc(), "--version"}};
+		p.exec();
+
+		// first line is something like: "pandoc 2.19.2"
+		std::string name;
+		p.out() >> name >> pandoc_version_;
+		p.close_in();
+		p.wait();
+
+		if (pandoc_version_.empty())
+			throw std::runtime_error{"unable to determine version of: " + pandoc()};
+	}
+	return pandoc_version_;
+}
+
+bool system::pandoc_version_at_least(int major, int minor)
+{
+	std::istringstream is{pandoc_version()};
+	int v_major = 0;
+	int v_minor = 0;
+	char dot;
+	is >> v_major >> dot >> v_minor;
+	return std::tie(v_major, v_minor) >= std::tie(major, minor);
 }
 }
@@ -17,19 +17,26 @@ public:
 	static std::string path_to_shared();
 
 	static void reset(const std::shared_ptr<config> & cfg);
-	static config & cfg();
+	static const config & cfg();
 
 	static plugin get_plugin(const std::string & name);
-	static theme get_theme();
+	/// The theme is resolved once per configuration.
+	static const theme & get_theme();
 
 	static std::string get_sitemap_filename();
 
 	static std::string pandoc();
 	static void set_pandoc(const std::string & path);
 
+	/// Version as reported by `pandoc --version`, e.g. `2.19.2`, determined once.
+	static std::string pandoc_version();
+	static bool pandoc_version_at_least(int major, int minor);
+
 private:
 	static std::shared_ptr<config> cfg_;
+	static std::unique_ptr<theme> theme_;
 	static std::string pandoc_;
+	static std::string pandoc_version_;
 
 	static std::string get_theme_path();
 };
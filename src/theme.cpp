@@ -10,6 +10,7 @@ using std::experimental::filesystem::exists;
 
 theme::theme(const std::string & path)
 	: path(path)
+	, footer(fs::exists(path + "footer.html") ? path + "footer.html" : std::string{})
 {
 }
 
@@ -45,8 +46,7 @@ std::string theme::get_style() const
 
 std::string theme::get_footer() const
 {
-	const auto p = path + "footer.html";
-	return fs::exists(p) ? p : std::string{};
+	return footer;
 }
 
 std::string theme::get_title_newest_entries() const
@@ -21,6 +21,7 @@ public:
 
 private:
 	const std::string path;
+	const std::string footer; // optional, empty if the theme has none
 
 	theme(const std::string & path);
 };
@@ -0,0 +1,93 @@
+#include "trace.hpp"
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <nlohmann/json.hpp>
+#include <unistd.h>
+
+namespace mkweb
+{
+trace::trace()
+	: origin_(clock::now())
+	, threads_{std::this_thread::get_id()}
+{
+}
+
+double trace::since_origin(clock::time_point t) const
+{
+	return std::chrono::duration<double, std::micro>(t - origin_).count();
+}
+
+int trace::thread_number()
+{
+	const auto id = std::this_thread::get_id();
+	const auto i = std::find(begin(threads_), end(threads_), id);
+	if (i != end(threads_))
+		return static_cast<int>(i - begin(threads_)) + 1;
+	threads_.push_back(id);
+	return static_cast<int>(threads_.size());
+}
+
+void trace::complete(const std::string & name, const std::string & category,
+	clock::time_point start, clock::time_point end, const arguments & args)
+{
+	std::lock_guard<std::mutex> lock{mtx_};
+	events_.push_back({name, category, 'X', since_origin(start),
+		std::chrono::duration<double, std::micro>(end - start).count(), thread_number(), 0,
+		args});
+}
+
+void trace::async(const std::string & name, const std::string & category, std::uint64_t id,
+	clock::time_point start, clock::time_point end, const arguments & args)
+{
+	std::lock_guard<std::mutex> lock{mtx_};
+	const auto thread = thread_number();
+	events_.push_back({name, category, 'b', since_origin(start), 0.0, thread, id, args});
+	events_.push_back({name, category, 'e', since_origin(end), 0.0, thread, id, {}});
+}
+
+std::uint64_t trace::next_id()
+{
+	std::lock_guard<std::mutex> lock{mtx_};
+	return next_id_++;
+}
+
+void trace::write(const std::string & filename) const
+{
+	const auto pid = static_cast<int>(::getpid());
+
+	auto events = nlohmann::json::array();
+	{
+		std::lock_guard<std::mutex> lock{mtx_};
+
+		for (std::size_t i = 0; i < threads_.size(); ++i) {
+			const auto name = (i == 0) ? std::string{"main"} : "worker " + std::to_string(i);
+			events.push_back({{"name", "thread_name"}, {"ph", "M"}, {"pid", pid},
+				{"tid", static_cast<int>(i) + 1}, {"args", {{"name", name}}}});
+		}
+
+		for (const auto & e : events_) {
+			nlohmann::json event = {{"name", e.name}, {"cat", e.category},
+				{"ph", std::string(1, e.phase)}, {"ts", e.timestamp}, {"pid", pid},
+				{"tid", e.thread}};
+			if (e.phase == 'X') {
+				event["dur"] = e.duration;
+			} else {
+				event["id"] = e.id;
+			}
+			if (!e.args.empty()) {
+				auto & args = event["args"];
+				for (const auto & arg : e.args)
+					args[arg.first] = arg.second;
+			}
+			events.push_back(std::move(event));
+		}
+	}
+
+	std::ofstream ofs{filename.c_str()};
+	ofs << nlohmann::json{{"traceEvents", std::move(events)}, {"displayTimeUnit", "ms"}}.dump()
+		<< '\n';
+	if (!ofs)
+		throw std::runtime_error{"unable to write file: " + filename};
+}
+}
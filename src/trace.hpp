@@ -0,0 +1,103 @@
+#ifndef MKWEB__TRACE__HPP
+#define MKWEB__TRACE__HPP
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace mkweb
+{
+/// Records spans of time of a build, written in the Chrome trace event
+/// format (JSON), which is read by `chrome://tracing` and Perfetto.
+///
+/// Spans are recorded with the thread recording them. Threads are numbered
+/// in the order of their first span, the thread constructing the trace is
+/// the first one, named `main`.
+///
+/// \note This class is thread safe.
+class trace
+{
+public:
+	using clock = std::chrono::steady_clock;
+	using arguments = std::vector<std::pair<std::string, std::string>>;
+
+	trace();
+
+	trace(const trace &) = delete;
+	trace & operator=(const trace &) = delete;
+
+	/// Records a span on the calling thread. Spans of a thread have to nest,
+	/// as function calls do.
+	void complete(const std::string & name, const std::string & category,
+		clock::time_point start, clock::time_point end, const arguments & args = {});
+
+	/// Records a span which may overlap others of the calling thread, e.g.
+	/// of a child process. Spans of the same category and identifier are
+	/// shown on a track of their own, they have to nest.
+	void async(const std::string & name, const std::string & category, std::uint64_t id,
+		clock::time_point start, clock::time_point end, const arguments & args = {});
+
+	/// Returns an identifier for `async` spans, unique within the trace.
+	std::uint64_t next_id();
+
+	/// Writes all spans recorded so far.
+	///
+	/// \exception std::runtime_error The file could not be written.
+	void write(const std::string & filename) const;
+
+private:
+	struct event {
+		std::string name;
+		std::string category;
+		char phase; // 'X': complete, 'b'/'e': begin/end of an async span
+		double timestamp; // microseconds since the start of the trace
+		double duration;
+		int thread;
+		std::uint64_t id;
+		arguments args;
+	};
+
+	const clock::time_point origin_;
+	mutable std::mutex mtx_;
+	std::vector<event> events_;
+	std::vector<std::thread::id> threads_;
+	std::uint64_t next_id_ = 1;
+
+	double since_origin(clock::time_point t) const;
+	int thread_number();
+};
+
+/// Records a span on the calling thread for its lifetime, if there is a trace.
+class trace_span
+{
+public:
+	trace_span(trace * t, const std::string & name, const std::string & category)
+		: trace_(t)
+		, name_(t ? name : std::string{})
+		, category_(category)
+		, start_(t ? trace::clock::now() : trace::clock::time_point{})
+	{
+	}
+
+	~trace_span()
+	{
+		if (trace_)
+			trace_->complete(name_, category_, start_, trace::clock::now());
+	}
+
+	trace_span(const trace_span &) = delete;
+	trace_span & operator=(const trace_span &) = delete;
+
+private:
+	trace * const trace_;
+	const std::string name_;
+	const std::string category_;
+	const trace::clock::time_point start_;
+};
+}
+
+#endif
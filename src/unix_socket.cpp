@@ -0,0 +1,213 @@
+#include "unix_socket.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace mkweb
+{
+namespace
+{
+sockaddr_un make_address(const std::string & path)
+{
+	sockaddr_un addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(addr.sun_path))
+		throw std::runtime_error{"socket path too long: " + path};
+	std::memcpy(addr.sun_path, path.c_str(), path.size());
+	return addr;
+}
+
+int open_socket()
+{
+	const auto fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd == -1)
+		throw std::runtime_error{std::string{"unable to create socket: "} + std::strerror(errno)};
+	return fd;
+}
+
+/// Returns `true` if a server is listening on the socket.
+bool try_connect(int fd, const std::string & path)
+{
+	const auto addr = make_address(path);
+	return ::connect(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) == 0;
+}
+}
+
+socket_connection::socket_connection(int fd)
+	: fd_(fd)
+{
+}
+
+socket_connection::~socket_connection()
+{
+	if (fd_ >= 0)
+		::close(fd_);
+}
+
+socket_connection::socket_connection(socket_connection && other)
+	: fd_(other.fd_)
+	, buffer_(std::move(other.buffer_))
+	, closed_(other.closed_)
+{
+	other.fd_ = -1;
+}
+
+socket_connection & socket_connection::operator=(socket_connection && other)
+{
+	if (this != &other) {
+		if (fd_ >= 0)
+			::close(fd_);
+		fd_ = other.fd_;
+		buffer_ = std::move(other.buffer_);
+		closed_ = other.closed_;
+		other.fd_ = -1;
+	}
+	return *this;
+}
+
+socket_connection socket_connection::connect(const std::string & path)
+{
+	socket_connection c{open_socket()};
+	if (!try_connect(c.fd_, path))
+		throw std::runtime_error{"no server listening on: " + path};
+	return c;
+}
+
+bool socket_connection::receive(std::string & message)
+{
+	char buf[4096];
+	while (!next_message(message)) {
+		// a signal interrupts waiting, the caller may have been asked to stop
+		const auto n = ::read(fd_, buf, sizeof(buf));
+		if (n <= 0)
+			return false;
+		buffer_.append(buf, static_cast<std::size_t>(n));
+	}
+	return true;
+}
+
+/// Takes the next complete message out of the buffer, if there is one.
+bool socket_connection::next_message(std::string & message)
+{
+	const auto end = buffer_.find('\n');
+	if (end == std::string::npos)
+		return false;
+	message = buffer_.substr(0, end);
+	buffer_.erase(0, end + 1);
+	return true;
+}
+
+/// Reads the data available, to be called if the socket is readable.
+///
+/// \return `false` if the connection was closed, or has failed.
+bool socket_connection::read_some()
+{
+	char buf[4096];
+	const auto n = ::read(fd_, buf, sizeof(buf));
+	if (n < 0)
+		return (errno == EINTR) || (errno == EAGAIN);
+	if (n == 0)
+		return false;
+	buffer_.append(buf, static_cast<std::size_t>(n));
+	return true;
+}
+
+void socket_connection::send(const std::string & message)
+{
+	const auto data = message + '\n';
+	std::size_t pos = 0;
+	while (pos < data.size()) {
+		const auto n = ::send(fd_, data.data() + pos, data.size() - pos, MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			throw std::runtime_error{std::string{"unable to send: "} + std::strerror(errno)};
+		}
+		pos += static_cast<std::size_t>(n);
+	}
+}
+
+socket_server::socket_server(const std::string & path)
+	: path_(path)
+	, fd_(open_socket())
+{
+	const auto addr = make_address(path_);
+
+	// a socket file without a server listening is left over, a server running is not replaced
+	if (::access(path_.c_str(), F_OK) == 0) {
+		const auto probe = open_socket();
+		const auto running = try_connect(probe, path_);
+		::close(probe);
+		if (running) {
+			::close(fd_);
+			throw std::runtime_error{"server already listening on: " + path_};
+		}
+		::unlink(path_.c_str());
+	}
+
+	if (::bind(fd_, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) != 0
+		|| ::listen(fd_, 8) != 0) {
+		const auto error = errno;
+		::close(fd_);
+		throw std::runtime_error{
+			"unable to listen on socket " + path_ + ": " + std::strerror(error)};
+	}
+}
+
+socket_server::~socket_server()
+{
+	::close(fd_);
+	::unlink(path_.c_str());
+}
+
+std::experimental::optional<socket_server::request> socket_server::receive()
+{
+	for (;;) {
+		// messages received already, clients in turn
+		for (std::size_t i = 0; i < clients_.size(); ++i) {
+			const auto n = (next_ + i) % clients_.size();
+			std::string message;
+			if (clients_[n].next_message(message)) {
+				next_ = n + 1;
+				return request{&clients_[n], std::move(message)};
+			}
+		}
+
+		clients_.erase(std::remove_if(begin(clients_), end(clients_),
+						   [](const socket_connection & c) { return c.closed_; }),
+			end(clients_));
+
+		// poll is not restarted after signals, unlike read and accept
+		std::vector<pollfd> fds{{fd_, POLLIN, 0}};
+		for (const auto & client : clients_)
+			fds.push_back({client.fd_, POLLIN, 0});
+		if (::poll(fds.data(), fds.size(), -1) == -1) {
+			if (errno == EINTR)
+				return {};
+			throw std::runtime_error{
+				std::string{"unable to wait for clients: "} + std::strerror(errno)};
+		}
+
+		for (std::size_t i = 0; i < clients_.size(); ++i) {
+			if (fds[i + 1].revents && !clients_[i].read_some())
+				clients_[i].closed_ = true;
+		}
+
+		if (fds[0].revents & POLLIN) {
+			const auto fd = ::accept4(fd_, nullptr, nullptr, SOCK_CLOEXEC);
+			if (fd != -1) {
+				clients_.emplace_back(fd);
+			} else if ((errno != EINTR) && (errno != EAGAIN) && (errno != ECONNABORTED)) {
+				throw std::runtime_error{
+					std::string{"unable to accept: "} + std::strerror(errno)};
+			}
+		}
+	}
+}
+}
@@ -0,0 +1,83 @@
+#ifndef MKWEB__UNIX_SOCKET__HPP
+#define MKWEB__UNIX_SOCKET__HPP
+
+#include <string>
+#include <vector>
+#include <experimental/optional>
+
+namespace mkweb
+{
+/// A connection over a Unix domain socket, messages are single lines.
+class socket_connection
+{
+public:
+	explicit socket_connection(int fd);
+	~socket_connection();
+
+	socket_connection(const socket_connection &) = delete;
+	socket_connection & operator=(const socket_connection &) = delete;
+
+	socket_connection(socket_connection && other);
+	socket_connection & operator=(socket_connection && other);
+
+	/// Connects to the server listening on the specified socket.
+	///
+	/// \exception std::runtime_error No server is listening.
+	static socket_connection connect(const std::string & path);
+
+	/// Receives a message, without the line break.
+	///
+	/// \return `false` if the connection was closed, or if interrupted by a signal.
+	bool receive(std::string & message);
+
+	/// Sends a message, which must not contain line breaks.
+	void send(const std::string & message);
+
+private:
+	friend class socket_server;
+
+	int fd_ = -1;
+	std::string buffer_;
+	bool closed_ = false; // by the peer, messages may still be buffered
+
+	bool next_message(std::string & message);
+	bool read_some();
+};
+
+/// A server listening on a Unix domain socket, serving any number of clients.
+///
+/// The socket file is created by the server and removed at its destruction.
+/// A stale socket file, without a server listening, is replaced.
+class socket_server
+{
+public:
+	/// A message of a client, see `receive`.
+	struct request {
+		socket_connection * client; ///< valid until the next call of `receive`
+		std::string message;
+	};
+
+	/// \exception std::runtime_error The socket cannot be created, or another
+	///   server is listening on it already.
+	socket_server(const std::string & path);
+	~socket_server();
+
+	socket_server(const socket_server &) = delete;
+	socket_server & operator=(const socket_server &) = delete;
+
+	/// Waits for the next message of any client, accepting new clients
+	/// meanwhile. Clients are served in turn, a client keeping its connection
+	/// open does not block others. Connections closed by clients are dropped.
+	///
+	/// \return The message and its client, empty if interrupted by a signal.
+	std::experimental::optional<request> receive();
+
+private:
+	std::string path_;
+	int fd_ = -1;
+	std::vector<socket_connection> clients_;
+	std::size_t next_ = 0; // client served first by the next call, in turn
+};
+}
+
+#endif
@@ -0,0 +1,142 @@
+#include "watcher.hpp"
+#include <cerrno>
+#include <cstdint>
+#include <system_error>
+#include <experimental/filesystem>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace mkweb
+{
+namespace fs
+{
+using recursive_directory_iterator
+	= std::experimental::filesystem::recursive_directory_iterator;
+using std::experimental::filesystem::is_directory;
+}
+
+namespace
+{
+constexpr std::uint32_t event_mask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM
+	| IN_MOVED_TO | IN_ATTRIB | IN_ONLYDIR;
+}
+
+constexpr int watcher::overflow;
+
+watcher::watcher()
+	: fd_(::inotify_init1(IN_CLOEXEC | IN_NONBLOCK))
+{
+	if (fd_ == -1)
+		throw std::system_error(errno, std::system_category());
+}
+
+watcher::~watcher()
+{
+	::close(fd_);
+}
+
+void watcher::add(const std::string & directory, int tag, bool recursive)
+{
+	std::error_code ec;
+	if (!fs::is_directory(directory, ec))
+		return;
+
+	const auto wd = ::inotify_add_watch(fd_, directory.c_str(), event_mask);
+	if (wd == -1) {
+		// removed meanwhile, e.g. a temporary directory reported by an event
+		if ((errno == ENOENT) || (errno == ENOTDIR))
+			return;
+		throw std::system_error(errno, std::system_category());
+	}
+	add_watch(wd, directory, tag, recursive);
+
+	if (!recursive)
+		return;
+
+	for (const auto & entry : fs::recursive_directory_iterator{directory, ec}) {
+		if (!fs::is_directory(entry.path(), ec))
+			continue;
+		const auto sub = ::inotify_add_watch(fd_, entry.path().c_str(), event_mask);
+		if (sub != -1)
+			add_watch(sub, entry.path().string(), tag, true);
+	}
+}
+
+/// Records a watch. A directory watched more than once has only one watch,
+/// its tags are combined.
+void watcher::add_watch(int wd, const std::string & path, int tag, bool recursive)
+{
+	const auto i = watches_.find(wd);
+	if (i == watches_.end()) {
+		watches_[wd] = {path, tag, recursive};
+		return;
+	}
+	i->second.tag |= tag;
+	i->second.recursive = i->second.recursive || recursive;
+}
+
+void watcher::read_events(std::vector<change> & changes)
+{
+	alignas(inotify_event) char buf[64 * 1024];
+
+	for (;;) {
+		const auto n = ::read(fd_, buf, sizeof(buf));
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN)
+				return;
+			throw std::system_error(errno, std::system_category());
+		}
+
+		for (auto * p = buf; p < buf + n;) {
+			const auto * ev = reinterpret_cast<const inotify_event *>(p);
+			p += sizeof(inotify_event) + ev->len;
+
+			if (ev->mask & IN_Q_OVERFLOW) {
+				changes.push_back({overflow, {}});
+				continue;
+			}
+
+			const auto i = watches_.find(ev->wd);
+			if (i == watches_.end())
+				continue;
+			if (ev->mask & IN_IGNORED) {
+				watches_.erase(i);
+				continue;
+			}
+
+			const auto w = i->second;
+			const auto path = (ev->len > 0) ? (w.path + '/' + ev->name) : w.path;
+			changes.push_back({w.tag, path});
+
+			// new subdirectories of recursively watched directories
+			if (w.recursive && (ev->mask & IN_ISDIR) && (ev->mask & (IN_CREATE | IN_MOVED_TO)))
+				add(path, w.tag, true);
+		}
+	}
+}
+
+std::vector<watcher::change> watcher::wait(std::chrono::milliseconds quiet)
+{
+	std::vector<change> changes;
+
+	pollfd pfd{fd_, POLLIN, 0};
+	auto timeout = -1; // first wait for any change
+	for (;;) {
+		const auto rc = ::poll(&pfd, 1, timeout);
+		if (rc == -1) {
+			if (errno == EINTR)
+				return changes;
+			throw std::system_error(errno, std::system_category());
+		}
+		if (rc == 0)
+			return changes;
+
+		read_events(changes);
+		if (!changes.empty())
+			timeout = static_cast<int>(quiet.count());
+	}
+}
+}
@@ -0,0 +1,59 @@
+#ifndef MKWEB__WATCHER__HPP
+#define MKWEB__WATCHER__HPP
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace mkweb
+{
+/// Watches directories for changes of files, using inotify.
+///
+/// Each watched directory is associated with a tag, which is reported along
+/// with the changed paths. Tags are bit flags, they are combined for
+/// directories watched more than once. Subdirectories of recursively watched
+/// directories are watched as well, also if they are created later on.
+class watcher
+{
+public:
+	struct change {
+		int tag;
+		std::string path;
+	};
+
+	/// Tag reported if events were lost, everything has to be considered changed.
+	static constexpr int overflow = -1;
+
+	watcher();
+	~watcher();
+
+	watcher(const watcher &) = delete;
+	watcher & operator=(const watcher &) = delete;
+
+	/// Watches the specified directory, nonexistent directories are ignored.
+	void add(const std::string & directory, int tag, bool recursive = true);
+
+	/// Blocks until there are changes, and then until no more changes happen
+	/// for the specified period of time. This way bursts of changes, like
+	/// saving a file by an editor or copying a directory, are reported at once.
+	///
+	/// Returns early if interrupted by a signal, possibly without changes.
+	std::vector<change> wait(std::chrono::milliseconds quiet);
+
+private:
+	struct watch {
+		std::string path;
+		int tag;
+		bool recursive;
+	};
+
+	int fd_;
+	std::map<int, watch> watches_;
+
+	void add_watch(int wd, const std::string & path, int tag, bool recursive);
+	void read_events(std::vector<change> & changes);
+};
+}
+
+#endif
@@ -0,0 +1,74 @@
+#include "worker_pool.hpp"
+#include <algorithm>
+
+namespace mkweb
+{
+worker_pool::worker_pool(std::size_t num_workers)
+{
+	num_workers = std::max<std::size_t>(num_workers, 1u);
+	workers_.reserve(num_workers);
+	for (std::size_t i = 0; i < num_workers; ++i)
+		workers_.emplace_back([this] { run(); });
+}
+
+worker_pool::~worker_pool()
+{
+	{
+		std::lock_guard<std::mutex> lock{mtx_};
+		stop_ = true;
+	}
+	cv_jobs_.notify_all();
+	for (auto & worker : workers_)
+		worker.join();
+}
+
+void worker_pool::submit(job j)
+{
+	{
+		std::lock_guard<std::mutex> lock{mtx_};
+		jobs_.push_back(std::move(j));
+	}
+	cv_jobs_.notify_one();
+}
+
+void worker_pool::wait()
+{
+	std::unique_lock<std::mutex> lock{mtx_};
+	cv_idle_.wait(lock, [this] { return jobs_.empty() && (active_ == 0); });
+}
+
+std::size_t worker_pool::size() const
+{
+	return workers_.size();
+}
+
+std::size_t worker_pool::default_size()
+{
+	return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+void worker_pool::run()
+{
+	for (;;) {
+		job j;
+		{
+			std::unique_lock<std::mutex> lock{mtx_};
+			cv_jobs_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+			if (jobs_.empty())
+				return;
+			j = std::move(jobs_.front());
+			jobs_.pop_front();
+			++active_;
+		}
+
+		j();
+
+		{
+			std::lock_guard<std::mutex> lock{mtx_};
+			--active_;
+			if (jobs_.empty() && (active_ == 0))
+				cv_idle_.notify_all();
+		}
+	}
+}
+}
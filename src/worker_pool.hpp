@@ -0,0 +1,55 @@
+#ifndef MKWEB__WORKER_POOL__HPP
+#define MKWEB__WORKER_POOL__HPP
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mkweb
+{
+/// A fixed number of worker threads, executing jobs in the order of
+/// their submission.
+///
+/// Jobs must not throw, exceptions have to be handled by the jobs themselves.
+class worker_pool
+{
+public:
+	using job = std::function<void()>;
+
+	worker_pool(std::size_t num_workers);
+	~worker_pool();
+
+	worker_pool(const worker_pool &) = delete;
+	worker_pool & operator=(const worker_pool &) = delete;
+
+	worker_pool(worker_pool &&) = delete;
+	worker_pool & operator=(worker_pool &&) = delete;
+
+	/// Queues the specified job for execution.
+	void submit(job j);
+
+	/// Blocks until all submitted jobs are finished.
+	void wait();
+
+	std::size_t size() const;
+
+	/// Returns the number of workers suitable for this machine, at least `1`.
+	static std::size_t default_size();
+
+private:
+	std::vector<std::thread> workers_;
+	std::deque<job> jobs_;
+	std::mutex mtx_;
+	std::condition_variable cv_jobs_;
+	std::condition_variable cv_idle_;
+	std::size_t active_ = 0;
+	bool stop_ = false;
+
+	void run();
+};
+}
+
+#endif